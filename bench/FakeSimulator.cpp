@@ -0,0 +1,494 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "FakeSimulator.h"
+#include "../code/lib/auxiliary.h"
+
+// Height of each valve row in percent of the lift, row 1 sits at the bottom.
+static const double rowHeight[3] = { 0.0, 40.0, 70.0 };
+
+FakeSluiceModel standardModel()
+{
+	FakeSluiceModel model;
+	model.doorTravelMs = 4000;
+	model.pulseMs = 0;
+	model.fastLock = false;
+	model.fillPerRowPerS = 3.0;
+	model.drainPerRowPerS = 3.0;
+	model.timeScale = 0.01;
+	model.replyDelayUs = 0;
+	return model;
+}
+
+FakeSluiceModel fastLockModel()
+{
+	FakeSluiceModel model = standardModel();
+	model.fastLock = true;
+	return model;
+}
+
+FakeSluiceModel pulseMotorModel()
+{
+	FakeSluiceModel model = standardModel();
+	model.pulseMs = 600;
+	return model;
+}
+
+FakeSimulator::FakeSimulator(int port, FakeSluiceModel Model)
+{
+	model = Model;
+	stopping = false;
+	restartRequested = false;
+	jammed = false;
+	refused[0] = '\0';
+	refusals = 0;
+	clientSock = -1;
+	pthread_mutex_init(&lock, NULL);
+	resetCounters();
+	lastUpdate = simulatedNow();
+	reset();
+
+	struct sockaddr_in addr;
+	int one = 1;
+	listenSock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+	setsockopt(listenSock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	addr.sin_port = htons(port);
+	if (bind(listenSock, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(listenSock, 4) != 0)
+	{
+		DieWithError("FakeSimulator: listen failed");
+	}
+
+	pthread_create(&thread, NULL, &FakeSimulator::serve, this);
+}
+
+FakeSimulator::~FakeSimulator()
+{
+	stopping = true;
+	pthread_join(thread, NULL);
+	close(listenSock);
+	pthread_mutex_destroy(&lock);
+}
+
+void FakeSimulator::reset()
+{
+	level = 0.0;
+	for (int side = 0; side < 2; side++)
+	{
+		for (int row = 0; row < 3; row++)
+		{
+			valveOpen[side][row] = false;
+		}
+		doorPosition[side] = 0.0;
+		doorMotion[side] = 0;
+		pulseStarted[side] = 0;
+		doorLocked[side] = model.fastLock;
+		doorDamaged[side] = false;
+	}
+	for (int light = 0; light < 4; light++)
+	{
+		redOn[light] = true;
+		greenOn[light] = false;
+	}
+}
+
+FakeCounters FakeSimulator::counters()
+{
+	pthread_mutex_lock(&lock);
+	FakeCounters copy = count;
+	pthread_mutex_unlock(&lock);
+	return copy;
+}
+
+void FakeSimulator::resetCounters()
+{
+	pthread_mutex_lock(&lock);
+	count.queries = 0;
+	count.commands = 0;
+	count.unsafeValves = 0;
+	count.roundTrips = 0;
+	pthread_mutex_unlock(&lock);
+}
+
+double FakeSimulator::waterLevel()
+{
+	pthread_mutex_lock(&lock);
+	update();
+	double copy = level;
+	pthread_mutex_unlock(&lock);
+	return copy;
+}
+
+double FakeSimulator::doorOpened(int side)
+{
+	pthread_mutex_lock(&lock);
+	update();
+	double copy = doorPosition[side];
+	pthread_mutex_unlock(&lock);
+	return copy;
+}
+
+void FakeSimulator::jam(bool Jammed)
+{
+	pthread_mutex_lock(&lock);
+	update(); // Moves up to now happened
+	jammed = Jammed;
+	pthread_mutex_unlock(&lock);
+}
+
+void FakeSimulator::refuse(const char command[], int times)
+{
+	pthread_mutex_lock(&lock);
+	strncpy(refused, command, sizeof(refused) - 1);
+	refused[sizeof(refused) - 1] = '\0';
+	refusals = times;
+	pthread_mutex_unlock(&lock);
+}
+
+bool FakeSimulator::lightShows(int location, bool red)
+{
+	pthread_mutex_lock(&lock);
+	bool lit = red ? redOn[location] : greenOn[location];
+	pthread_mutex_unlock(&lock);
+	return lit;
+}
+
+void FakeSimulator::restart()
+{
+	pthread_mutex_lock(&lock);
+	restartRequested = true;
+	pthread_mutex_unlock(&lock);
+}
+
+long long FakeSimulator::simulatedNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	double realMs = ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+	return (long long) (realMs / model.timeScale);
+}
+
+void FakeSimulator::update()
+{
+	long long now = simulatedNow();
+	long long previous = lastUpdate;
+	double elapsedS = (now - previous) / 1000.0;
+	lastUpdate = now;
+	if (jammed)
+	{
+		return;
+	}
+
+	for (int side = 0; side < 2; side++)
+	{
+		if (doorMotion[side] == 0)
+		{
+			continue;
+		}
+
+		// A pulse motor only moved until its pulse ran out.
+		long long until = now;
+		bool pulseOver = model.pulseMs > 0 && pulseStarted[side] + model.pulseMs <= now;
+		if (pulseOver)
+		{
+			until = pulseStarted[side] + model.pulseMs;
+		}
+		long long moving = (until > previous) ? until - previous : 0;
+
+		// Only the end the door travels towards stops it, a door that was just
+		// told to move is still sitting at the other one.
+		doorPosition[side] += doorMotion[side] * (double) moving / model.doorTravelMs;
+		if (doorMotion[side] > 0 && doorPosition[side] >= 1.0)
+		{
+			doorPosition[side] = 1.0;
+			doorMotion[side] = 0;
+		}
+		else if (doorMotion[side] < 0 && doorPosition[side] <= 0.0)
+		{
+			doorPosition[side] = 0.0;
+			doorMotion[side] = 0;
+		}
+		else if (pulseOver)
+		{
+			doorMotion[side] = 0; // The door stops halfway until it gets the next pulse
+		}
+	}
+
+	// The right door faces the high water: its valves fill the chamber.
+	// The left door faces the low water: its valves drain it, when the water is above them.
+	double change = 0.0;
+	for (int row = 0; row < 3; row++)
+	{
+		if (valveOpen[1][row])
+		{
+			change += model.fillPerRowPerS * elapsedS;
+		}
+		if (valveOpen[0][row] && level > rowHeight[row])
+		{
+			change -= model.drainPerRowPerS * elapsedS;
+		}
+	}
+	level += change;
+	if (level > 100.0)
+	{
+		level = 100.0;
+	}
+	else if (level < 0.0)
+	{
+		level = 0.0;
+	}
+}
+
+const char* FakeSimulator::doorState(int side)
+{
+	if (doorDamaged[side])
+	{
+		return "motorDamage";
+	}
+	if (doorMotion[side] > 0)
+	{
+		return "doorOpening";
+	}
+	if (doorMotion[side] < 0)
+	{
+		return "doorClosing";
+	}
+	if (doorPosition[side] >= 1.0)
+	{
+		return "doorOpen";
+	}
+	if (doorPosition[side] <= 0.0)
+	{
+		return doorLocked[side] ? "doorLocked" : "doorClosed";
+	}
+	return "doorStopped";
+}
+
+const char* FakeSimulator::waterBand()
+{
+	if (level <= 1.0)
+	{
+		return "low";
+	}
+	if (level < rowHeight[1])
+	{
+		return "belowValve2";
+	}
+	if (level < rowHeight[2])
+	{
+		return "aboveValve2";
+	}
+	if (level < 99.0)
+	{
+		return "aboveValve3";
+	}
+	return "high";
+}
+
+void FakeSimulator::handle(const char message[], char reply[])
+{
+	update();
+
+	int side = (strstr(message, "Right") != NULL) ? 1 : 0;
+	int row = 0;
+	int light = 0;
+	const char* valve = strstr(message, "Valve");
+	if (valve != NULL)
+	{
+		row = valve[5] - '1';
+	}
+	if (strncmp(message, "SetTrafficLight", 15) == 0 || strncmp(message, "GetTrafficLight", 15) == 0)
+	{
+		light = message[15] - '1';
+	}
+	bool on = strstr(message, ":on") != NULL;
+
+	strcpy(reply, "ack");
+	if (message[0] == 'G')
+	{
+		count.queries++;
+		if (strcmp(message, "GetWaterLevel") == 0)
+		{
+			strcpy(reply, waterBand());
+		}
+		else if (valve != NULL)
+		{
+			strcpy(reply, valveOpen[side][row] ? "open" : "closed");
+		}
+		else if (strncmp(message, "GetDoorLockState", 16) == 0)
+		{
+			strcpy(reply, doorDamaged[side] ? "lockDamaged" : "lockWorking");
+		}
+		else if (strncmp(message, "GetDoor", 7) == 0)
+		{
+			strcpy(reply, doorState(side));
+		}
+		else if (strncmp(message, "GetTrafficLight", 15) == 0)
+		{
+			bool lit = (strstr(message, "Red") != NULL) ? redOn[light] : greenOn[light];
+			strcpy(reply, lit ? "on" : "off");
+		}
+		else
+		{
+			strcpy(reply, "error");
+		}
+		return;
+	}
+
+	count.commands++;
+	if (refusals > 0 && strcmp(message, refused) == 0)
+	{
+		refusals--;
+		strcpy(reply, "error");
+		return;
+	}
+	if (valve != NULL)
+	{
+		bool open = strstr(message, ":open") != NULL;
+		// A fill row that is opened above the water sprays into the chamber.
+		if (open && side == 1 && !valveOpen[side][row] && level < rowHeight[row])
+		{
+			count.unsafeValves++;
+		}
+		valveOpen[side][row] = open;
+	}
+	else if (strncmp(message, "SetDoorLock", 11) == 0)
+	{
+		if (doorPosition[side] <= 0.0 && doorMotion[side] == 0)
+		{
+			doorLocked[side] = on;
+		}
+		else if (!on)
+		{
+			doorLocked[side] = false;
+		}
+	}
+	else if (strncmp(message, "SetDoor", 7) == 0)
+	{
+		const char* action = strchr(message, ':') + 1;
+		if (strcmp(action, "stop") == 0)
+		{
+			doorMotion[side] = 0;
+		}
+		else if (doorLocked[side])
+		{
+			doorDamaged[side] = true; // Moving against the lock
+		}
+		else if (!doorDamaged[side])
+		{
+			doorMotion[side] = (strcmp(action, "open") == 0) ? 1 : -1;
+			pulseStarted[side] = lastUpdate;
+		}
+	}
+	else if (strncmp(message, "SetTrafficLight", 15) == 0)
+	{
+		if (strstr(message, "Red") != NULL)
+		{
+			redOn[light] = on;
+		}
+		else
+		{
+			greenOn[light] = on;
+		}
+	}
+	else
+	{
+		strcpy(reply, "error");
+	}
+}
+
+void* FakeSimulator::serve(void* self)
+{
+	FakeSimulator* sim = (FakeSimulator*) self;
+	char buffer[512];
+	char message[64];
+	int messageLength = 0;
+	char reply[32];
+
+	while (!sim->stopping)
+	{
+		pthread_mutex_lock(&sim->lock);
+		if (sim->restartRequested)
+		{
+			sim->restartRequested = false;
+			sim->reset();
+			if (sim->clientSock >= 0)
+			{
+				close(sim->clientSock);
+				sim->clientSock = -1;
+			}
+		}
+		pthread_mutex_unlock(&sim->lock);
+
+		struct pollfd pfd;
+		pfd.fd = (sim->clientSock >= 0) ? sim->clientSock : sim->listenSock;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, 20) <= 0)
+		{
+			continue;
+		}
+
+		if (sim->clientSock < 0)
+		{
+			sim->clientSock = accept(sim->listenSock, NULL, NULL);
+			messageLength = 0;
+			continue;
+		}
+
+		int received = recv(sim->clientSock, buffer, sizeof(buffer), 0);
+		if (received <= 0)
+		{
+			close(sim->clientSock);
+			sim->clientSock = -1;
+			continue;
+		}
+
+		std::string replies;
+		pthread_mutex_lock(&sim->lock);
+		for (int i = 0; i < received; i++)
+		{
+			if (buffer[i] != ';')
+			{
+				if (messageLength < (int) sizeof(message) - 1)
+				{
+					message[messageLength++] = buffer[i];
+				}
+				continue;
+			}
+			message[messageLength] = '\0';
+			messageLength = 0;
+			sim->handle(message, reply);
+			replies += reply;
+			replies += ';';
+		}
+		if (!replies.empty())
+		{
+			sim->count.roundTrips++;
+		}
+		pthread_mutex_unlock(&sim->lock);
+
+		if (!replies.empty())
+		{
+			if (sim->model.replyDelayUs > 0)
+			{
+				usleep(sim->model.replyDelayUs);
+			}
+			send(sim->clientSock, replies.data(), replies.size(), MSG_NOSIGNAL);
+		}
+	}
+
+	if (sim->clientSock >= 0)
+	{
+		close(sim->clientSock);
+	}
+	return NULL;
+}
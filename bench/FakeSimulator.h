@@ -0,0 +1,92 @@
+#ifndef FAKESIMULATOR_H_
+#define FAKESIMULATOR_H_
+
+#include <pthread.h>
+
+// Stand-in for SluiceSim, for benchmarks that need a sluice that behaves
+// (doors take time to move, water takes time to rise) without the Qt
+// simulator. Times are in simulated milliseconds, timeScale says how many
+// real milliseconds one of them takes.
+struct FakeSluiceModel
+{
+	int doorTravelMs;		// Fully closed to fully open
+	int pulseMs;			// Pulse motor: the door stops after moving this long, 0 for a standard motor
+	bool fastLock;			// Moving a locked door damages the motor
+	double fillPerRowPerS;	// Percent of the level difference one open fill row adds per second
+	double drainPerRowPerS;	// Percent one open drain row removes per second, when the water is above it
+	double timeScale;
+	int replyDelayUs;		// Added to every round trip, for a link slower than loopback
+};
+
+FakeSluiceModel standardModel();
+FakeSluiceModel fastLockModel();
+FakeSluiceModel pulseMotorModel();
+
+struct FakeCounters
+{
+	long long queries;		// Get... messages
+	long long commands;		// Set... messages
+	long long unsafeValves;	// Fill rows opened while below the water, the policy must never do this
+	long long roundTrips;	// Writes answered, however many messages each held
+};
+
+class FakeSimulator
+{
+public:
+	FakeSimulator(int port, FakeSluiceModel Model);
+	~FakeSimulator();
+
+	FakeCounters counters();
+	void resetCounters();
+	// Level in percent, 0 is the low side and 100 the high side.
+	double waterLevel();
+	// How far the door on side is open, 0 closed to 1 open.
+	double doorOpened(int side);
+	// Drops the connection, forgets every light, valve and door, like a restart.
+	void restart();
+	// While jammed the doors and the water stand still, a door told to move
+	// keeps reporting that it moves.
+	void jam(bool jammed);
+	// The next times times command (without the ';') arrives it is
+	// answered with an error and not carried out.
+	void refuse(const char command[], int times);
+	// Whether the light at location (0 to 3) shows red and green.
+	bool lightShows(int location, bool red);
+
+private:
+	FakeSimulator(const FakeSimulator&);
+	FakeSimulator& operator= (const FakeSimulator&);
+
+	int listenSock;
+	int clientSock;
+	volatile bool stopping;
+	bool restartRequested;
+	bool jammed;
+	char refused[64];
+	int refusals;				// Left to give
+	pthread_t thread;
+	pthread_mutex_t lock;
+	FakeSluiceModel model;
+	FakeCounters count;
+
+	long long lastUpdate;		// Simulated ms
+	double level;
+	bool valveOpen[2][3];
+	bool redOn[4];
+	bool greenOn[4];
+	double doorPosition[2];		// 0 closed, 1 open
+	int doorMotion[2];			// +1 opening, -1 closing, 0 still
+	long long pulseStarted[2];
+	bool doorLocked[2];
+	bool doorDamaged[2];
+
+	static void* serve(void* self);
+	void reset();
+	long long simulatedNow();
+	void update();
+	void handle(const char message[], char reply[]);
+	const char* doorState(int side);
+	const char* waterBand();
+};
+
+#endif
@@ -0,0 +1,219 @@
+// How fast automation can drive the daemon (-l). Clients send requests over
+// the control socket as fast as they can: status requests, answered by the
+// server at once, and operations, which are accepted at once and run on
+// the sluices' threads while more requests keep coming in.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "FakeSimulator.h"
+#include "../code/ControlServer.h"
+#include "../code/FleetEmergencyStop.h"
+#include "../code/Sluice.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/timing.h"
+
+#define BENCH_PORT 18100
+#define BENCH_SOCKET "/tmp/sluiceControlBench"
+#define SLUICES 4
+#define STATUS_REQUESTS 2000
+#define OPERATIONS 12
+
+struct ClientRun
+{
+	int sluice;				// 1.., for operations
+	bool operations;
+	long long requests;
+	long long totalUs;		// Request written to its first reply line
+	long long maxUs;
+	long long results;		// Operations that finished, with success
+	long long failed;
+};
+
+static int connectClient()
+{
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, BENCH_SOCKET);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (connect(fd, (struct sockaddr*) &address, sizeof(address)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// The next whole line from fd, buffered in pending.
+static std::string readLine(int fd, std::string& pending)
+{
+	size_t end;
+	while ((end = pending.find('\n')) == std::string::npos)
+	{
+		char received[256];
+		int size = recv(fd, received, sizeof(received), 0);
+		if (size <= 0)
+		{
+			return "";
+		}
+		pending.append(received, size);
+	}
+	std::string line = pending.substr(0, end);
+	pending.erase(0, end + 1);
+	return line;
+}
+
+static void* client(void* arg)
+{
+	ClientRun* run = (ClientRun*) arg;
+	int fd = connectClient();
+	if (fd < 0)
+	{
+		return NULL;
+	}
+
+	std::string pending;
+	const char cycle[] = { 'e', 's', 'x' };
+	int count = run->operations ? OPERATIONS : STATUS_REQUESTS;
+	int outstanding = 0;
+	for (int i = 0; i < count; i++)
+	{
+		char request[16];
+		if (run->operations)
+		{
+			snprintf(request, sizeof(request), "%d%c\n", run->sluice, cycle[i % 3]);
+		}
+		else
+		{
+			snprintf(request, sizeof(request), "?\n");
+		}
+
+		long long sentAt = monotonicUs();
+		if (write(fd, request, strlen(request)) < 0)
+		{
+			break;
+		}
+		// Operation results may come in between, the acceptance is what is timed.
+		std::string line;
+		do
+		{
+			line = readLine(fd, pending);
+			if (line[0] == '=' && run->operations)
+			{
+				outstanding--;
+				(line.substr(line.find(' ') + 1) == "0") ? run->results++ : run->failed++;
+			}
+		} while (run->operations && line[0] == '=');
+		long long us = monotonicUs() - sentAt;
+		run->requests++;
+		run->totalUs += us;
+		if (us > run->maxUs)
+		{
+			run->maxUs = us;
+		}
+		outstanding += run->operations ? 1 : 0;
+	}
+
+	while (outstanding > 0)
+	{
+		std::string line = readLine(fd, pending);
+		if (line.empty())
+		{
+			break;
+		}
+		outstanding--;
+		(line.substr(line.find(' ') + 1) == "0") ? run->results++ : run->failed++;
+	}
+	close(fd);
+	return NULL;
+}
+
+static void* serve(void* server)
+{
+	((ControlServer*) server)->run();
+	return NULL;
+}
+
+static void measure(ControlServer& server, int clients, bool operations)
+{
+	std::vector<ClientRun> runs(clients);
+	std::vector<pthread_t> threads(clients);
+	long long started = monotonicUs();
+	for (int i = 0; i < clients; i++)
+	{
+		memset(&runs[i], 0, sizeof(ClientRun));
+		runs[i].sluice = i % SLUICES + 1;
+		runs[i].operations = operations;
+		pthread_create(&threads[i], NULL, client, &runs[i]);
+	}
+
+	ClientRun total;
+	memset(&total, 0, sizeof(total));
+	for (int i = 0; i < clients; i++)
+	{
+		pthread_join(threads[i], NULL);
+		total.requests += runs[i].requests;
+		total.totalUs += runs[i].totalUs;
+		total.results += runs[i].results;
+		total.failed += runs[i].failed;
+		if (runs[i].maxUs > total.maxUs)
+		{
+			total.maxUs = runs[i].maxUs;
+		}
+	}
+	long long elapsedUs = monotonicUs() - started;
+
+	printf("%-10s %8d %10lld %12lld %10lld %10lld %12lld\n", operations ? "operations" : "status", clients,
+		total.requests, total.requests * 1000000 / (elapsedUs > 0 ? elapsedUs : 1),
+		total.totalUs / (total.requests > 0 ? total.requests : 1), total.maxUs, operations ? total.results : 0);
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+
+	FakeSluiceModel model = standardModel();
+	std::vector<FakeSimulator*> simulators;
+	std::vector<StandardSluice*> sluices;
+	FleetEmergencyStop button;
+	ControlServer server(BENCH_SOCKET, button);
+	for (int i = 0; i < SLUICES; i++)
+	{
+		simulators.push_back(new FakeSimulator(BENCH_PORT + i, model));
+		sluices.push_back(new StandardSluice(BENCH_PORT + i));
+		button.addSluice(*sluices[i]);
+		server.addSluice(*sluices[i]);
+	}
+	if (!server.open())
+	{
+		return 1;
+	}
+	pthread_t thread;
+	pthread_create(&thread, NULL, serve, &server);
+
+	printf("%-10s %8s %10s %12s %10s %10s %12s\n", "requests", "clients", "sent", "per second", "avg us", "max us", "succeeded");
+	measure(server, 1, false);
+	measure(server, 4, false);
+	measure(server, 16, false);
+	measure(server, SLUICES, true);
+
+	server.stop();
+	pthread_join(thread, NULL);
+	ControlReport report = server.report();
+	printf("\nserver side: %lld operations accepted in %lld us on average, %lld us at most\n",
+		report.accepted, report.acceptAverageUs, report.acceptMaxUs);
+
+	for (int i = 0; i < SLUICES; i++)
+	{
+		delete sluices[i];
+		delete simulators[i];
+	}
+	return 0;
+}
@@ -0,0 +1,66 @@
+// What the dashboard costs per frame, and what it costs the simulators:
+// frames are drawn from the status board only, so the simulators must not
+// see a single message while it redraws as fast as it can.
+
+#include <stdio.h>
+#include <vector>
+
+#include "FakeSimulator.h"
+#include "../code/Dashboard.h"
+#include "../code/Sluice.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/timing.h"
+
+#define BENCH_PORT 18000
+#define FRAMES 20000
+
+static void measure(int count)
+{
+	std::vector<FakeSimulator*> simulators;
+	std::vector<StandardSluice*> sluices;
+	for (int i = 0; i < count; i++)
+	{
+		simulators.push_back(new FakeSimulator(BENCH_PORT + i, standardModel()));
+		sluices.push_back(new StandardSluice(BENCH_PORT + i));
+		sluices[i]->allowEntry(); // Doors, lights and water known on the board
+		simulators[i]->resetCounters();
+	}
+
+	Dashboard dashboard(STATUS_BOARD_NAME);
+	if (!dashboard.open())
+	{
+		printf("no status board\n");
+		return;
+	}
+	long long bytes = 0;
+	long long started = monotonicUs();
+	for (int frame = 0; frame < FRAMES; frame++)
+	{
+		bytes += dashboard.render().size();
+	}
+	long long frameNs = (monotonicUs() - started) * 1000 / FRAMES;
+
+	long long messages = 0;
+	for (int i = 0; i < count; i++)
+	{
+		FakeCounters seen = simulators[i]->counters();
+		messages += seen.queries + seen.commands;
+	}
+	printf("%8d %8d %12lld %12lld %18lld\n", count, dashboard.sluiceCount(), frameNs, bytes / FRAMES, messages);
+
+	for (int i = 0; i < count; i++)
+	{
+		delete sluices[i];
+		delete simulators[i];
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+
+	printf("%8s %8s %12s %12s %18s\n", "sluices", "shown", "ns/frame", "bytes/frame", "simulator msgs");
+	measure(4);
+	measure(16);
+	return 0;
+}
@@ -0,0 +1,77 @@
+// Messages each sluice variant sends for one round trip of a boat: in at the
+// low side, up, out at the high side, and the same way back down.
+//
+// Commands (Set...) are fixed by the variant's door policies. Queries
+// (Get...) include the polling while doors move and water flows, so they
+// depend on timing as well.
+
+#include <stdio.h>
+
+#include "FakeSimulator.h"
+#include "../code/Sluice.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/returnValues.h"
+#include "../code/lib/timing.h"
+
+#define BENCH_PORT 17000
+
+struct Phase
+{
+	const char* name;
+	int (Sluice::*operation)();
+};
+
+static const Phase phases[] = {
+	{ "entry low", &Sluice::allowEntry },
+	{ "up", &Sluice::start },
+	{ "exit high", &Sluice::allowExit },
+	{ "entry high", &Sluice::allowEntry },
+	{ "down", &Sluice::start },
+	{ "exit low", &Sluice::allowExit },
+};
+
+static void measure(const char name[], Sluice& sluice, FakeSimulator& simulator)
+{
+	long long totalQueries = 0;
+	long long totalCommands = 0;
+
+	for (unsigned int p = 0; p < sizeof(phases) / sizeof(phases[0]); p++)
+	{
+		simulator.resetCounters();
+		long long started = monotonicMs();
+		int rtnval = (sluice.*phases[p].operation)();
+		long long took = monotonicMs() - started;
+		FakeCounters counted = simulator.counters();
+
+		printf("%-18s %-11s %8lld %9lld %8lld %s\n", name, phases[p].name,
+			counted.commands, counted.queries, took, rtnval == success ? "" : "FAILED");
+		totalQueries += counted.queries;
+		totalCommands += counted.commands;
+	}
+	printf("%-18s %-11s %8lld %9lld\n\n", name, "total", totalCommands, totalQueries);
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+
+	printf("%-18s %-11s %8s %9s %8s\n", "variant", "phase", "commands", "queries", "ms");
+
+	{
+		FakeSimulator simulator(BENCH_PORT, standardModel());
+		StandardSluice sluice(BENCH_PORT);
+		measure("standard", sluice, simulator);
+	}
+	{
+		FakeSimulator simulator(BENCH_PORT + 1, fastLockModel());
+		FastLockSluice sluice(BENCH_PORT + 1);
+		measure("fast lock", sluice, simulator);
+	}
+	{
+		FakeSimulator simulator(BENCH_PORT + 2, pulseMotorModel());
+		PulseMotorSluice sluice(BENCH_PORT + 2);
+		measure("pulse motor", sluice, simulator);
+	}
+
+	return 0;
+}
@@ -0,0 +1,165 @@
+// What the emergency button costs: messages and time for the stop, for the
+// restore until the water (or the door) is moving again, and for the whole
+// restore until the operation is done, with what it came to. A vessel is
+// let in, taken up and let out, each stopped on the way, and then taken down
+// with the stop pressed before the door behind it is sent to close. The stop
+// is pressed from a signal handler on the thread running the operation, the
+// least convenient place for it to come in.
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+
+#include "FakeSimulator.h"
+#include "../code/Sluice.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/returnValues.h"
+#include "../code/lib/timing.h"
+
+#define BENCH_PORT 17600
+
+// closing is taking the vessel down, stopped while the open door is asked
+// about, before it is told to close.
+enum Phase { entry, water, exiting, closing };
+
+struct Operation
+{
+	StandardSluice* sluice;
+	Phase phase;
+	int result;
+};
+
+static void* runOperation(void* arg)
+{
+	Operation* operation = (Operation*) arg;
+	switch (operation->phase)
+	{
+		case entry:
+			operation->result = operation->sluice->allowEntry();
+			break;
+		case water:
+		case closing:
+			operation->result = operation->sluice->start();
+			break;
+		case exiting:
+			operation->result = operation->sluice->allowExit();
+			break;
+	}
+	return NULL;
+}
+
+static StandardSluice* pressed;
+static volatile long long stopMs;
+
+static void stopHandler(int sig)
+{
+	long long started = monotonicMs();
+	pressed->passInterrupt();
+	stopMs = monotonicMs() - started;
+}
+
+static void* pressButton(void* arg)
+{
+	Operation* operation = (Operation*) arg;
+	operation->result = operation->sluice->passInterrupt();
+	return NULL;
+}
+
+// How far the door or the water has got: the left door lets the vessel in,
+// the right one out.
+static double progress(FakeSimulator& simulator, Phase phase)
+{
+	switch (phase)
+	{
+		case entry:
+			return simulator.doorOpened(left) * 100.0;
+		case exiting:
+			return simulator.doorOpened(right) * 100.0;
+		case closing:
+			return 100.0 - simulator.waterLevel();
+		default:
+			return simulator.waterLevel();
+	}
+}
+
+// The light the vessel passes shows green, the other one on that door red.
+static bool lightsLetThrough(FakeSimulator& simulator, Phase phase)
+{
+	int green = (phase == entry) ? 0 : 2;
+	int red = (phase == entry) ? 1 : 3;
+	return phase == water || phase == closing || (simulator.lightShows(green, false) && !simulator.lightShows(green, true)
+		&& simulator.lightShows(red, true) && !simulator.lightShows(red, false));
+}
+
+static void measure(const char name[], FakeSimulator& simulator, StandardSluice& sluice, Phase phase)
+{
+	Operation operation = { &sluice, phase, success };
+	pthread_t thread;
+	simulator.resetCounters();
+	pthread_create(&thread, NULL, &runOperation, &operation);
+	while ((phase == closing) ? simulator.counters().queries < 2 : progress(simulator, phase) < 30.0)
+	{
+		sleepMs(0);
+	}
+
+	simulator.resetCounters();
+	stopMs = -1;
+	pthread_kill(thread, SIGUSR1);
+	while (stopMs < 0)
+	{
+		sleepMs(1);
+	}
+	FakeCounters stop = simulator.counters();
+	pthread_join(thread, NULL);
+	bool ok = operation.result == interruptReceived;
+
+	sleepMs(50);
+	double stoppedAt = progress(simulator, phase);
+	simulator.resetCounters();
+	long long started = monotonicMs();
+	pthread_create(&thread, NULL, &pressButton, &operation);
+	bool doorShut = true;
+	while (progress(simulator, phase) < stoppedAt + 0.5 && monotonicMs() - started < 5000)
+	{
+		sleepMs(0);
+	}
+	if (phase == closing)
+	{
+		// The water may only move with the door behind the vessel shut.
+		doorShut = simulator.doorOpened(right) == 0.0;
+	}
+	long long restartMs = monotonicMs() - started;
+	FakeCounters restart = simulator.counters();
+	pthread_join(thread, NULL);
+	long long restoreMs = monotonicMs() - started;
+	FakeCounters restore = simulator.counters();
+	ok = ok && doorShut && operation.result == success && lightsLetThrough(simulator, phase);
+
+	printf("%-8s %5lld %5lld %5lld   %5lld %5lld %5lld   %5lld %5lld %5lld %6d %s\n", name, stop.commands,
+		stop.queries, stopMs, restart.commands, restart.queries, restartMs, restore.commands, restore.queries,
+		restoreMs, operation.result, ok ? "" : "FAILED");
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+
+	// A link slower than loopback, for the stop to land between two messages.
+	FakeSluiceModel model = standardModel();
+	model.replyDelayUs = 1000;
+	FakeSimulator simulator(BENCH_PORT, model);
+	StandardSluice sluice(BENCH_PORT);
+	pressed = &sluice;
+	signal(SIGUSR1, &stopHandler);
+	printf("%-8s %17s   %23s   %30s\n", "", "stop", "restart until moving", "whole restore");
+	printf("%-8s %5s %5s %5s   %5s %5s %5s   %5s %5s %5s %6s\n", "phase", "cmds", "qrys", "ms", "cmds", "qrys",
+		"ms", "cmds", "qrys", "ms", "result");
+
+	measure("entry", simulator, sluice, entry);
+	// The vessel is in, take it up and let it out.
+	measure("water", simulator, sluice, water);
+	measure("exit", simulator, sluice, exiting);
+	measure("closing", simulator, sluice, closing);
+
+	return 0;
+}
@@ -0,0 +1,217 @@
+// Controller CPU time to talk to a whole fleet of simulators.
+//
+// A child process plays N simulators on consecutive ports and answers every
+// message with "ack;". Each round, every sluice gets the same messages, sent
+// either one send/recv pair at a time through SimulationCommunicator, or in
+// one batch for the whole fleet through the epoll and io_uring backends.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <vector>
+
+#include "../code/SimulationCommunicator.h"
+#include "../code/BatchIO.h"
+#include "../code/IoUringBatchIO.h"
+#include "../code/EpollBatchIO.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/commands.h"
+
+#define BENCH_PORT 16000
+#define ROUNDS 200
+
+static long long nowNs(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void serveFleet(std::vector<int>& listeners)
+{
+	int epollFd = epoll_create1(0);
+	for (unsigned int i = 0; i < listeners.size(); i++)
+	{
+		struct epoll_event event;
+		event.events = EPOLLIN;
+		event.data.u64 = (1ULL << 32) | listeners[i];
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, listeners[i], &event);
+	}
+
+	struct epoll_event events[64];
+	char buffer[512];
+	char replies[512];
+	while (true)
+	{
+		int ready = epoll_wait(epollFd, events, 64, -1);
+		for (int e = 0; e < ready; e++)
+		{
+			int fd = events[e].data.u64 & 0xffffffff;
+			if (events[e].data.u64 >> 32)
+			{
+				int client = accept(fd, NULL, NULL);
+				struct epoll_event event;
+				event.events = EPOLLIN;
+				event.data.u64 = client;
+				epoll_ctl(epollFd, EPOLL_CTL_ADD, client, &event);
+				continue;
+			}
+
+			int received = recv(fd, buffer, sizeof(buffer), 0);
+			if (received <= 0)
+			{
+				exit(0);
+			}
+			int length = 0;
+			for (int i = 0; i < received; i++)
+			{
+				if (buffer[i] == ';')
+				{
+					memcpy(replies + length, "ack;", 4);
+					length += 4;
+				}
+			}
+			if (send(fd, replies, length, MSG_NOSIGNAL) != length)
+			{
+				exit(0);
+			}
+		}
+	}
+}
+
+static pid_t startFleet(int sluices)
+{
+	std::vector<int> listeners;
+	for (int i = 0; i < sluices; i++)
+	{
+		struct sockaddr_in addr;
+		int one = 1;
+		int sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+		setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+		addr.sin_port = htons(BENCH_PORT + i);
+		if (bind(sock, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(sock, 1) != 0)
+		{
+			DieWithError("listen failed");
+		}
+		listeners.push_back(sock);
+	}
+
+	fflush(stdout);
+	pid_t child = fork();
+	if (child == 0)
+	{
+		serveFleet(listeners);
+	}
+	for (unsigned int i = 0; i < listeners.size(); i++)
+	{
+		close(listeners[i]);
+	}
+	return child;
+}
+
+static void report(const char name[], int sluices, int perSluice, long long wallNs, long long cpuNs)
+{
+	double messages = (double) ROUNDS * sluices * perSluice;
+	printf("%-10s %8d %8d %12.1f %14.2f\n", name, sluices, perSluice,
+		wallNs / 1000.0 / ROUNDS, cpuNs / messages);
+}
+
+static void measure(int sluices, int perSluice, BatchIO& uring, BatchIO& epoll)
+{
+	pid_t fleet = startFleet(sluices);
+
+	std::vector<SimulationCommunicator*> simulations;
+	for (int i = 0; i < sluices; i++)
+	{
+		simulations.push_back(new SimulationCommunicator(BENCH_PORT + i));
+	}
+
+	// What a fleet-wide stop sends: both doors and every valve row.
+	const char* stopAll[] = { DoorLeftStop, DoorRightStop,
+		DoorLeftCloseBottomValve, DoorLeftCloseMiddleValve, DoorLeftCloseTopValve,
+		DoorRightCloseBottomValve, DoorRightCloseMiddleValve, DoorRightCloseTopValve };
+
+	long long wall = nowNs(CLOCK_MONOTONIC);
+	long long cpu = nowNs(CLOCK_PROCESS_CPUTIME_ID);
+	for (int round = 0; round < ROUNDS; round++)
+	{
+		for (int s = 0; s < sluices; s++)
+		{
+			for (int m = 0; m < perSluice; m++)
+			{
+				simulations[s]->sendMessage(stopAll[m]);
+			}
+		}
+	}
+	report("sequential", sluices, perSluice, nowNs(CLOCK_MONOTONIC) - wall, nowNs(CLOCK_PROCESS_CPUTIME_ID) - cpu);
+
+	BatchIO* backends[] = { &epoll, &uring };
+	for (int b = 0; b < 2; b++)
+	{
+		if (backends[b] == &uring && !((IoUringBatchIO&) uring).available())
+		{
+			printf("%-10s unavailable on this kernel\n", uring.name());
+			continue;
+		}
+
+		std::vector<BatchTarget> targets(sluices);
+		for (int s = 0; s < sluices; s++)
+		{
+			targets[s].simulation = simulations[s];
+			targets[s].messages.assign(stopAll, stopAll + perSluice);
+		}
+
+		wall = nowNs(CLOCK_MONOTONIC);
+		cpu = nowNs(CLOCK_PROCESS_CPUTIME_ID);
+		for (int round = 0; round < ROUNDS; round++)
+		{
+			backends[b]->exchangeAll(targets, 1000);
+		}
+		report(backends[b]->name(), sluices, perSluice, nowNs(CLOCK_MONOTONIC) - wall, nowNs(CLOCK_PROCESS_CPUTIME_ID) - cpu);
+
+		for (int s = 0; s < sluices; s++)
+		{
+			if (targets[s].replies[perSluice - 1] != "ack")
+			{
+				DieWithError("batch lost a reply");
+			}
+		}
+	}
+
+	for (int i = 0; i < sluices; i++)
+	{
+		delete simulations[i];
+	}
+	kill(fleet, SIGTERM);
+	waitpid(fleet, NULL, 0);
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+
+	IoUringBatchIO uring;
+	EpollBatchIO epoll;
+
+	printf("%d rounds, every sluice gets the same messages each round\n\n", ROUNDS);
+	printf("%-10s %8s %8s %12s %14s\n", "", "sluices", "msgs", "us/round", "cpu ns/msg");
+	int fleetSizes[] = { 4, 64, 256 };
+	for (int f = 0; f < 3; f++)
+	{
+		measure(fleetSizes[f], 1, uring, epoll);
+		measure(fleetSizes[f], 8, uring, epoll);
+	}
+
+	return 0;
+}
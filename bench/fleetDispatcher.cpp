@@ -0,0 +1,103 @@
+// Vessels per hour and waiting time for a stream of vessels that is more
+// than one sluice can handle: all of them through one sluice, and spread
+// over four by the dispatcher. Times are converted back to the fake
+// simulator's own clock. Last, the four again with the emergency button
+// pressed and released halfway, and one sluice going out of service: every
+// vessel still has to get through.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FakeSimulator.h"
+#include "../code/FleetDispatcher.h"
+#include "../code/FleetEmergencyStop.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/returnValues.h"
+#include "../code/lib/timing.h"
+
+#define BENCH_PORT 17400
+#define FLEET_SIZE 4
+#define VESSELS 40
+#define MEAN_ARRIVAL_GAP_MS 10000	// Simulated: six vessels a minute, from either side
+#define PASSAGE_MS 30000			// Simulated: sailing in or out of the chamber
+#define FAILING_FROM 8				// Vessel from which the first sluice's left door no longer opens
+#define PRESSED_AT 20				// Vessel the emergency button is pressed at
+#define RELEASED_AT 24
+
+static void measure(int sluices, bool disrupted)
+{
+	FakeSluiceModel model = standardModel();
+	FakeSimulator* simulators[FLEET_SIZE];
+	StandardSluice* fleetSluices[FLEET_SIZE];
+	FleetDispatcher fleet;
+	FleetEmergencyStop button;
+
+	for (int i = 0; i < sluices; i++)
+	{
+		simulators[i] = new FakeSimulator(BENCH_PORT + i, model);
+		fleetSluices[i] = new StandardSluice(BENCH_PORT + i);
+		fleet.addSluice(*fleetSluices[i], CHAMBER_CAPACITY, (long long) (PASSAGE_MS * model.timeScale));
+		button.addSluice(*fleetSluices[i]);
+	}
+	fleet.start();
+
+	// The same arrivals for every run, dispatched as they come.
+	srand(1);
+	long long arrival = monotonicMs();
+	for (int i = 0; i < VESSELS; i++)
+	{
+		arrival += (long long) ((rand() % (2 * MEAN_ARRIVAL_GAP_MS)) * model.timeScale);
+		sleepMs(arrival - monotonicMs());
+		if (disrupted && i == FAILING_FROM)
+		{
+			simulators[0]->refuse("SetDoorLeft:open", VESSELS * 100);
+		}
+		if (disrupted && i == PRESSED_AT)
+		{
+			button.stop();
+		}
+		if (disrupted && i == RELEASED_AT)
+		{
+			button.release();
+		}
+		fleet.dispatch((rand() % 2 == 0) ? left : right);
+	}
+	fleet.finish();
+
+	int vessels = 0;
+	long long waited = 0;
+	long long longest = 0;
+	long long elapsed = 0;
+	for (int i = 0; i < sluices; i++)
+	{
+		FleetSluiceReport report = fleet.report(i);
+		printf("%6d %8d %8d %8d %8.0f%% %s\n", sluices, i + 1, report.assigned, report.lockages.lockages,
+			report.utilization * 100, report.failure == success ? "" : "out of service");
+		vessels += report.lockages.vessels;
+		waited += report.lockages.averageWaitMs * report.lockages.vessels;
+		longest = (report.lockages.longestWaitMs > longest) ? report.lockages.longestWaitMs : longest;
+		elapsed = (report.lockages.elapsedMs > elapsed) ? report.lockages.elapsedMs : elapsed;
+	}
+	printf("%6d %8s %8d vessels, %.1f per hour, waited %.1f min on average, %.1f min at most %s\n\n",
+		sluices, disrupted ? "disrupt" : "fleet", vessels, vessels * 3600000.0 / elapsed * model.timeScale,
+		waited / (double) vessels / model.timeScale / 60000.0, longest / model.timeScale / 60000.0,
+		(vessels == VESSELS) ? "" : "NOT ALL THROUGH");
+
+	for (int i = 0; i < sluices; i++)
+	{
+		delete fleetSluices[i];
+		delete simulators[i];
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+
+	printf("%6s %8s %8s %8s %9s\n", "fleet", "sluice", "vessels", "lockages", "busy");
+	measure(1, false);
+	measure(FLEET_SIZE, false);
+	measure(FLEET_SIZE, true);
+
+	return 0;
+}
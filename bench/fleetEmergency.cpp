@@ -0,0 +1,268 @@
+// Time from pressing the emergency button to the last acknowledgement, for
+// a whole fleet. The same stop messages (both doors and every valve of
+// every sluice) are sent one after another, sluice by sluice, and in one
+// batch through FleetEmergencyStop. The simulators reply at once, or after
+// a delay that stands for a slower link. Then the button pressed from a
+// signal handler on a thread waiting for the reply to a query: every stop
+// has to get its own acknowledgement and the query its own reply.
+// And stops sent after an operation's deadline (-o) passed, which still
+// have to go out, on its thread and on another one. And the button pressed
+// while one simulator restarts and its sluice waits to reconnect: the
+// others must not wait with it.
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "FakeSimulator.h"
+#include "../code/FleetEmergencyStop.h"
+#include "../code/SimulationCommunicator.h"
+#include "../code/Sluice.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/commands.h"
+#include "../code/lib/returnValues.h"
+#include "../code/lib/timing.h"
+
+#define BENCH_PORT 17800
+#define ROUNDS 20
+#define PRESSES 20
+#define SLOW_QUERY_US 20000
+#define RECONNECT_FLEET 4
+
+static void measure(int count, int replyDelayUs)
+{
+	FakeSluiceModel model = standardModel();
+	model.replyDelayUs = replyDelayUs;
+
+	std::vector<FakeSimulator*> simulators;
+	std::vector<StandardSluice*> sluices;
+	FleetEmergencyStop button;
+	for (int i = 0; i < count; i++)
+	{
+		simulators.push_back(new FakeSimulator(BENCH_PORT + i, model));
+		sluices.push_back(new StandardSluice(BENCH_PORT + i));
+		button.addSluice(*sluices[i]);
+		sluices[i]->allowEntry(); // Something to stop: the door is open and the light green
+	}
+
+	long long oneByOneUs = 0;
+	long long batchUs = 0;
+	int acknowledged = 0;
+	int messages = 0;
+	for (int round = 0; round < ROUNDS; round++)
+	{
+		long long pressedAt = monotonicUs();
+		for (int i = 0; i < count; i++)
+		{
+			BatchTarget target;
+			sluices[i]->addEmergencyStop(target);
+			for (unsigned int m = 0; m < target.messages.size(); m++)
+			{
+				target.simulation->sendMessage(target.messages[m]);
+			}
+		}
+		oneByOneUs += monotonicUs() - pressedAt;
+		button.release();
+
+		FleetStopReport report = button.stop();
+		batchUs += report.lastAckUs;
+		acknowledged += report.acknowledged;
+		messages += report.messages;
+		button.release();
+	}
+
+	printf("%8d %10d %12lld %12lld %10d/%d\n", count, replyDelayUs, oneByOneUs / ROUNDS, batchUs / ROUNDS,
+		acknowledged / ROUNDS, messages / ROUNDS);
+
+	for (int i = 0; i < count; i++)
+	{
+		delete sluices[i];
+		delete simulators[i];
+	}
+}
+
+static FleetEmergencyStop* pressed;
+static FleetStopReport pressReport;
+static volatile bool pressDone;
+static volatile bool querying;
+static volatile int queries;
+static volatile int wrongReplies;
+
+static void pressButton(int sig)
+{
+	pressReport = pressed->stop();
+	pressDone = true;
+}
+
+static void* query(void* arg)
+{
+	Sluice* sluice = (Sluice*) arg;
+	while (querying)
+	{
+		if (sluice->getWaterLevel() == waterError)
+		{
+			wrongReplies++;
+		}
+		queries++;
+	}
+	return NULL;
+}
+
+static void measurePressDuringQuery(int port)
+{
+	FakeSluiceModel model = standardModel();
+	model.replyDelayUs = SLOW_QUERY_US;
+	FakeSimulator simulator(port, model);
+	StandardSluice sluice(port);
+	FleetEmergencyStop button;
+	button.addSluice(sluice);
+	pressed = &button;
+	signal(SIGUSR1, &pressButton);
+
+	querying = true;
+	pthread_t thread;
+	pthread_create(&thread, NULL, &query, &sluice);
+	int acknowledged = 0;
+	int messages = 0;
+	for (int press = 0; press < PRESSES; press++)
+	{
+		int before = queries;
+		sleepMs(SLOW_QUERY_US / 2000); // Halfway the reply's delay
+		pressDone = false;
+		pthread_kill(thread, SIGUSR1);
+		long long giveUp = monotonicMs() + 2000;
+		while ((!pressDone || queries == before) && monotonicMs() < giveUp)
+		{
+			sleepMs(1);
+		}
+		acknowledged += pressReport.acknowledged;
+		messages += pressReport.messages;
+		button.releaseButton();
+		sluice.passInterrupt(); // Nothing to resume, only the doors are let go
+	}
+	querying = false;
+	pthread_join(thread, NULL);
+	signal(SIGUSR1, SIG_DFL);
+
+	printf("\npressed %d times during a %d us query: %d/%d stops acknowledged, %d of %d queries answered wrongly\n",
+		PRESSES, SLOW_QUERY_US, acknowledged, messages, wrongReplies, queries);
+}
+
+static void* stopFromOtherThread(void* arg)
+{
+	SimulationCommunicator* simulation = (SimulationCommunicator*) arg;
+	return (void*) (strcmp(simulation->sendMessage(DoorLeftStop), "ack") == 0);
+}
+
+static void measurePastDeadline(int port)
+{
+	FakeSimulator simulator(port, standardModel());
+	SimulationCommunicator simulation(port);
+	simulation.setDeadline(monotonicMs() - 1);
+
+	bool queried = simulation.sendMessage(GetWaterLevel)[0] != '\0';
+	bool ownStop = strcmp(simulation.sendUrgent(DoorLeftStop), "ack") == 0;
+	pthread_t thread;
+	void* otherStop;
+	pthread_create(&thread, NULL, &stopFromOtherThread, &simulation);
+	pthread_join(thread, &otherStop);
+
+	printf("past the operation's deadline: query %s, stop on its thread %s, stop on another thread %s\n",
+		queried ? "sent" : "not sent", ownStop ? "acknowledged" : "DROPPED", otherStop ? "acknowledged" : "DROPPED");
+}
+
+static void* stopFleet(void* arg)
+{
+	pressReport = ((FleetEmergencyStop*) arg)->stop();
+	pressDone = true;
+	return NULL;
+}
+
+static void* queryOnce(void* arg)
+{
+	((Sluice*) arg)->getWaterLevel();
+	return NULL;
+}
+
+static void measureOneReconnecting(int port)
+{
+	FakeSimulator* simulators[RECONNECT_FLEET];
+	StandardSluice* sluices[RECONNECT_FLEET];
+	FleetEmergencyStop button;
+	for (int i = 0; i < RECONNECT_FLEET; i++)
+	{
+		simulators[i] = new FakeSimulator(port + i, standardModel());
+		sluices[i] = new StandardSluice(port + i);
+		button.addSluice(*sluices[i]);
+		sluices[i]->getWaterLevel(); // Connected before the press
+	}
+
+	// The first sluice finds the connection gone and backs off before it
+	// reconnects.
+	sleepMs(20);
+	simulators[0]->restart();
+	sleepMs(50); // Taken up by the simulator's next poll
+	long long queriedAt = monotonicUs();
+	pthread_t querier;
+	pthread_create(&querier, NULL, &queryOnce, sluices[0]);
+	sleepMs(20);
+	for (int i = 0; i < RECONNECT_FLEET; i++)
+	{
+		simulators[i]->resetCounters();
+	}
+
+	pressDone = false;
+	long long pressedAt = monotonicUs();
+	pthread_t presser;
+	pthread_create(&presser, NULL, &stopFleet, &button);
+	long long othersUs = -1;
+	while (!pressDone || othersUs < 0)
+	{
+		bool othersStopped = true;
+		for (int i = 1; i < RECONNECT_FLEET; i++)
+		{
+			othersStopped = othersStopped && simulators[i]->counters().commands >= 8;
+		}
+		if (othersStopped && othersUs < 0)
+		{
+			othersUs = monotonicUs() - pressedAt;
+		}
+		sleepMs(0);
+	}
+	pthread_join(presser, NULL);
+	pthread_join(querier, NULL);
+	long long reconnectedUs = monotonicUs() - queriedAt;
+
+	printf("one of %d simulators restarted: the others stopped after %lld us, all %d/%d stops acknowledged after %lld us"
+		" (the query reconnected after %lld us)\n", RECONNECT_FLEET, othersUs, pressReport.acknowledged,
+		pressReport.messages, pressReport.lastAckUs, reconnectedUs);
+
+	for (int i = 0; i < RECONNECT_FLEET; i++)
+	{
+		delete sluices[i];
+		delete simulators[i];
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+
+	printf("%8s %10s %12s %12s %12s\n", "sluices", "delay us", "one by one", "batch", "acked");
+	int counts[] = { 4, 16 };
+	int delays[] = { 0, 500 };
+	for (int d = 0; d < 2; d++)
+	{
+		for (int c = 0; c < 2; c++)
+		{
+			measure(counts[c], delays[d]);
+		}
+	}
+
+	measurePressDuringQuery(BENCH_PORT + 16);
+	measurePastDeadline(BENCH_PORT + 17);
+	measureOneReconnecting(BENCH_PORT + 18);
+	return 0;
+}
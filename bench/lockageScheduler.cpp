@@ -0,0 +1,76 @@
+// Vessels per hour and waiting time for the same stream of arrivals taken
+// through one vessel per lockage and batched as many as fit in the chamber,
+// and at low traffic with and without predictive pre-levelling. Times are
+// converted back to the fake simulator's own clock, so they read as they
+// would on the real sluice.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FakeSimulator.h"
+#include "../code/LockageScheduler.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/returnValues.h"
+#include "../code/lib/timing.h"
+
+#define BENCH_PORT 17300
+#define PASSAGE_MS 30000	// Simulated: sailing in or out of the chamber
+
+struct Traffic
+{
+	const char* name;
+	int vessels;
+	int meanArrivalGapMs;	// Simulated
+	int lowSidePercent;		// Share of the vessels coming from the low side
+	double timeScale;		// Real ms per simulated ms, quiet traffic runs faster to keep this short
+};
+
+// Three vessels a minute from either side.
+static const Traffic busy = { "busy", 16, 20000, 50, 0.01 };
+// One every five minutes, mostly going up.
+static const Traffic quiet = { "quiet", 24, 300000, 80, 0.002 };
+
+static void measure(const Traffic& traffic, int capacity, bool predictive, int port)
+{
+	FakeSluiceModel model = standardModel();
+	model.timeScale = traffic.timeScale;
+	FakeSimulator simulator(port, model);
+	StandardSluice sluice(port);
+	LockageScheduler scheduler(sluice, capacity, (long long) (PASSAGE_MS * model.timeScale));
+	scheduler.setPredictive(predictive);
+
+	// The same arrivals for every run.
+	srand(1);
+	long long start = monotonicMs();
+	long long arrival = 0;
+	for (int i = 0; i < traffic.vessels; i++)
+	{
+		arrival += rand() % (2 * traffic.meanArrivalGapMs);
+		DoorSide from = (rand() % 100 < traffic.lowSidePercent) ? left : right;
+		scheduler.addVessel(from, start + (long long) (arrival * model.timeScale));
+	}
+
+	int rtnval = scheduler.run();
+	SchedulerReport report = scheduler.report();
+
+	printf("%-8s %8d %-10s %8d %6d %6d %10.1f %10.1f %10.1f %s\n", traffic.name, capacity,
+		predictive ? "yes" : "no", report.lockages, report.emptyLevelChanges, report.preLevellings,
+		report.vesselsPerHour * model.timeScale,
+		report.averageWaitMs / model.timeScale / 60000.0, report.longestWaitMs / model.timeScale / 60000.0,
+		rtnval == success ? "" : "FAILED");
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+
+	printf("%-8s %8s %-10s %8s %6s %6s %10s %10s %10s\n", "traffic", "capacity", "predictive",
+		"lockages", "empty", "ahead", "vessels/h", "avg wait", "max wait");
+	printf("%-8s %8s %-10s %8s %6s %6s %10s %10s %10s\n", "", "", "", "", "", "", "", "(min)", "(min)");
+	measure(busy, 1, false, BENCH_PORT);
+	measure(busy, CHAMBER_CAPACITY, false, BENCH_PORT + 1);
+	measure(quiet, CHAMBER_CAPACITY, false, BENCH_PORT + 2);
+	measure(quiet, CHAMBER_CAPACITY, true, BENCH_PORT + 3);
+
+	return 0;
+}
@@ -0,0 +1,144 @@
+// Commands that go together sent one by one and as a macro command, over a
+// link that adds its delay to every round trip: switching a light (two
+// commands) and closing a side's three valves. Then with the simulator
+// refusing one of them: switching to red sends what failed again and
+// never goes back to green, switching to green goes back to red, a valve
+// that did not close is closed again.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FakeSimulator.h"
+#include "../code/CommunicationHandler.h"
+#include "../code/MacroCommand.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/commands.h"
+#include "../code/lib/returnValues.h"
+#include "../code/lib/timing.h"
+
+#define BENCH_PORT 18600
+#define SWITCHES 200
+#define SLOW_LINK_US 500
+
+static const char* const toRed[] = { TrafficLight1GreenOff, TrafficLight1RedOn };
+static const char* const toGreen[] = { TrafficLight1RedOff, TrafficLight1GreenOn };
+static const char* const opens[] = { DoorRightOpenTopValve, DoorRightOpenMiddleValve, DoorRightOpenBottomValve };
+static const char* const closes[] = { DoorRightCloseTopValve, DoorRightCloseMiddleValve, DoorRightCloseBottomValve };
+
+static bool oneByOne(SimulationCommunicator& simulation, const char* const commands[], int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (strcmp(simulation.sendMessage(commands[i]), "ack") != 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool asMacro(SimulationCommunicator& simulation, const char* const commands[], int count)
+{
+	MacroCommand macro;
+	for (int i = 0; i < count; i++)
+	{
+		macro.add(commands[i], NULL);
+	}
+	return macro.run(simulation);
+}
+
+static void measure(const char name[], int port, bool (*sendAll)(SimulationCommunicator&, const char* const[], int))
+{
+	FakeSluiceModel model = standardModel();
+	model.replyDelayUs = SLOW_LINK_US;
+	FakeSimulator simulator(port, model);
+	SimulationCommunicator simulation(port);
+
+	bool acked = true;
+	long long started = monotonicUs();
+	for (int i = 0; i < SWITCHES; i++)
+	{
+		acked = sendAll(simulation, (i % 2) ? toGreen : toRed, 2) && acked;
+	}
+	long long lightUs = (monotonicUs() - started) / SWITCHES;
+	long long lightTrips = simulator.counters().roundTrips;
+
+	simulator.resetCounters();
+	long long valvesUs = 0;
+	for (int i = 0; i < SWITCHES; i++)
+	{
+		oneByOne(simulation, opens, 3);
+		started = monotonicUs();
+		acked = sendAll(simulation, closes, 3) && acked;
+		valvesUs += monotonicUs() - started;
+	}
+	long long valveTrips = simulator.counters().roundTrips - SWITCHES * 3; // Not the opens
+
+	printf("%-12s %11.1f %8lld %11.1f %8lld %s\n", name, (double) lightTrips / SWITCHES, lightUs,
+		(double) valveTrips / SWITCHES, valvesUs / SWITCHES, acked ? "" : "FAILED");
+}
+
+static void switchRefused(FakeSimulator& simulator, CommunicationHandler& handler, const char name[],
+	const char refused[], int times, bool toRed)
+{
+	// From the other colour, the way the sluice switches.
+	if (toRed)
+	{
+		handler.greenLight(1);
+	}
+	else
+	{
+		handler.redLight(1);
+	}
+	simulator.refuse(refused, times);
+	simulator.resetCounters();
+	int rtnval = toRed ? handler.redLight(1) : handler.greenLight(1);
+	const char* told = (handler.commandedLight(1) == redLightOn) ? "red" : "green";
+	printf("%-18s %s, light shows red %s green %s, %s commanded, %lld round trips, %lld commands\n", name,
+		(rtnval == success) ? "switched" : "not switched", simulator.lightShows(0, true) ? "on" : "off",
+		simulator.lightShows(0, false) ? "on" : "off", told, simulator.counters().roundTrips,
+		simulator.counters().commands);
+}
+
+static void measureRefused(int port)
+{
+	FakeSluiceModel model = standardModel();
+	model.replyDelayUs = SLOW_LINK_US;
+	FakeSimulator simulator(port, model);
+	CommunicationHandler handler(port);
+
+	switchRefused(simulator, handler, "red refused once", "SetTrafficLight1Red:on", 1, true);
+	switchRefused(simulator, handler, "red refused twice", "SetTrafficLight1Red:on", 2, true);
+	switchRefused(simulator, handler, "green refused", "SetTrafficLight1Green:on", 1, false);
+
+	for (int row = 1; row <= 3; row++)
+	{
+		handler.valveOpen(right, row);
+	}
+	simulator.refuse("SetDoorRightValve2:close", 1);
+	simulator.resetCounters();
+	bool closed = handler.valvesClose(right, 7);
+	int open = 0;
+	for (int row = 1; row <= 3; row++)
+	{
+		open += handler.getValveOpened(right, row) ? 1 : 0;
+	}
+	long long roundTrips = simulator.counters().roundTrips - 3; // Not the 3 queries
+	printf("%-18s %s, %d valves open, %lld round trips, %lld commands\n", "close refused",
+		closed ? "closed" : "not closed", open, roundTrips, simulator.counters().commands);
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+	argv_queryrate = 0; // Only what is sent is counted, not how fast
+
+	printf("%d us link, per light switch and per closing of three valves\n", SLOW_LINK_US);
+	printf("%-12s %11s %8s %11s %8s\n", "sent", "light trips", "light us", "valve trips", "valve us");
+	measure("one by one", BENCH_PORT, &oneByOne);
+	measure("macro", BENCH_PORT + 1, &asMacro);
+
+	printf("\n");
+	measureRefused(BENCH_PORT + 2);
+	return 0;
+}
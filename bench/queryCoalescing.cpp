@@ -0,0 +1,120 @@
+// Queries a sluice saves by reusing replies: whole rounds of a standard
+// sluice with replies only shared while on their way (-k 0) and with the
+// default freshness window, then several threads reading the water level
+// of one sluice over a slow link at once.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <vector>
+
+#include "FakeSimulator.h"
+#include "../code/CommunicationHandler.h"
+#include "../code/Sluice.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/returnValues.h"
+#include "../code/lib/timing.h"
+
+#define BENCH_PORT 18400
+#define ROUNDS 5
+#define READERS 8
+#define READ_MS 500
+#define SLOW_LINK_US 500
+
+static int round(StandardSluice& sluice)
+{
+	int rtnval = sluice.allowEntry();
+	rtnval = (rtnval == success) ? sluice.start() : rtnval;
+	rtnval = (rtnval == success) ? sluice.allowExit() : rtnval;
+	rtnval = (rtnval == success) ? sluice.start() : rtnval;
+	return rtnval;
+}
+
+static void measureRounds(int port, int freshMs)
+{
+	argv_freshness = freshMs;
+	FakeSimulator simulator(port, standardModel());
+	StandardSluice sluice(port);
+
+	long long started = monotonicMs();
+	int rtnval = success;
+	for (int i = 0; i < ROUNDS && rtnval == success; i++)
+	{
+		rtnval = round(sluice);
+	}
+	FakeCounters counted = simulator.counters();
+	SluiceStatus status;
+	bool shown = false;
+	for (int slot = 0; slot < STATUS_BOARD_SLOTS && !shown; slot++)
+	{
+		shown = controllerStatusBoard().read(slot, status) && status.port == port;
+	}
+	printf("%-6d %10lld %10lld %10lld %8lld %s\n", freshMs, counted.queries / ROUNDS,
+		shown ? status.coalesced / ROUNDS : -1, counted.commands / ROUNDS, (monotonicMs() - started) / ROUNDS,
+		(rtnval == success) ? "" : "FAILED");
+}
+
+struct Reader
+{
+	CommunicationHandler* handler;
+	long long reads;
+};
+
+static volatile bool reading;
+
+static void* read(void* arg)
+{
+	Reader* reader = (Reader*) arg;
+	while (reading)
+	{
+		reader->handler->getWaterLevel();
+		reader->reads++;
+	}
+	return NULL;
+}
+
+static void measureReaders(int port, int freshMs)
+{
+	argv_freshness = freshMs;
+	FakeSluiceModel model = standardModel();
+	model.replyDelayUs = SLOW_LINK_US;
+	FakeSimulator simulator(port, model);
+	CommunicationHandler handler(port);
+
+	std::vector<Reader> readers(READERS);
+	std::vector<pthread_t> threads(READERS);
+	reading = true;
+	for (int i = 0; i < READERS; i++)
+	{
+		readers[i].handler = &handler;
+		readers[i].reads = 0;
+		pthread_create(&threads[i], NULL, read, &readers[i]);
+	}
+	sleepMs(READ_MS);
+	reading = false;
+	long long reads = 0;
+	for (int i = 0; i < READERS; i++)
+	{
+		pthread_join(threads[i], NULL);
+		reads += readers[i].reads;
+	}
+	FakeCounters counted = simulator.counters();
+	printf("%-6d %10lld %10lld %10lld\n", freshMs, reads * 1000 / READ_MS, counted.queries * 1000 / READ_MS,
+		handler.queryCounters().coalesced * 1000 / READ_MS);
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+	argv_queryrate = 0; // Only what is sent is counted, not how fast
+
+	printf("per round of a standard sluice\n");
+	printf("%-6s %10s %10s %10s %8s\n", "-k ms", "queries", "coalesced", "commands", "ms");
+	measureRounds(BENCH_PORT, 0);
+	measureRounds(BENCH_PORT + 1, 10);
+
+	printf("\n%d threads reading the water level, %d us link, per second\n", READERS, SLOW_LINK_US);
+	printf("%-6s %10s %10s %10s\n", "-k ms", "answered", "sent", "coalesced");
+	measureReaders(BENCH_PORT + 2, 0);
+	measureReaders(BENCH_PORT + 3, 10);
+	return 0;
+}
@@ -0,0 +1,120 @@
+// One sluice polling flat out next to three that poll politely, without
+// limits, with a limit per simulator (-q) and with one budget for the
+// whole fleet that the sluices take turns on (-Q). The polite sluices also
+// switch a light every round: commands must never be held up.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <vector>
+
+#include "FakeSimulator.h"
+#include "../code/CommunicationHandler.h"
+#include "../code/QueryLimiter.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/timing.h"
+
+#define BENCH_PORT 18200
+#define SLUICES 4
+#define RUN_MS 1000
+#define POLITE_PAUSE_US 2000
+
+struct Poller
+{
+	CommunicationHandler* handler;
+	bool greedy;
+	long long commands;
+	long long commandUs;
+};
+
+static volatile bool running;
+
+static void* poll(void* arg)
+{
+	Poller* poller = (Poller*) arg;
+	while (running)
+	{
+		poller->handler->getWaterLevel();
+		if (!poller->greedy)
+		{
+			long long sentAt = monotonicUs();
+			poller->handler->redLight(1);
+			poller->commandUs += monotonicUs() - sentAt;
+			poller->commands++;
+			sleepUs(POLITE_PAUSE_US);
+		}
+	}
+	return NULL;
+}
+
+static void measure(const char name[], int perSimulator, int fleet)
+{
+	argv_queryrate = perSimulator;
+	fleetQueryScheduler().configure(fleet, QUERY_BURST);
+
+	std::vector<FakeSimulator*> simulators;
+	std::vector<Poller> pollers(SLUICES);
+	std::vector<pthread_t> threads(SLUICES);
+	for (int i = 0; i < SLUICES; i++)
+	{
+		simulators.push_back(new FakeSimulator(BENCH_PORT + i, standardModel()));
+		pollers[i].handler = new CommunicationHandler(BENCH_PORT + i);
+		pollers[i].greedy = (i == 0);
+		pollers[i].commands = 0;
+		pollers[i].commandUs = 0;
+	}
+
+	running = true;
+	for (int i = 0; i < SLUICES; i++)
+	{
+		pthread_create(&threads[i], NULL, poll, &pollers[i]);
+	}
+	sleepMs(RUN_MS);
+	running = false;
+	for (int i = 0; i < SLUICES; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	QueryCounters greedy = pollers[0].handler->queryCounters();
+	QueryCounters polite;
+	polite.queries = 0;
+	polite.throttled = 0;
+	polite.throttledUs = 0;
+	long long commands = 0;
+	long long commandUs = 0;
+	for (int i = 1; i < SLUICES; i++)
+	{
+		QueryCounters count = pollers[i].handler->queryCounters();
+		polite.queries += count.queries;
+		polite.throttled += count.throttled;
+		polite.throttledUs += count.throttledUs;
+		commands += pollers[i].commands;
+		commandUs += pollers[i].commandUs;
+	}
+	polite.queries /= SLUICES - 1;
+	polite.throttled /= SLUICES - 1;
+
+	printf("%-18s %10lld %10lld %10lld %10lld %12lld %10lld\n", name, greedy.queries * 1000 / RUN_MS, greedy.throttled,
+		polite.queries * 1000 / RUN_MS, polite.throttled, (polite.queries > 0) ? polite.throttledUs / (polite.queries * (SLUICES - 1)) : 0,
+		(commands > 0) ? commandUs / commands : 0);
+
+	for (int i = 0; i < SLUICES; i++)
+	{
+		delete pollers[i].handler;
+		delete simulators[i];
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+	argv_freshness = 0; // Every read of the greedy loop has to go out
+
+	printf("%-18s %10s %10s %10s %10s %12s %10s\n", "limits", "greedy q/s", "throttled", "polite q/s", "throttled",
+		"wait us/q", "cmd us");
+	measure("none", 0, 0);
+	measure("-q 1000", 1000, 0);
+	measure("-q 1000 -Q 1500", 1000, 1500);
+	measure("-Q 1000", 0, 1000);
+	return 0;
+}
@@ -0,0 +1,65 @@
+// Round trips a sluice saves by sending the next step's queries along with
+// each command: whole rounds of a standard sluice over a link that adds
+// its delay to every round trip, with the queries sent on their own (-n)
+// and sent along. The first round only learns what follows which command.
+
+#include <stdio.h>
+
+#include "FakeSimulator.h"
+#include "../code/Sluice.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/returnValues.h"
+#include "../code/lib/timing.h"
+
+#define BENCH_PORT 18500
+#define ROUNDS 5
+#define SLOW_LINK_US 500
+
+static int round(StandardSluice& sluice)
+{
+	int rtnval = sluice.allowEntry();
+	rtnval = (rtnval == success) ? sluice.start() : rtnval;
+	rtnval = (rtnval == success) ? sluice.allowExit() : rtnval;
+	rtnval = (rtnval == success) ? sluice.start() : rtnval;
+	return rtnval;
+}
+
+static void measureRounds(int port, bool speculate)
+{
+	argv_speculate = speculate;
+	FakeSluiceModel model = standardModel();
+	model.replyDelayUs = SLOW_LINK_US;
+	FakeSimulator simulator(port, model);
+	StandardSluice sluice(port);
+
+	int rtnval = round(sluice); // Learning
+	simulator.resetCounters();
+	long long started = monotonicMs();
+	for (int i = 0; i < ROUNDS && rtnval == success; i++)
+	{
+		rtnval = round(sluice);
+	}
+	long long took = monotonicMs() - started;
+	FakeCounters counted = simulator.counters();
+	SluiceStatus status;
+	bool shown = false;
+	for (int slot = 0; slot < STATUS_BOARD_SLOTS && !shown; slot++)
+	{
+		shown = controllerStatusBoard().read(slot, status) && status.port == port;
+	}
+	printf("%-10s %11lld %8lld %9lld %10lld %6lld %s\n", speculate ? "along" : "-n",
+		counted.roundTrips / ROUNDS, counted.queries / ROUNDS, counted.commands / ROUNDS,
+		shown ? status.prefetched / (ROUNDS + 1) : -1, took / ROUNDS, (rtnval == success) ? "" : "FAILED");
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+	argv_queryrate = 0; // Only what is sent is counted, not how fast
+
+	printf("per round of a standard sluice, %d us link\n", SLOW_LINK_US);
+	printf("%-10s %11s %8s %9s %10s %6s\n", "queries", "round trips", "queries", "commands", "prefetched", "ms");
+	measureRounds(BENCH_PORT, false);
+	measureRounds(BENCH_PORT + 1, true);
+	return 0;
+}
@@ -0,0 +1,119 @@
+// How soon a stuck sluice gives up: a door that is told to close and never
+// gets there, and water that stops rising with the valves open. Before the
+// watchdog only the operation's deadline (-o) ended either, and the sluice
+// kept polling all that time. After each stall the simulator is freed and
+// the sluice has to carry on from where it stopped.
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "FakeSimulator.h"
+#include "../code/Sluice.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/returnValues.h"
+#include "../code/lib/timing.h"
+
+#define BENCH_PORT 18300
+#define LEARNING_ROUNDS 2
+
+static const char* resultName(int result)
+{
+	switch (result)
+	{
+		case success:			return "success";
+		case operationStalled:	return "stalled";
+		case timeoutExpired:	return "timed out";
+		default:				return "failed";
+	}
+}
+
+static void report(const char name[], FakeSimulator& simulator, long long started, int result)
+{
+	long long took = monotonicMs() - started;
+	FakeCounters counted = simulator.counters();
+	printf("%-22s %-10s %8lld %9lld %10d\n", name, resultName(result), took, counted.queries, argv_optimeout * 1000);
+}
+
+struct Operation
+{
+	StandardSluice* sluice;
+	int result;
+};
+
+static void* goUp(void* arg)
+{
+	Operation* operation = (Operation*) arg;
+	operation->result = operation->sluice->start();
+	return NULL;
+}
+
+static int round(StandardSluice& sluice)
+{
+	// In at the low side, up, out at the high side, and back down empty.
+	int rtnval = sluice.allowEntry();
+	rtnval = (rtnval == success) ? sluice.start() : rtnval;
+	rtnval = (rtnval == success) ? sluice.allowExit() : rtnval;
+	rtnval = (rtnval == success) ? sluice.start() : rtnval;
+	return rtnval;
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+
+	FakeSimulator simulator(BENCH_PORT, standardModel());
+	StandardSluice sluice(BENCH_PORT);
+	for (int i = 0; i < LEARNING_ROUNDS; i++)
+	{
+		if (round(sluice) != success)
+		{
+			printf("learning round %d failed\n", i + 1);
+			return 1;
+		}
+	}
+	printf("%-22s %-10s %8s %9s %10s\n", "stuck", "result", "ms", "queries", "-o ms");
+
+	// The left door jams on its way shut.
+	int rtnval = sluice.allowEntry();
+	simulator.jam(true);
+	simulator.resetCounters();
+	long long started = monotonicMs();
+	rtnval = (rtnval == success) ? sluice.start() : rtnval;
+	report("door closing", simulator, started, rtnval);
+
+	simulator.jam(false);
+	simulator.resetCounters();
+	started = monotonicMs();
+	rtnval = sluice.allowEntry();
+	rtnval = (rtnval == success) ? sluice.start() : rtnval;
+	report("  then entry and up", simulator, started, rtnval);
+
+	// The water stops rising halfway, timed from there.
+	rtnval = sluice.allowExit();
+	rtnval = (rtnval == success) ? sluice.start() : rtnval;
+	rtnval = (rtnval == success) ? sluice.allowEntry() : rtnval;
+	if (rtnval != success)
+	{
+		printf("back to the low side failed: %d\n", rtnval);
+		return 1;
+	}
+	Operation operation = { &sluice, success };
+	pthread_t thread;
+	pthread_create(&thread, NULL, &goUp, &operation);
+	while (simulator.waterLevel() < 50.0)
+	{
+		sleepMs(1);
+	}
+	simulator.jam(true);
+	simulator.resetCounters();
+	started = monotonicMs();
+	pthread_join(thread, NULL);
+	report("water rising", simulator, started, operation.result);
+
+	simulator.jam(false);
+	simulator.resetCounters();
+	started = monotonicMs();
+	rtnval = sluice.levelTo(right); // start() only goes from one side to the other
+	report("  then level up", simulator, started, rtnval);
+	return 0;
+}
@@ -0,0 +1,151 @@
+// What a restart of the controller costs with a state file (-s): a child
+// process runs an operation and is killed halfway, then a new controller
+// picks the sluice up with recover(). Shows what recover() made of it, the
+// messages it took and how long until it was done. A controller without a
+// state file can't tell what was going on, start() refuses a chamber that
+// is neither high nor low.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "FakeSimulator.h"
+#include "../code/Sluice.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/returnValues.h"
+#include "../code/lib/timing.h"
+
+#define BENCH_PORT 17700
+
+enum Scenario
+{
+	killedOpening,		// While the door opens for the vessels
+	killedSluicing,		// While the water rises
+	killedInEmergency	// After the emergency button stopped the water
+};
+
+static StandardSluice* childSluice;
+
+static void emergencyHandler(int sig)
+{
+	childSluice->passInterrupt();
+}
+
+static void runChild(Scenario scenario)
+{
+	StandardSluice sluice(BENCH_PORT);
+	childSluice = &sluice;
+	signal(SIGUSR1, &emergencyHandler);
+	sluice.recover();
+	if (scenario == killedOpening || sluice.allowEntry() == success)
+	{
+		if (scenario == killedOpening)
+		{
+			sluice.allowEntry();
+		}
+		else
+		{
+			sluice.start();
+		}
+	}
+	pause(); // Until killed
+	_exit(0);
+}
+
+// Starts a controller that gets killed where the scenario says.
+static void killHalfway(FakeSimulator& simulator, Scenario scenario)
+{
+	simulator.restart();
+	sleepMs(100); // Served by the simulator's thread
+	fflush(stdout);
+	pid_t child = fork();
+	if (child == 0)
+	{
+		runChild(scenario);
+	}
+
+	while ((scenario == killedOpening) ? simulator.doorOpened(left) < 0.3 : simulator.waterLevel() < 40.0)
+	{
+		sleepMs(1);
+	}
+	if (scenario == killedInEmergency)
+	{
+		kill(child, SIGUSR1);
+		sleepMs(50);
+	}
+	kill(child, SIGKILL);
+	waitpid(child, NULL, 0);
+}
+
+static void report(const char name[], const char result[], FakeSimulator& simulator, long long started)
+{
+	long long took = monotonicMs() - started;
+	FakeCounters counted = simulator.counters();
+	printf("%-20s %-18s %8lld %8lld %8lld\n", name, result, counted.commands, counted.queries, took);
+}
+
+static const char* describe(int rtnval)
+{
+	switch (rtnval)
+	{
+		case success:
+			return "finished";
+		case interruptReceived:
+			return "emergency again";
+		case stateDiscarded:
+			return "discarded";
+		case invalidWaterLevel:
+			return "refused";
+		default:
+			return "FAILED";
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+	char directory[] = "/tmp/sluiceStateXXXXXX";
+	if (mkdtemp(directory) == NULL)
+	{
+		DieWithError("stateRestart: no state directory");
+	}
+	argv_statedir = directory;
+
+	FakeSimulator simulator(BENCH_PORT, standardModel());
+	printf("%-20s %-18s %8s %8s %8s\n", "killed", "after restart", "commands", "queries", "ms");
+
+	const char* names[3] = { "opening the door", "sluicing", "in an emergency" };
+	for (int scenario = killedOpening; scenario <= killedInEmergency; scenario++)
+	{
+		killHalfway(simulator, (Scenario) scenario);
+		StandardSluice sluice(BENCH_PORT);
+		simulator.resetCounters();
+		long long started = monotonicMs();
+		int rtnval = sluice.recover();
+		report(names[scenario], describe(rtnval), simulator, started);
+
+		if (rtnval == interruptReceived)
+		{
+			simulator.resetCounters();
+			started = monotonicMs();
+			sluice.passInterrupt();
+			report("", "button pressed", simulator, started);
+		}
+	}
+
+	// The same, without anything to go on.
+	killHalfway(simulator, killedSluicing);
+	argv_statedir = NULL;
+	StandardSluice sluice(BENCH_PORT);
+	simulator.resetCounters();
+	long long started = monotonicMs();
+	report("sluicing, no file", describe(sluice.start()), simulator, started);
+
+	char path[256];
+	snprintf(path, sizeof(path), STATE_FILE_PATH, directory, BENCH_PORT);
+	unlink(path);
+	rmdir(directory);
+	return 0;
+}
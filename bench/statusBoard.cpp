@@ -0,0 +1,228 @@
+// What a monitor pays to see a sluice's state. Reading the status board is
+// compared with asking the simulator itself (readSnapshot(), one query per
+// door, valve, light and the water), and readers running flat out against
+// a controller publishing flat out must never see a half-written status.
+// Last, a controller killed halfway publishing: monitors give up on its
+// slot, the next controller takes the slot over and publishes again.
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "FakeSimulator.h"
+#include "../code/CommunicationHandler.h"
+#include "../code/StatusBoard.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/timing.h"
+
+#define BENCH_PORT 17900
+#define BENCH_BOARD "/sluiceStatusBench"
+#define SNAPSHOT_ROUNDS 200
+#define BOARD_ROUNDS 200000
+#define STRESS_MS 1000
+#define MAX_READERS 4
+
+static volatile bool stressing;
+
+struct ReaderCount
+{
+	long long reads;
+	long long torn;
+};
+
+// Every field of a published status is derived from one counter, so a copy
+// that mixes two publishes shows.
+static void fillStatus(SluiceStatus& status, long long n)
+{
+	memset(&status, 0, sizeof(status));
+	status.port = BENCH_PORT;
+	status.doors[left] = (DoorState) (n % 7);
+	status.doors[right] = (DoorState) (n % 7);
+	status.waterLevel = (WaterLevel) (n % 5);
+	status.emergency = (n & 1) != 0;
+	status.operationSinceMs = n;
+	status.updatedAtMs = n;
+	status.commands = n;
+	status.queries = n;
+}
+
+static bool consistent(const SluiceStatus& status)
+{
+	long long n = status.commands;
+	return status.queries == n && status.updatedAtMs == n && status.operationSinceMs == n
+		&& status.doors[left] == (DoorState) (n % 7) && status.doors[right] == (DoorState) (n % 7)
+		&& status.waterLevel == (WaterLevel) (n % 5) && status.emergency == ((n & 1) != 0);
+}
+
+static void* reader(void* arg)
+{
+	ReaderCount* count = (ReaderCount*) arg;
+	StatusBoard board(BENCH_BOARD, false); // A mapping of its own, like a monitor process has
+	board.open();
+	SluiceStatus status;
+	while (stressing)
+	{
+		if (board.read(0, status))
+		{
+			count->reads++;
+			if (!consistent(status))
+			{
+				count->torn++;
+			}
+		}
+	}
+	return NULL;
+}
+
+static void stress(int readers)
+{
+	StatusBoard board(BENCH_BOARD, true);
+	if (!board.open())
+	{
+		printf("no shared memory for %s\n", BENCH_BOARD);
+		return;
+	}
+	int slot = board.claim(BENCH_PORT);
+	SluiceStatus status;
+	fillStatus(status, 0);
+	board.publish(slot, status);
+
+	stressing = true;
+	pthread_t threads[MAX_READERS];
+	ReaderCount counts[MAX_READERS];
+	for (int i = 0; i < readers; i++)
+	{
+		counts[i].reads = 0;
+		counts[i].torn = 0;
+		pthread_create(&threads[i], NULL, reader, &counts[i]);
+	}
+
+	long long published = 0;
+	long long end = monotonicMs() + STRESS_MS;
+	while (monotonicMs() < end)
+	{
+		for (int i = 0; i < 1000; i++)
+		{
+			fillStatus(status, ++published);
+			board.publish(slot, status);
+		}
+	}
+	stressing = false;
+
+	long long reads = 0;
+	long long torn = 0;
+	for (int i = 0; i < readers; i++)
+	{
+		pthread_join(threads[i], NULL);
+		reads += counts[i].reads;
+		torn += counts[i].torn;
+	}
+	board.release(slot);
+	board.close();
+	shm_unlink(BENCH_BOARD);
+
+	printf("%8d %14lld %14lld %8lld\n", readers, published * 1000 / STRESS_MS, reads * 1000 / STRESS_MS, torn);
+}
+
+static int findSlot(StatusBoard& board, int port)
+{
+	SluiceStatus status;
+	for (int slot = 0; slot < STATUS_BOARD_SLOTS; slot++)
+	{
+		if (board.read(slot, status) && status.port == port)
+		{
+			return slot;
+		}
+	}
+	return -1;
+}
+
+static void killedPublishing()
+{
+	// The controller dies between the odd and the even store of a publish.
+	pid_t child = fork();
+	if (child == 0)
+	{
+		StatusBoard board(BENCH_BOARD, true);
+		board.open();
+		int slot = board.claim(BENCH_PORT);
+		int fd = shm_open(BENCH_BOARD, O_RDWR, 0);
+		StatusBoardRegion* region = (StatusBoardRegion*) mmap(NULL, sizeof(StatusBoardRegion),
+			PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		region->slots[slot].sequence++;
+		_exit(0);
+	}
+	waitpid(child, NULL, 0);
+
+	StatusBoard monitor(BENCH_BOARD, false);
+	monitor.open();
+	SluiceStatus status;
+	long long started = monotonicUs();
+	bool halfRead = monitor.read(0, status);
+	long long gaveUpUs = monotonicUs() - started;
+
+	StatusBoard board(BENCH_BOARD, true);
+	board.open();
+	int slot = board.claim(BENCH_PORT);
+	fillStatus(status, 1);
+	bool published = board.publish(slot, status);
+	bool read = monitor.read(slot, status) && consistent(status);
+	board.release(slot);
+	board.close();
+	monitor.close();
+	shm_unlink(BENCH_BOARD);
+
+	printf("\nkilled publishing: read %s in %lld us, slot %d taken over, publish %s, read %s, released\n",
+		halfRead ? "SUCCEEDED" : "gave up", gaveUpUs, slot, published ? "done" : "REFUSED", read ? "done" : "FAILED");
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+
+	FakeSimulator simulator(BENCH_PORT, standardModel());
+	CommunicationHandler handler(BENCH_PORT);
+	handler.getWaterLevel(); // Something on the board besides the port
+
+	long long started = monotonicUs();
+	for (int i = 0; i < SNAPSHOT_ROUNDS; i++)
+	{
+		handler.readSnapshot();
+	}
+	long long snapshotNs = (monotonicUs() - started) * 1000 / SNAPSHOT_ROUNDS;
+	FakeCounters asked = simulator.counters();
+
+	StatusBoard monitor(STATUS_BOARD_NAME, false);
+	int slot = monitor.open() ? findSlot(monitor, BENCH_PORT) : -1;
+	if (slot < 0)
+	{
+		printf("sluice %d is not on the board\n", BENCH_PORT);
+		return 1;
+	}
+	simulator.resetCounters();
+	SluiceStatus status;
+	started = monotonicUs();
+	for (int i = 0; i < BOARD_ROUNDS; i++)
+	{
+		monitor.read(slot, status);
+	}
+	long long boardNs = (monotonicUs() - started) * 1000 / BOARD_ROUNDS;
+	FakeCounters boardAsked = simulator.counters();
+
+	printf("%-14s %12s %18s\n", "source", "ns per read", "queries per read");
+	printf("%-14s %12lld %18lld\n", "readSnapshot", snapshotNs, asked.queries / SNAPSHOT_ROUNDS);
+	printf("%-14s %12lld %18lld\n", "status board", boardNs, boardAsked.queries / BOARD_ROUNDS);
+	printf("\n");
+
+	printf("%8s %14s %14s %8s\n", "readers", "publishes/s", "reads/s", "torn");
+	for (int readers = 1; readers <= MAX_READERS; readers *= 2)
+	{
+		stress(readers);
+	}
+	killedPublishing();
+	return 0;
+}
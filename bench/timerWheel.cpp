@@ -0,0 +1,228 @@
+// The timer wheel against an ordered map of timers, with 10k and 100k of
+// them pending at once: scheduling, cancelling half of them (what the
+// emergency button does to every waiting sluice) and firing the rest. Time
+// is simulated here, every tick is advanced. Then real waits through the
+// poll scheduler: how late they wake up with many sluices waiting, and how
+// soon a cancelled one is back.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <vector>
+
+#include "../code/PollScheduler.h"
+#include "../code/TimerWheel.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/timing.h"
+
+#define MAX_DELAY_MS 60000
+#define WAITERS 64
+#define WAIT_RUN_MS 1000
+#define MAX_WAIT_MS 20
+
+static long long simulatedMs;
+static long long fired;
+static long long late;			// Timers that fired after their tick
+
+static void countFire(WheelTimer* timer)
+{
+	fired++;
+	if (timer->expiresMs != simulatedMs)
+	{
+		late++;
+	}
+}
+
+static double nsEach(long long startedUs, long long count)
+{
+	return (monotonicUs() - startedUs) * 1000.0 / count;
+}
+
+static void measureWheel(int count, const std::vector<long long>& delays)
+{
+	std::vector<WheelTimer> timers(count);
+	TimerWheel wheel(0);
+	simulatedMs = 0;
+	fired = 0;
+	late = 0;
+
+	long long started = monotonicUs();
+	for (int i = 0; i < count; i++)
+	{
+		timers[i].fire = &countFire;
+		timers[i].next = NULL;
+		wheel.schedule(timers[i], delays[i]);
+	}
+	double scheduleNs = nsEach(started, count);
+
+	started = monotonicUs();
+	for (int i = 0; i < count; i += 2)
+	{
+		wheel.cancel(timers[i]);
+	}
+	double cancelNs = nsEach(started, count / 2);
+
+	started = monotonicUs();
+	while (wheel.pending() > 0)
+	{
+		simulatedMs++;
+		wheel.advance(simulatedMs);
+	}
+	double fireNs = nsEach(started, count - count / 2);
+
+	printf("%-8s %7d %11.0f %9.0f %9.0f %8lld %6lld\n", "wheel", count, scheduleNs, cancelNs, fireNs, fired, late);
+}
+
+static void measureMap(int count, const std::vector<long long>& delays)
+{
+	typedef std::multimap<long long, int> Timers;
+	Timers timers;
+	std::vector<Timers::iterator> handles(count);
+	fired = 0;
+
+	long long started = monotonicUs();
+	for (int i = 0; i < count; i++)
+	{
+		handles[i] = timers.insert(std::make_pair(delays[i], i));
+	}
+	double scheduleNs = nsEach(started, count);
+
+	started = monotonicUs();
+	for (int i = 0; i < count; i += 2)
+	{
+		timers.erase(handles[i]);
+	}
+	double cancelNs = nsEach(started, count / 2);
+
+	started = monotonicUs();
+	for (long long now = 1; !timers.empty(); now++)
+	{
+		while (!timers.empty() && timers.begin()->first <= now)
+		{
+			timers.erase(timers.begin());
+			fired++;
+		}
+	}
+	double fireNs = nsEach(started, count - count / 2);
+
+	printf("%-8s %7d %11.0f %9.0f %9.0f %8lld %6s\n", "map", count, scheduleNs, cancelNs, fireNs, fired, "-");
+}
+
+struct Waiter
+{
+	WaitChannel channel;
+	unsigned int seed;
+	long long waits;
+	long long lateUs;
+	long long worstUs;
+};
+
+static volatile bool running;
+
+static void* wait(void* arg)
+{
+	Waiter* waiter = (Waiter*) arg;
+	while (running)
+	{
+		long long when = monotonicMs() + 1 + rand_r(&waiter->seed) % MAX_WAIT_MS;
+		pollScheduler().waitUntil(waiter->channel, when);
+		long long lateness = monotonicUs() - when * 1000;
+		waiter->waits++;
+		waiter->lateUs += lateness;
+		if (lateness > waiter->worstUs)
+		{
+			waiter->worstUs = lateness;
+		}
+	}
+	return NULL;
+}
+
+static void* waitLong(void* arg)
+{
+	Waiter* waiter = (Waiter*) arg;
+	pollScheduler().waitUntil(waiter->channel, monotonicMs() + 10000);
+	waiter->lateUs = monotonicUs();
+	return NULL;
+}
+
+static void measureWaits()
+{
+	std::vector<Waiter*> waiters;
+	std::vector<pthread_t> threads(WAITERS);
+	running = true;
+	for (int i = 0; i < WAITERS; i++)
+	{
+		waiters.push_back(new Waiter());
+		waiters[i]->seed = i + 1;
+		waiters[i]->waits = 0;
+		waiters[i]->lateUs = 0;
+		waiters[i]->worstUs = 0;
+		pthread_create(&threads[i], NULL, wait, waiters[i]);
+	}
+	sleepMs(WAIT_RUN_MS);
+	running = false;
+
+	long long waits = 0;
+	long long lateUs = 0;
+	long long worstUs = 0;
+	for (int i = 0; i < WAITERS; i++)
+	{
+		pthread_join(threads[i], NULL);
+		waits += waiters[i]->waits;
+		lateUs += waiters[i]->lateUs;
+		worstUs = (waiters[i]->worstUs > worstUs) ? waiters[i]->worstUs : worstUs;
+		delete waiters[i];
+	}
+	printf("\n%d sluices waiting 1-%d ms: %lld waits, %lld us late on average, %lld us at worst\n",
+		WAITERS, MAX_WAIT_MS, waits, (waits > 0) ? lateUs / waits : 0, worstUs);
+
+	// Cancelled waits, the emergency button against sluices that would
+	// otherwise sleep another 10 s.
+	long long backUs = 0;
+	long long worstBackUs = 0;
+	for (int i = 0; i < WAITERS; i++)
+	{
+		waiters[i] = new Waiter();
+		pthread_create(&threads[i], NULL, waitLong, waiters[i]);
+	}
+	sleepMs(50);
+	int pending = pollScheduler().pending();
+	long long pressedAt = monotonicUs();
+	for (int i = 0; i < WAITERS; i++)
+	{
+		waiters[i]->channel.wake();
+	}
+	for (int i = 0; i < WAITERS; i++)
+	{
+		pthread_join(threads[i], NULL);
+		long long back = waiters[i]->lateUs - pressedAt;
+		backUs += back;
+		worstBackUs = (back > worstBackUs) ? back : worstBackUs;
+		delete waiters[i];
+	}
+	printf("%d waits cancelled (%d on the wheel): back after %lld us on average, %lld us at worst\n",
+		WAITERS, pending, backUs / WAITERS, worstBackUs);
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+
+	printf("%-8s %7s %11s %9s %9s %8s %6s\n", "timers", "pending", "schedule ns", "cancel ns", "fire ns", "fired", "late");
+	int counts[] = { 10000, 100000 };
+	for (int c = 0; c < 2; c++)
+	{
+		std::vector<long long> delays(counts[c]);
+		unsigned int seed = 42;
+		for (int i = 0; i < counts[c]; i++)
+		{
+			delays[i] = 1 + rand_r(&seed) % MAX_DELAY_MS;
+		}
+		measureWheel(counts[c], delays);
+		measureMap(counts[c], delays);
+	}
+
+	measureWaits();
+	return 0;
+}
@@ -0,0 +1,203 @@
+// Round trip latency of one query/reply over each transport.
+//
+// For every transport a child process plays a co-located simulator that
+// answers every message with "low;", and the controller side sends
+// GetWaterLevel through a real SimulationCommunicator, exactly like the
+// polling loops in Door and Sluice do.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <vector>
+
+#include "../code/SimulationCommunicator.h"
+#include "../code/ShmTransport.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/commands.h"
+
+#define BENCH_PORT 15555
+#define WARMUP 1000
+#define ROUND_TRIPS 50000
+
+static long long nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Answers every semicolon terminated message on a stream socket.
+static void serveSocket(int listenSock, int readyPipe)
+{
+	if (write(readyPipe, "r", 1) != 1)
+	{
+		exit(1);
+	}
+
+	int client = accept(listenSock, NULL, NULL);
+	int one = 1;
+	setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // Fails harmlessly on AF_UNIX
+
+	char buffer[256];
+	int received;
+	while ((received = recv(client, buffer, sizeof(buffer), 0)) > 0)
+	{
+		for (int i = 0; i < received; i++)
+		{
+			if (buffer[i] == ';' && send(client, "low;", 4, MSG_NOSIGNAL) != 4)
+			{
+				exit(0);
+			}
+		}
+	}
+	exit(0);
+}
+
+static void serveShm(int readyPipe)
+{
+	ShmTransport simulatorSide(BENCH_PORT, true);
+	if (!simulatorSide.open() || write(readyPipe, "r", 1) != 1)
+	{
+		exit(1);
+	}
+
+	char buffer[256];
+	while (true)
+	{
+		int received = simulatorSide.receive(buffer, sizeof(buffer), -1);
+		for (int i = 0; i < received; i++)
+		{
+			if (buffer[i] == ';')
+			{
+				simulatorSide.send("low;", 4);
+			}
+		}
+	}
+}
+
+static pid_t startSimulator(TransportType type)
+{
+	int readyPipe[2];
+	if (pipe(readyPipe) != 0)
+	{
+		DieWithError("pipe() failed");
+	}
+
+	int listenSock = -1;
+	if (type == tcpTransport)
+	{
+		struct sockaddr_in addr;
+		int one = 1;
+		listenSock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+		setsockopt(listenSock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+		addr.sin_port = htons(BENCH_PORT);
+		if (bind(listenSock, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(listenSock, 1) != 0)
+		{
+			DieWithError("TCP listen failed");
+		}
+	}
+	else if (type == unixTransport)
+	{
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		snprintf(addr.sun_path, sizeof(addr.sun_path), UNIX_SOCKET_PATH, BENCH_PORT);
+		unlink(addr.sun_path);
+		listenSock = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (bind(listenSock, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(listenSock, 1) != 0)
+		{
+			DieWithError("AF_UNIX listen failed");
+		}
+	}
+
+	fflush(stdout); // Or the child prints our buffered output again
+	pid_t child = fork();
+	if (child == 0)
+	{
+		if (type == shmTransport)
+		{
+			serveShm(readyPipe[1]);
+		}
+		serveSocket(listenSock, readyPipe[1]);
+	}
+
+	char ready;
+	if (read(readyPipe[0], &ready, 1) != 1)
+	{
+		DieWithError("simulator did not start");
+	}
+	close(readyPipe[0]);
+	close(readyPipe[1]);
+	if (listenSock >= 0)
+	{
+		close(listenSock);
+	}
+	return child;
+}
+
+static void measure(const char name[])
+{
+	argv_transport = (char*) name;
+	TransportType type = parseTransportType(name);
+	pid_t simulator = startSimulator(type);
+
+	std::vector<long long> samples;
+	samples.reserve(ROUND_TRIPS);
+	{
+		SimulationCommunicator communicator(BENCH_PORT);
+
+		for (int i = 0; i < WARMUP; i++)
+		{
+			communicator.sendMessage(GetWaterLevel);
+		}
+
+		long long started = nowNs();
+		for (int i = 0; i < ROUND_TRIPS; i++)
+		{
+			long long before = nowNs();
+			if (strcmp(communicator.sendMessage(GetWaterLevel), "low") != 0)
+			{
+				DieWithError("unexpected reply");
+			}
+			samples.push_back(nowNs() - before);
+		}
+		long long total = nowNs() - started;
+
+		std::sort(samples.begin(), samples.end());
+		printf("%-6s %10.2f %10.2f %10.2f %10.2f %12.0f\n", name,
+			total / 1000.0 / ROUND_TRIPS,
+			samples[ROUND_TRIPS / 2] / 1000.0,
+			samples[ROUND_TRIPS * 99 / 100] / 1000.0,
+			samples[ROUND_TRIPS - 1] / 1000.0,
+			ROUND_TRIPS * 1e9 / total);
+	}
+
+	kill(simulator, SIGTERM);
+	waitpid(simulator, NULL, 0);
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+
+	printf("%d round trips of GetWaterLevel per transport, times in microseconds\n\n", ROUND_TRIPS);
+	printf("%-6s %10s %10s %10s %10s %12s\n", "", "mean", "p50", "p99", "max", "queries/s");
+	measure("tcp");
+	measure("unix");
+	measure("shm");
+
+	return 0;
+}
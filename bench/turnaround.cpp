@@ -0,0 +1,56 @@
+// Messages and time to swap the vessels in the chamber for the ones waiting
+// at the high side: allowExit() followed by allowEntry(), against one
+// turnaround(). No passage time, so only the sluice's own work is counted.
+// Uses the pulse motor sluice, whose door is not polled while it moves, so
+// the difference is not lost among door state queries.
+
+#include <stdio.h>
+
+#include "FakeSimulator.h"
+#include "../code/Sluice.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/returnValues.h"
+#include "../code/lib/timing.h"
+
+#define BENCH_PORT 17500
+
+static bool toHighSide(Sluice& sluice)
+{
+	// Vessels in at the low side and up, the chamber ends up closed at the high side.
+	return sluice.allowEntry() == success && sluice.start() == success;
+}
+
+static bool toLowSide(Sluice& sluice)
+{
+	return sluice.start() == success && sluice.allowExit() == success;
+}
+
+static void report(const char name[], FakeSimulator& simulator, long long started, bool ok)
+{
+	long long took = monotonicMs() - started;
+	FakeCounters counted = simulator.counters();
+	printf("%-22s %8lld %9lld %8lld %s\n", name, counted.commands, counted.queries, took, ok ? "" : "FAILED");
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+
+	FakeSimulator simulator(BENCH_PORT, pulseMotorModel());
+	PulseMotorSluice sluice(BENCH_PORT);
+	printf("%-22s %8s %9s %8s\n", "at the high side", "commands", "queries", "ms");
+
+	bool ok = toHighSide(sluice);
+	simulator.resetCounters();
+	long long started = monotonicMs();
+	ok = ok && sluice.allowExit() == success && sluice.allowEntry() == success;
+	report("allowExit, allowEntry", simulator, started, ok);
+
+	ok = toLowSide(sluice) && toHighSide(sluice);
+	simulator.resetCounters();
+	started = monotonicMs();
+	ok = ok && sluice.turnaround(0) == success;
+	report("turnaround", simulator, started, ok);
+
+	return 0;
+}
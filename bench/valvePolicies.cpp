@@ -0,0 +1,65 @@
+// Fill and drain time per valve policy, with both doors closed so only the
+// water moves. Also counts fill rows the fake saw opened above the water,
+// which no policy may ever do.
+
+#include <stdio.h>
+
+#include "FakeSimulator.h"
+#include "../code/Sluice.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/returnValues.h"
+#include "../code/lib/timing.h"
+
+#define BENCH_PORT 17200
+#define LOCKAGES 3
+
+static void measure(const char name[], Sluice& sluice, FakeSimulator& simulator)
+{
+	long long fillMs = 0;
+	long long drainMs = 0;
+	long long unsafe = 0;
+	bool failed = false;
+
+	for (int lockage = 0; lockage < LOCKAGES; lockage++)
+	{
+		for (int way = 0; way < 2; way++)
+		{
+			simulator.resetCounters();
+			long long started = monotonicMs();
+			failed |= (sluice.start() != success);
+			long long took = monotonicMs() - started;
+
+			if (way == 0)
+			{
+				fillMs += took;
+			}
+			else
+			{
+				drainMs += took;
+			}
+			unsafe += simulator.counters().unsafeValves;
+		}
+	}
+
+	printf("%-12s %8lld %8lld %8lld %6lld %s\n", name, fillMs / LOCKAGES, drainMs / LOCKAGES,
+		(fillMs + drainMs) / LOCKAGES, unsafe, failed ? "FAILED" : "");
+}
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+
+	printf("%-12s %8s %8s %8s %6s\n", "policy", "fill ms", "drain ms", "cycle ms", "unsafe");
+	{
+		FakeSimulator simulator(BENCH_PORT, standardModel());
+		BasicSluice<NoLock, StandardMotor, SequentialValves> sluice(BENCH_PORT);
+		measure("sequential", sluice, simulator);
+	}
+	{
+		FakeSimulator simulator(BENCH_PORT + 1, standardModel());
+		BasicSluice<NoLock, StandardMotor, GreedyValves> sluice(BENCH_PORT + 1);
+		measure("greedy", sluice, simulator);
+	}
+
+	return 0;
+}
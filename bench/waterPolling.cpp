@@ -0,0 +1,41 @@
+// Simulator queries spent on watching the water, over consecutive lockages
+// of one sluice. The first ones poll at a fixed interval, later ones sleep
+// on what the sluice learned about each band and read the level just before
+// it changes. The time per lockage shows the valves still open promptly.
+
+#include <stdio.h>
+
+#include "FakeSimulator.h"
+#include "../code/Sluice.h"
+#include "../code/lib/auxiliary.h"
+#include "../code/lib/returnValues.h"
+#include "../code/lib/timing.h"
+
+#define BENCH_PORT 17100
+#define LOCKAGES 6
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+
+	FakeSimulator simulator(BENCH_PORT, standardModel());
+	StandardSluice sluice(BENCH_PORT);
+
+	printf("%-8s %-5s %9s %8s\n", "lockage", "way", "queries", "ms");
+	for (int lockage = 1; lockage <= LOCKAGES; lockage++)
+	{
+		// Both doors stay closed, so start() only moves the water.
+		for (int way = 0; way < 2; way++)
+		{
+			simulator.resetCounters();
+			long long started = monotonicMs();
+			int rtnval = sluice.start();
+			long long took = monotonicMs() - started;
+
+			printf("%-8d %-5s %9lld %8lld %s\n", lockage, (way == 0) ? "up" : "down",
+				simulator.counters().queries, took, rtnval == success ? "" : "FAILED");
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,61 @@
+#include "BatchIO.h"
+#include "IoUringBatchIO.h"
+#include "EpollBatchIO.h"
+#include "SimulationCommunicator.h"
+
+void BatchIO::exchangeAll(std::vector<BatchTarget>& targets, int timeoutMs)
+{
+	std::vector<BatchExchange> exchanges;
+	std::vector<int> exchangeOf(targets.size(), -1);
+
+	exchanges.reserve(targets.size());
+	for (unsigned int i = 0; i < targets.size(); i++)
+	{
+		BatchTarget& target = targets[i];
+		target.replies.assign(target.messages.size(), std::string());
+
+		BatchExchange batched;
+		if (!target.messages.empty() && target.simulation->prepareExchange(batched, &target.messages[0], target.messages.size()))
+		{
+			exchangeOf[i] = exchanges.size();
+			exchanges.push_back(batched);
+		}
+	}
+
+	if (!exchanges.empty())
+	{
+		exchange(exchanges, timeoutMs);
+	}
+
+	for (unsigned int i = 0; i < targets.size(); i++)
+	{
+		if (exchangeOf[i] >= 0)
+		{
+			targets[i].simulation->finishExchange(exchanges[exchangeOf[i]], &targets[i].replies[0]);
+		}
+	}
+
+	// Only now the simulators that were busy, one of them may keep its
+	// messages waiting for seconds.
+	for (unsigned int i = 0; i < targets.size(); i++)
+	{
+		BatchTarget& target = targets[i];
+		for (unsigned int m = 0; exchangeOf[i] < 0 && m < target.messages.size(); m++)
+		{
+			target.replies[m] = target.simulation->sendUrgent(target.messages[m]);
+		}
+	}
+}
+
+BatchIO* createBatchIO()
+{
+	IoUringBatchIO* ring = new IoUringBatchIO();
+	if (ring->available())
+	{
+		return ring;
+	}
+
+	// Kernel too old, io_uring disabled or forbidden by a seccomp profile.
+	delete ring;
+	return new EpollBatchIO();
+}
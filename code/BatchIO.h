@@ -0,0 +1,48 @@
+#ifndef BATCHIO_H_
+#define BATCHIO_H_
+
+#include <string>
+#include <vector>
+
+class SimulationCommunicator;
+
+// One socket's part of a batch: everything to send in a single write, and
+// the replies read back until all expected replies have arrived.
+struct BatchExchange
+{
+	int fd;
+	std::string request;
+	int repliesExpected;
+	std::string replies;
+	bool complete;
+};
+
+// Messages for one simulator in a fleet-wide batch.
+struct BatchTarget
+{
+	SimulationCommunicator* simulation;
+	std::vector<const char*> messages;
+	std::vector<std::string> replies;	// One per message, empty when it got no reply
+};
+
+// Talks to many simulators at once: all outgoing messages are submitted
+// together and all replies are harvested together, instead of one send and
+// one recv per message per simulator.
+class BatchIO
+{
+public:
+	virtual ~BatchIO() {}
+
+	virtual const char* name() = 0;
+	// Returns the number of exchanges that got all their replies within timeoutMs (-1 waits forever).
+	virtual int exchange(std::vector<BatchExchange>& exchanges, int timeoutMs) = 0;
+
+	// Simulators that can't take part in a batch (not connected, or connected
+	// without a socket) are sent their messages one at a time instead.
+	void exchangeAll(std::vector<BatchTarget>& targets, int timeoutMs);
+};
+
+// io_uring when the kernel offers it, epoll otherwise.
+BatchIO* createBatchIO();
+
+#endif
@@ -1,23 +1,214 @@
-// Destructor, copy constructor and assignment operator overloading is not
-// needed as this class does not contain allocated memory
+// Copy constructor and assignment operator are disabled: the handler owns its
+// status board slot, released by its destructor, and its waits' eventfd.
 
 #include <iostream>
 #include <string.h>
 
 #include "CommunicationHandler.h"
+#include "StatusBoard.h"
+#include "lib/auxiliary.h"
 #include "lib/commands.h"
 #include "lib/enums.h"
 #include "lib/returnValues.h"
+#include "lib/timing.h"
 
 CommunicationHandler::CommunicationHandler(int socket)
-	: simulation(SimulationCommunicator(socket))
+	: simulation(socket)
 {
-	
+	commanded = &ownCommanded;
+	for (int side = 0; side < 2; side++)
+	{
+		commanded->doorMotion[side] = doorStateError;
+		commanded->doorLock[side] = notCommanded;
+		for (int row = 0; row < 3; row++)
+		{
+			commanded->valves[side][row] = notCommanded;
+		}
+	}
+	for (int location = 0; location < 4; location++)
+	{
+		commanded->lights[location] = lightError;
+	}
+
+	memset(&known, 0, sizeof(known));
+	known.port = socket;
+	for (int side = 0; side < 2; side++)
+	{
+		known.doors[side] = doorStateError;
+		known.locks[side] = notCommanded;
+	}
+	for (int location = 0; location < 4; location++)
+	{
+		known.lights[location] = lightError;
+	}
+	known.waterLevel = waterError;
+	known.operation = waitingForCommand;
+	known.operationSinceMs = monotonicMs();
+	operation = NULL;
+	emergency = NULL;
+	publishMissed = false;
+	optionsRead = false;
+	boardSlot = controllerStatusBoard().claim(socket);
+	publishStatus();
+
+	simulation.setConnectionListener(this);
 }
 
 CommunicationHandler::~CommunicationHandler()
 {
+	controllerStatusBoard().release(boardSlot);
+}
+
+char* CommunicationHandler::send(const char message[])
+{
+	// Everything the simulator is told or asked goes through here. Only
+	// queries wait for the rate limits, commands move the sluice and make
+	// every reply so far stale. What the next step asked last time goes
+	// along with a command, its replies kept for when it asks again.
+	readOptions();
+	if (message[0] == 'S')
+	{
+		coalescer.forget();
+		limiter.bypass();
+		known.commands++;
+		static __thread char guesses[SPECULATED_QUERIES][RCVBUFSIZE];
+		static __thread char guessed[SPECULATED_QUERIES][RCVBUFSIZE];
+		int count = speculator.commanded(message, guesses);
+		if (count == 0)
+		{
+			return simulation.sendMessage(message);
+		}
+		const char* queries[SPECULATED_QUERIES];
+		for (int i = 0; i < count; i++)
+		{
+			queries[i] = guesses[i];
+		}
+		unsigned int asOf = coalescer.current();
+		char* reply = simulation.sendPipelined(message, queries, count, guessed);
+		for (int i = 0; i < count; i++)
+		{
+			coalescer.prefill(guesses[i], guessed[i], asOf);
+		}
+		known.speculated += count;
+		return reply;
+	}
+
+	speculator.queried(message);
+	static __thread char reused[RCVBUFSIZE];
+	int flight;
+	if (coalescer.reuse(message, reused, flight))
+	{
+		known.coalesced = coalescer.coalesced();
+		known.prefetched = coalescer.prefetched();
+		return reused;
+	}
+
+	limiter.acquire();
+	QueryCounters count = limiter.counters();
+	known.queries++;
+	known.throttled = count.throttled;
+	known.throttledMs = count.throttledUs / 1000;
+	char* reply = simulation.sendMessage(message);
+	coalescer.land(flight, reply);
+	return reply;
+}
+
+void CommunicationHandler::readOptions()
+{
+	// Not in the constructor: the sluices in main.cpp are built before the
+	// options are parsed.
+	if (optionsRead)
+	{
+		return;
+	}
+	optionsRead = true;
+	limiter.configure(argv_queryrate, QUERY_BURST);
+	coalescer.configure(argv_freshness);
+	speculator.configure(argv_speculate && argv_freshness > 0); // A reply kept 0 ms is never used
+}
+
+QueryCounters CommunicationHandler::queryCounters()
+{
+	QueryCounters count = limiter.counters();
+	count.coalesced = coalescer.coalesced();
+	count.speculated = known.speculated;
+	count.prefetched = coalescer.prefetched();
+	return count;
+}
+
+void CommunicationHandler::watchOperation(const SluiceState* current, const bool* stopped)
+{
+	operation = current;
+	emergency = stopped;
+	publishStatus();
+}
+
+void CommunicationHandler::publishStatus()
+{
+	// When another publish is half-way (the emergency button interrupted
+	// it), that one goes again with what is known by then.
+	if (boardSlot < 0)
+	{
+		return;
+	}
+	do
+	{
+		publishMissed = false;
+		long long now = monotonicMs();
+		if (operation != NULL)
+		{
+			if (*operation != known.operation)
+			{
+				if (known.operation != waitingForCommand)
+				{
+					known.phaseMs[known.operation] = now - known.operationSinceMs;
+				}
+				known.operation = *operation;
+				known.operationSinceMs = now;
+			}
+			known.emergency = *emergency;
+		}
+		known.updatedAtMs = now;
+		if (!controllerStatusBoard().publish(boardSlot, known))
+		{
+			publishMissed = true;
+			return;
+		}
+	} while (publishMissed);
+}
+
+void CommunicationHandler::setDeadline(long long deadline)
+{
+	simulation.setDeadline(deadline);
+}
+
+long long CommunicationHandler::getDeadline()
+{
+	return simulation.getDeadline();
+}
+
+bool CommunicationHandler::waitUntil(long long whenMs)
+{
+	coalescer.forget(); // Waiting is for seeing something new
+	speculator.stepEnded();
+	long long deadline = simulation.getDeadline();
+	if (deadline != NO_DEADLINE && deadline < whenMs)
+	{
+		pollScheduler().waitUntil(waits, deadline);
+		return false;
+	}
+	return pollScheduler().waitUntil(waits, whenMs);
+}
+
+void CommunicationHandler::cancelWaits()
+{
+	waits.wake();
+}
 
+bool CommunicationHandler::timedOut()
+{
+	// Either the last message got no reply in time, or the operation's deadline has passed.
+	return simulation.timedOut() || deadlineExpired(simulation.getDeadline());
 }
 
 DoorState CommunicationHandler::getDoorState(DoorSide side)
@@ -35,7 +226,7 @@ DoorState CommunicationHandler::getDoorState(DoorSide side)
 	}
 
 	// std::cout << "[DBG] Message to send: " << messageToSend << std::endl;
-	receivedMessage = simulation.sendMessage(messageToSend);
+	receivedMessage = send(messageToSend);
 	
 	// Switch cases aren't possible for strings sadly.
 	if (strcmp(receivedMessage, "doorLocked") == 0)
@@ -67,18 +258,25 @@ DoorState CommunicationHandler::getDoorState(DoorSide side)
 		dState = motorDamage;
 	}
 
+	if (dState != doorStateError)
+	{
+		known.doors[side] = dState;
+		publishStatus();
+	}
 	return dState;
 }
 
 bool CommunicationHandler::lockDoor(DoorSide side)
 {
+	commanded->doorLock[side] = commandedOn;
+
 	if (side == left)
 	{
-		receivedMessage = simulation.sendMessage(DoorLeftLock);
+		receivedMessage = send(DoorLeftLock);
 	}
 	else // side == right
 	{
-		receivedMessage = simulation.sendMessage(DoorRightLock);
+		receivedMessage = send(DoorRightLock);
 	}
 
 	if (strcmp(receivedMessage, "ack") != 0)
@@ -87,19 +285,24 @@ bool CommunicationHandler::lockDoor(DoorSide side)
 	}
 	else
 	{
+		known.locks[side] = commandedOn;
+		known.doors[side] = doorLocked;
+		publishStatus();
 		return true;
 	}
 }
 
 bool CommunicationHandler::unlockDoor(DoorSide side)
 {
+	commanded->doorLock[side] = commandedOff;
+
 	if (side == left)
 	{
-		receivedMessage = simulation.sendMessage(DoorLeftUnlock);
+		receivedMessage = send(DoorLeftUnlock);
 	}
 	else // side == right
 	{
-		receivedMessage = simulation.sendMessage(DoorRightUnlock);
+		receivedMessage = send(DoorRightUnlock);
 	}
 
 	if (strcmp(receivedMessage, "ack") != 0)
@@ -108,23 +311,30 @@ bool CommunicationHandler::unlockDoor(DoorSide side)
 	}
 	else
 	{
+		known.locks[side] = commandedOff;
+		known.doors[side] = doorClosed;
+		publishStatus();
 		return true;
 	}
 }
 
 bool CommunicationHandler::openDoor(DoorSide side)
 {
+	commanded->doorMotion[side] = doorOpening;
+
 	if (side == left)
 	{
-		receivedMessage = simulation.sendMessage(DoorLeftOpen);
+		receivedMessage = send(DoorLeftOpen);
 	}
 	else // side == right
 	{
-		receivedMessage = simulation.sendMessage(DoorRightOpen);
+		receivedMessage = send(DoorRightOpen);
 	}
 
 	if (strcmp(receivedMessage, "ack") == 0)
 	{
+		known.doors[side] = doorOpening;
+		publishStatus();
 		return true; // Door was told to open.
 	}
 	else
@@ -136,18 +346,21 @@ bool CommunicationHandler::openDoor(DoorSide side)
 bool CommunicationHandler::closeDoor(DoorSide side)
 {
 	// Door should deal with locking itself.
+	commanded->doorMotion[side] = doorClosing;
 
 	if (side == left)
 	{
-		receivedMessage = simulation.sendMessage(DoorLeftClose);
+		receivedMessage = send(DoorLeftClose);
 	}
 	else // side == right
 	{
-		receivedMessage = simulation.sendMessage(DoorRightClose);
+		receivedMessage = send(DoorRightClose);
 	}
 
 	if (strcmp(receivedMessage, "ack") == 0)
 	{
+		known.doors[side] = doorClosing;
+		publishStatus();
 		return true; // Door was told to close.
 	}
 	else
@@ -158,17 +371,24 @@ bool CommunicationHandler::closeDoor(DoorSide side)
 
 bool CommunicationHandler::stopDoor(DoorSide side)
 {
+	commanded->doorMotion[side] = doorStopped;
+
 	if (side == left)
 	{
-		receivedMessage = simulation.sendMessage(DoorLeftStop);
+		receivedMessage = send(DoorLeftStop);
 	}
 	else // side == right
 	{
-		receivedMessage = simulation.sendMessage(DoorRightStop);
+		receivedMessage = send(DoorRightStop);
 	}
 
 	if (strcmp(receivedMessage, "ack") == 0)
 	{
+		if (known.doors[side] == doorOpening || known.doors[side] == doorClosing)
+		{
+			known.doors[side] = doorStopped;
+			publishStatus();
+		}
 		return success; // Successfully stopped
 	}
 	else
@@ -213,13 +433,18 @@ bool CommunicationHandler::getValveOpened(DoorSide side, int row)
 		}
 	}
 
-	receivedMessage = simulation.sendMessage(messageToSend);
+	receivedMessage = send(messageToSend);
 
 	if (strcmp(receivedMessage, "open") == 0)
 	{
 		opened = true;
 	}
 
+	if (row >= 1 && row <= 3 && (opened || strcmp(receivedMessage, "closed") == 0))
+	{
+		known.valvesOpen[side][row - 1] = opened;
+		publishStatus();
+	}
 	return opened;
 }
 
@@ -229,19 +454,21 @@ bool CommunicationHandler::valveOpen(DoorSide side, int row)
 	
 	if (row >= 1 && row <= 3)
 	{
+		commanded->valves[side][row - 1] = commandedOn;
+
 		switch(side)
 		{
 			case left:
 				switch(row)
 				{
 					case 1:
-						receivedMessage = simulation.sendMessage(DoorLeftOpenBottomValve);
+						receivedMessage = send(DoorLeftOpenBottomValve);
 						break;
 					case 2:
-						receivedMessage = simulation.sendMessage(DoorLeftOpenMiddleValve);
+						receivedMessage = send(DoorLeftOpenMiddleValve);
 						break;
 					case 3:
-						receivedMessage = simulation.sendMessage(DoorLeftOpenTopValve);
+						receivedMessage = send(DoorLeftOpenTopValve);
 						break;
 				}
 				break;
@@ -249,13 +476,13 @@ bool CommunicationHandler::valveOpen(DoorSide side, int row)
 				switch(row)
 				{
 					case 1:
-						receivedMessage = simulation.sendMessage(DoorRightOpenBottomValve);
+						receivedMessage = send(DoorRightOpenBottomValve);
 						break;
 					case 2:
-						receivedMessage = simulation.sendMessage(DoorRightOpenMiddleValve);
+						receivedMessage = send(DoorRightOpenMiddleValve);
 						break;
 					case 3:
-						receivedMessage = simulation.sendMessage(DoorRightOpenTopValve);
+						receivedMessage = send(DoorRightOpenTopValve);
 						break;
 				}
 				break;
@@ -263,6 +490,8 @@ bool CommunicationHandler::valveOpen(DoorSide side, int row)
 
 		if (strcmp(receivedMessage, "ack") == 0)
 		{
+			known.valvesOpen[side][row - 1] = true;
+			publishStatus();
 			return true; // Valve opened.
 		}
 	}
@@ -277,19 +506,21 @@ bool CommunicationHandler::valveClose(DoorSide side, int row)
 	
 	if (row >= 1 && row <= 3)
 	{
+		commanded->valves[side][row - 1] = commandedOff;
+
 		switch(side)
 		{
 			case left:
 				switch(row)
 				{
 					case 1:
-						receivedMessage = simulation.sendMessage(DoorLeftCloseBottomValve);
+						receivedMessage = send(DoorLeftCloseBottomValve);
 						break;
 					case 2:
-						receivedMessage = simulation.sendMessage(DoorLeftCloseMiddleValve);
+						receivedMessage = send(DoorLeftCloseMiddleValve);
 						break;
 					case 3:
-						receivedMessage = simulation.sendMessage(DoorLeftCloseTopValve);
+						receivedMessage = send(DoorLeftCloseTopValve);
 						break;
 				}
 				break;
@@ -297,13 +528,13 @@ bool CommunicationHandler::valveClose(DoorSide side, int row)
 				switch(row)
 				{
 					case 1:
-						receivedMessage = simulation.sendMessage(DoorRightCloseBottomValve);
+						receivedMessage = send(DoorRightCloseBottomValve);
 						break;
 					case 2:
-						receivedMessage = simulation.sendMessage(DoorRightCloseMiddleValve);
+						receivedMessage = send(DoorRightCloseMiddleValve);
 						break;
 					case 3:
-						receivedMessage = simulation.sendMessage(DoorRightCloseTopValve);
+						receivedMessage = send(DoorRightCloseTopValve);
 						break;
 				}
 				break;
@@ -311,6 +542,8 @@ bool CommunicationHandler::valveClose(DoorSide side, int row)
 
 		if (strcmp(receivedMessage, "ack") == 0)
 		{
+			known.valvesOpen[side][row - 1] = false;
+			publishStatus();
 			return true; // Valve closed.
 		}
 	}
@@ -318,6 +551,74 @@ bool CommunicationHandler::valveClose(DoorSide side, int row)
 	return false;
 }
 
+bool CommunicationHandler::valvesClose(DoorSide side, int rows)
+{
+	static const char* const closes[2][3] = {
+		{ DoorLeftCloseBottomValve, DoorLeftCloseMiddleValve, DoorLeftCloseTopValve },
+		{ DoorRightCloseBottomValve, DoorRightCloseMiddleValve, DoorRightCloseTopValve }
+	};
+
+	// Top row first, like one by one. A close that was not acknowledged is
+	// sent again rather than the others reopened.
+	MacroCommand macro;
+	int rowOf[3];
+	for (int row = 3; row >= 1; row--)
+	{
+		if (rows & (1 << (row - 1)))
+		{
+			commanded->valves[side][row - 1] = commandedOff;
+			rowOf[macro.steps()] = row;
+			macro.add(closes[side][row - 1], NULL);
+		}
+	}
+	if (macro.steps() == 0)
+	{
+		return true;
+	}
+
+	bool closed = sendMacro(macro);
+	for (int i = 0; i < macro.steps(); i++)
+	{
+		if (macro.applied(i))
+		{
+			known.valvesOpen[side][rowOf[i] - 1] = false;
+		}
+	}
+	publishStatus();
+	return closed;
+}
+
+bool CommunicationHandler::sendMacro(MacroCommand& macro)
+{
+	// As send() does for a command, the step after the macro is learned
+	// under its last command.
+	if (macro.steps() == 0)
+	{
+		return true;
+	}
+	readOptions();
+	coalescer.forget();
+	static __thread char guesses[SPECULATED_QUERIES][RCVBUFSIZE];
+	int count = speculator.commanded(macro.command(macro.steps() - 1), guesses);
+	for (int i = 0; i < count; i++)
+	{
+		macro.ask(guesses[i]);
+	}
+	unsigned int asOf = coalescer.current();
+	bool applied = macro.run(simulation);
+	for (int i = 0; i < count; i++)
+	{
+		coalescer.prefill(guesses[i], macro.answer(i), asOf);
+	}
+	for (int i = 0; i < macro.sent(); i++)
+	{
+		limiter.bypass();
+	}
+	known.commands += macro.sent();
+	known.speculated += count;
+	return applied;
+}
+
 int CommunicationHandler::redLight(int lightLocation)
 {
 	if (lightLocation >= 1 && lightLocation <= 4)
@@ -345,24 +646,9 @@ int CommunicationHandler::redLight(int lightLocation)
 				break;
 		}
 
-		receivedMessage = simulation.sendMessage(message1ToSend);
-	
-		if (strcmp(receivedMessage, "ack") == 0)
-		{
-			receivedMessage = simulation.sendMessage(message2ToSend);
-			if (strcmp(receivedMessage, "ack") == 0)
-			{
-				return success; // Success
-			}
-			else
-			{
-				return noAckReceived; // Only one of the lights was changed
-			}
-		}
-		else
-		{
-			return noAckReceived; // None of the lights were changed.
-		}
+		// Never back to green: what failed goes again, and when it fails
+		// once more the light is left dark rather than green.
+		return switchLight(lightLocation, redLightOn, message1ToSend, NULL, message2ToSend, NULL);
 	}
 	else
 	{
@@ -376,44 +662,67 @@ int CommunicationHandler::greenLight(int lightLocation)
 	{
 		const char* message1ToSend;
 		const char* message2ToSend;
+		const char* message1Undo;
+		const char* message2Undo;
 
 		switch(lightLocation)
 		{
 			case 1:
 				message1ToSend = TrafficLight1RedOff;
 				message2ToSend = TrafficLight1GreenOn;
+				message1Undo = TrafficLight1RedOn;
+				message2Undo = TrafficLight1GreenOff;
 				break;
 			case 2:
 				message1ToSend = TrafficLight2RedOff;
 				message2ToSend = TrafficLight2GreenOn;
+				message1Undo = TrafficLight2RedOn;
+				message2Undo = TrafficLight2GreenOff;
 				break;
 			case 3:
 				message1ToSend = TrafficLight3RedOff;
 				message2ToSend = TrafficLight3GreenOn;
+				message1Undo = TrafficLight3RedOn;
+				message2Undo = TrafficLight3GreenOff;
 				break;
 			case 4:
 				message1ToSend = TrafficLight4RedOff;
 				message2ToSend = TrafficLight4GreenOn;
+				message1Undo = TrafficLight4RedOn;
+				message2Undo = TrafficLight4GreenOff;
 				break;
 		}
 
-		receivedMessage = simulation.sendMessage(message1ToSend);
-	
-		if (strcmp(receivedMessage, "ack") == 0)
-		{
-			receivedMessage = simulation.sendMessage(message2ToSend);
-			if (strcmp(receivedMessage, "ack") == 0)
-			{
-				return success; // Success
-			}
-		}
+		// Both or neither: a light left dark halfway goes back to red.
+		return switchLight(lightLocation, greenLightOn, message1ToSend, message1Undo, message2ToSend, message2Undo);
 	}
 	else
 	{
 		return invalidLightLocation; // Invalid lightLocation was passed
 	}
+}
 
-	return noAckReceived; // One of the messages was not received by the simulator
+int CommunicationHandler::switchLight(int lightLocation, LightState state, const char* off, const char* offUndo,
+	const char* on, const char* onUndo)
+{
+	// What was commanded only changes once the light shows it: resume()
+	// and a reconnect go by it.
+	MacroCommand macro;
+	macro.add(off, offUndo);
+	macro.add(on, onUndo);
+	if (sendMacro(macro))
+	{
+		commanded->lights[lightLocation - 1] = state;
+		known.lights[lightLocation - 1] = state;
+		publishStatus();
+		return success;
+	}
+	if (macro.applied(0) || macro.applied(1))
+	{
+		known.lights[lightLocation - 1] = lightError; // Half switched, or not even the undo went through
+		publishStatus();
+	}
+	return noAckReceived;
 }
 
 LightState CommunicationHandler::getLightState(int lightLocation)
@@ -445,8 +754,8 @@ LightState CommunicationHandler::getLightState(int lightLocation)
 				break;	
 		}
 
-		std::string redLightReceived = simulation.sendMessage(redLightMessage);
-		std::string greenLightReceived = simulation.sendMessage(greenLightMessage);
+		std::string redLightReceived = send(redLightMessage);
+		std::string greenLightReceived = send(greenLightMessage);
 
 		if (redLightReceived == "on" && greenLightReceived == "off")
 		{
@@ -456,6 +765,12 @@ LightState CommunicationHandler::getLightState(int lightLocation)
 		{
 			lState = greenLightOn;
 		}
+
+		if (lState != lightError)
+		{
+			known.lights[lightLocation - 1] = lState;
+			publishStatus();
+		}
 	}
 
 	return lState;
@@ -464,7 +779,7 @@ LightState CommunicationHandler::getLightState(int lightLocation)
 WaterLevel CommunicationHandler::getWaterLevel()
 {
 	WaterLevel wLevel = waterError;
-	receivedMessage = simulation.sendMessage(GetWaterLevel);
+	receivedMessage = send(GetWaterLevel);
 
 	// Switch cases aren't possible for strings sadly.
 	if (strcmp(receivedMessage, "low") == 0)
@@ -488,5 +803,252 @@ WaterLevel CommunicationHandler::getWaterLevel()
 		wLevel = high;
 	}
 
+	if (wLevel != waterError)
+	{
+		known.waterLevel = wLevel;
+		publishStatus();
+	}
 	return wLevel;
-}
\ No newline at end of file
+}
+
+int CommunicationHandler::commandedValves()
+{
+	int mask = 0;
+	for (int side = 0; side < 2; side++)
+	{
+		for (int row = 0; row < 3; row++)
+		{
+			if (commanded->valves[side][row] == commandedOn)
+			{
+				mask |= 1 << (side * 3 + row);
+			}
+		}
+	}
+	return mask;
+}
+
+LightState CommunicationHandler::commandedLight(int lightLocation)
+{
+	if (lightLocation < 1 || lightLocation > 4)
+	{
+		return lightError;
+	}
+	return commanded->lights[lightLocation - 1];
+}
+
+void CommunicationHandler::addEmergencyStop(BatchTarget& target)
+{
+	// Every door and every valve, whatever was commanded: stopping what
+	// stands still costs nothing when the messages go out together.
+	static const char* const stops[EMERGENCY_STOP_MESSAGES] = {
+		DoorLeftStop, DoorRightStop,
+		DoorLeftCloseBottomValve, DoorLeftCloseMiddleValve, DoorLeftCloseTopValve,
+		DoorRightCloseBottomValve, DoorRightCloseMiddleValve, DoorRightCloseTopValve
+	};
+
+	for (int side = left; side <= right; side++)
+	{
+		commanded->doorMotion[side] = doorStopped;
+		for (int row = 0; row < 3; row++)
+		{
+			commanded->valves[side][row] = commandedOff;
+		}
+	}
+
+	target.simulation = &simulation;
+	target.messages.assign(stops, stops + EMERGENCY_STOP_MESSAGES);
+
+	// Taken as done: the acknowledgements come back with the whole fleet's.
+	for (int side = left; side <= right; side++)
+	{
+		if (known.doors[side] == doorOpening || known.doors[side] == doorClosing)
+		{
+			known.doors[side] = doorStopped;
+		}
+		for (int row = 0; row < 3; row++)
+		{
+			known.valvesOpen[side][row] = false;
+		}
+	}
+	coalescer.forget();
+	speculator.stepEnded();
+	for (unsigned int i = 0; i < target.messages.size(); i++)
+	{
+		limiter.bypass(); // The emergency button is never held up
+	}
+	known.commands += target.messages.size();
+	publishStatus();
+}
+
+void CommunicationHandler::keepCommandedIn(CommandedState* storage, bool takeOver)
+{
+	if (!takeOver)
+	{
+		*storage = *commanded;
+	}
+	commanded = storage;
+}
+
+CommandedState CommunicationHandler::getCommanded()
+{
+	return *commanded;
+}
+
+bool CommunicationHandler::agreesWith(const CommandedState& told, const SluiceSnapshot& snapshot)
+{
+	// Whether the simulator is where it would be after being told this and
+	// left alone since. A door may have got where it was sent, or not yet.
+	if (snapshot.waterLevel == waterError)
+	{
+		return false;
+	}
+
+	for (int location = 0; location < 4; location++)
+	{
+		if (told.lights[location] != lightError && snapshot.lights[location] != told.lights[location])
+		{
+			return false;
+		}
+	}
+
+	for (int side = left; side <= right; side++)
+	{
+		for (int row = 0; row < 3; row++)
+		{
+			if (told.valves[side][row] != notCommanded
+				&& snapshot.valvesOpen[side][row] != (told.valves[side][row] == commandedOn))
+			{
+				return false;
+			}
+		}
+
+		DoorState current = snapshot.doors[side];
+		switch (told.doorMotion[side])
+		{
+			case doorOpening:
+				if (current != doorOpening && current != doorOpen && current != doorStopped)
+				{
+					return false;
+				}
+				break;
+			case doorClosing:
+				if (current != doorClosing && current != doorClosed && current != doorLocked && current != doorStopped)
+				{
+					return false;
+				}
+				break;
+			case doorStopped:
+				if (current == doorOpening || current == doorClosing)
+				{
+					return false;
+				}
+				break;
+			default:
+				break;
+		}
+		if (current == motorDamage || current == doorStateError)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+SluiceSnapshot CommunicationHandler::readSnapshot()
+{
+	SluiceSnapshot snapshot;
+
+	for (int side = left; side <= right; side++)
+	{
+		snapshot.doors[side] = getDoorState((DoorSide) side);
+		for (int row = 1; row <= 3; row++)
+		{
+			snapshot.valvesOpen[side][row - 1] = getValveOpened((DoorSide) side, row);
+		}
+	}
+	for (int location = 1; location <= 4; location++)
+	{
+		snapshot.lights[location - 1] = getLightState(location);
+	}
+	snapshot.waterLevel = getWaterLevel();
+
+	return snapshot;
+}
+
+void CommunicationHandler::connectionRestored()
+{
+	// The simulator may have been restarted, in which case it forgot everything
+	// it was told. Compare what it reports now to what it was told before and
+	// repeat whatever it lost, so the operation that was interrupted can carry on.
+	coalescer.forget();
+	speculator.stepEnded();
+	lastResync = readSnapshot();
+
+	for (int location = 1; location <= 4; location++)
+	{
+		LightState wanted = commanded->lights[location - 1];
+		if (wanted != lightError && lastResync.lights[location - 1] != wanted)
+		{
+			if (wanted == redLightOn)
+			{
+				redLight(location);
+			}
+			else
+			{
+				greenLight(location);
+			}
+		}
+	}
+
+	for (int side = left; side <= right; side++)
+	{
+		DoorSide doorSide = (DoorSide) side;
+
+		for (int row = 1; row <= 3; row++)
+		{
+			ActuatorCommand wanted = commanded->valves[side][row - 1];
+			bool opened = lastResync.valvesOpen[side][row - 1];
+			if (wanted == commandedOn && !opened)
+			{
+				valveOpen(doorSide, row);
+			}
+			else if (wanted == commandedOff && opened)
+			{
+				valveClose(doorSide, row);
+			}
+		}
+
+		DoorState current = lastResync.doors[side];
+		switch (commanded->doorMotion[side])
+		{
+			case doorOpening:
+				if (current == doorLocked)
+				{
+					unlockDoor(doorSide);
+					openDoor(doorSide);
+				}
+				else if (current == doorClosed || current == doorStopped)
+				{
+					openDoor(doorSide);
+				}
+				break;
+			case doorClosing:
+				if (current == doorOpen || current == doorStopped)
+				{
+					closeDoor(doorSide);
+				}
+				else if (current == doorClosed && commanded->doorLock[side] == commandedOn)
+				{
+					lockDoor(doorSide);
+				}
+				break;
+			default:
+				// The door was never moved or was stopped on purpose, only the lock may need restoring.
+				if (commanded->doorLock[side] == commandedOn && current == doorClosed)
+				{
+					lockDoor(doorSide);
+				}
+				break;
+		}
+	}
+}
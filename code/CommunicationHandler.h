@@ -2,11 +2,36 @@
 #define COMMUNICATIONHANDLER_H_
 
 #include "SimulationCommunicator.h"
+#include "MacroCommand.h"
+#include "PollScheduler.h"
+#include "QueryCoalescer.h"
+#include "QuerySpeculator.h"
+#include "QueryLimiter.h"
+#include "StatusBoard.h"
 #include "lib/enums.h"
 
+#define EMERGENCY_STOP_MESSAGES 8	/* Put in a batch target by addEmergencyStop() */
 
+// Everything the simulator reports about one sluice, read in one go.
+struct SluiceSnapshot
+{
+	DoorState doors[2];			// Indexed by DoorSide
+	bool valvesOpen[2][3];		// Indexed by DoorSide and valve row - 1
+	LightState lights[4];		// Indexed by light location - 1
+	WaterLevel waterLevel;
+};
+
+// Everything the controller has told the simulator to do, so it can be told
+// again when the simulator restarted.
+struct CommandedState
+{
+	DoorState doorMotion[2];	// doorOpening, doorClosing, doorStopped or doorStateError when never moved
+	ActuatorCommand doorLock[2];
+	ActuatorCommand valves[2][3];
+	LightState lights[4];		// lightError when never set
+};
 
-class CommunicationHandler
+class CommunicationHandler : public ConnectionListener
 {
 public:
 	CommunicationHandler(int socket);
@@ -21,14 +46,71 @@ public:
 	bool getValveOpened(DoorSide side, int row);
 	bool valveOpen(DoorSide side, int row);
 	bool valveClose(DoorSide side, int row);
+	// Closes the valves of side with a bit set in rows (bit row - 1) at once.
+	bool valvesClose(DoorSide side, int rows);
 	int redLight(int lightLocation);
 	int greenLight(int lightLocation);
 	LightState getLightState(int lightLocation);
 	WaterLevel getWaterLevel();
+	// Valves told to open, one bit per valve: bit side * 3 + row - 1.
+	int commandedValves();
+	// What the light was last told to show, lightError if it never was.
+	LightState commandedLight(int lightLocation);
+
+	// Puts a stop for both doors and a close for every valve in target,
+	// for sending along with other sluices' in one batch.
+	void addEmergencyStop(BatchTarget& target);
+	// From now on keep track of what was commanded in storage, which holds
+	// what a previous run commanded when takeOver is set.
+	void keepCommandedIn(CommandedState* storage, bool takeOver);
+	CommandedState getCommanded();
+	static bool agreesWith(const CommandedState& told, const SluiceSnapshot& snapshot);
+
+	SluiceSnapshot readSnapshot();
+	void connectionRestored();
+
+	// The operation and emergency flag to show on the status board along
+	// with what the simulator reported. publishStatus() is for changes to
+	// them that no message follows.
+	void watchOperation(const SluiceState* current, const bool* stopped);
+	void publishStatus();
+	QueryCounters queryCounters();
+
+	void setDeadline(long long deadline);
+	long long getDeadline();
+	bool timedOut();
+
+	// Waits for the next poll until whenMs, never past the operation's
+	// deadline. false when cancelWaits() or a signal ended it sooner.
+	bool waitUntil(long long whenMs);
+	// Ends the wait in progress, from any thread or a signal handler.
+	void cancelWaits();
 	
 private:
+	CommunicationHandler(const CommunicationHandler&);
+	CommunicationHandler& operator= (const CommunicationHandler&);
+
 	SimulationCommunicator simulation;
 	char* receivedMessage;
+	CommandedState ownCommanded;
+	CommandedState* commanded;	// ownCommanded, or kept in a state file
+	SluiceSnapshot lastResync;
+	QueryLimiter limiter;
+	QueryCoalescer coalescer;
+	QuerySpeculator speculator;
+	SluiceStatus known;			// What goes on the status board
+	int boardSlot;				// -1 when not on the board
+	const SluiceState* operation;
+	const bool* emergency;
+	volatile bool publishMissed;
+	WaitChannel waits;
+	bool optionsRead;			// -q and the like, by the first message
+
+	char* send(const char message[]);
+	void readOptions();
+	bool sendMacro(MacroCommand& macro);
+	int switchLight(int lightLocation, LightState state, const char* off, const char* offUndo,
+		const char* on, const char* onUndo);
 };
 
-#endif
\ No newline at end of file
+#endif
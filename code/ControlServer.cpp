@@ -0,0 +1,517 @@
+// Copy constructor and assignment operator are disabled, the server owns its
+// sockets and the sluices' threads
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "ControlServer.h"
+#include "lib/returnValues.h"
+#include "lib/timing.h"
+
+ControlServer::ControlServer(const char Path[], FleetEmergencyStop& button)
+	: path(Path)
+	, emergencyButton(button)
+{
+	nextClient = 1;
+	listenFd = -1;
+	wakePipe[0] = -1;
+	wakePipe[1] = -1;
+	stopping = false;
+	emergencyPressed = false;
+	memset(&counters, 0, sizeof(counters));
+	acceptTotalUs = 0;
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&jobAdded, NULL);
+}
+
+ControlServer::~ControlServer()
+{
+	// An operation in progress is finished, queued ones are not started.
+	stop();
+	for (unsigned int i = 0; i < workers.size(); i++)
+	{
+		if (listenFd >= 0)
+		{
+			pthread_join(workers[i]->thread, NULL);
+		}
+		delete workers[i];
+	}
+	for (unsigned int i = 0; i < clients.size(); i++)
+	{
+		close(clients[i].fd);
+	}
+	if (listenFd >= 0)
+	{
+		close(listenFd);
+		unlink(path.c_str());
+	}
+	if (wakePipe[0] >= 0)
+	{
+		close(wakePipe[0]);
+		close(wakePipe[1]);
+	}
+	pthread_cond_destroy(&jobAdded);
+	pthread_mutex_destroy(&lock);
+}
+
+void ControlServer::addSluice(Sluice& sluice)
+{
+	Worker* worker = new Worker;
+	worker->server = this;
+	worker->sluice = &sluice;
+	worker->number = workers.size() + 1;
+	worker->busy = false;
+	worker->lastResult = success;
+	workers.push_back(worker);
+}
+
+bool ControlServer::open()
+{
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path))
+	{
+		std::cout << "Control socket path " << path << " is too long." << std::endl;
+		return false;
+	}
+	strcpy(address.sun_path, path.c_str());
+
+	if (pipe(wakePipe) != 0)
+	{
+		return false;
+	}
+	fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+
+	// A socket left by a controller that did not shut down would be in the way.
+	unlink(path.c_str());
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || bind(fd, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(fd, CONTROL_MAX_CLIENTS) != 0)
+	{
+		std::cout << "Unable to listen on " << path << ": " << strerror(errno) << std::endl;
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+		return false;
+	}
+	listenFd = fd;
+
+	for (unsigned int i = 0; i < workers.size(); i++)
+	{
+		pthread_create(&workers[i]->thread, NULL, &ControlServer::serve, workers[i]);
+	}
+	return true;
+}
+
+void ControlServer::run()
+{
+	std::vector<struct pollfd> polled;
+	std::vector<bool> gone;
+	char drain[64];
+
+	while (!stopping)
+	{
+		polled.resize(clients.size() + 2);
+		polled[0].fd = listenFd;
+		polled[1].fd = wakePipe[0];
+		for (unsigned int i = 0; i < clients.size(); i++)
+		{
+			polled[i + 2].fd = clients[i].fd;
+		}
+		for (unsigned int i = 0; i < polled.size(); i++)
+		{
+			polled[i].events = POLLIN;
+			polled[i].revents = 0;
+		}
+
+		if (poll(&polled[0], polled.size(), -1) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			std::cout << "Control socket: " << strerror(errno) << std::endl;
+			break;
+		}
+
+		if (polled[1].revents & POLLIN)
+		{
+			while (read(wakePipe[0], drain, sizeof(drain)) > 0)
+			{
+			}
+			if (emergencyPressed)
+			{
+				emergencyPressed = false;
+				pressButton(NULL, 0);
+			}
+		}
+
+		gone.assign(clients.size(), false);
+		for (unsigned int i = 0; i < clients.size(); i++)
+		{
+			if ((polled[i + 2].revents & (POLLIN | POLLHUP | POLLERR)) && !readClient(clients[i]))
+			{
+				gone[i] = true;
+			}
+		}
+		for (int i = clients.size() - 1; i >= 0; i--)
+		{
+			if (gone[i])
+			{
+				close(clients[i].fd);
+				clients.erase(clients.begin() + i);
+			}
+		}
+
+		sendReplies();
+
+		if (polled[0].revents & POLLIN)
+		{
+			acceptClient();
+		}
+	}
+}
+
+void ControlServer::stop()
+{
+	pthread_mutex_lock(&lock);
+	stopping = true;
+	pthread_cond_broadcast(&jobAdded);
+	pthread_mutex_unlock(&lock);
+	wake();
+}
+
+void ControlServer::pressEmergency()
+{
+	emergencyPressed = true;
+	wake();
+}
+
+ControlReport ControlServer::report()
+{
+	pthread_mutex_lock(&lock);
+	ControlReport copy = counters;
+	copy.acceptAverageUs = (counters.accepted > 0) ? acceptTotalUs / counters.accepted : 0;
+	pthread_mutex_unlock(&lock);
+	return copy;
+}
+
+void* ControlServer::serve(void* worker)
+{
+	Worker* self = (Worker*) worker;
+	ControlServer* server = self->server;
+
+	pthread_mutex_lock(&server->lock);
+	while (true)
+	{
+		while (self->jobs.empty() && !server->stopping)
+		{
+			pthread_cond_wait(&server->jobAdded, &server->lock);
+		}
+		if (server->stopping)
+		{
+			break;
+		}
+
+		Job job = self->jobs.front();
+		self->jobs.pop_front();
+		self->busy = true;
+		pthread_mutex_unlock(&server->lock);
+
+		int rtnval = success;
+		switch (job.operation)
+		{
+			case 'e':
+				rtnval = self->sluice->allowEntry();
+				break;
+			case 's':
+				rtnval = self->sluice->start();
+				break;
+			case 'x':
+				rtnval = self->sluice->allowExit();
+				break;
+			case 't':
+				rtnval = self->sluice->turnaround(job.passageMs);
+				break;
+			case 'r':
+				rtnval = self->sluice->passInterrupt(); // Carries on with what the button stopped
+				if (rtnval != success)
+				{
+					std::cout << "Sluice " << self->number << " could not carry on after the emergency button: "
+							  << rtnval << "." << std::endl;
+				}
+				break;
+		}
+
+		char text[48];
+		if (job.operation == 'r')
+		{
+			snprintf(text, sizeof(text), "=%lld resumed %d %d", job.request, self->number, rtnval);
+		}
+		else
+		{
+			snprintf(text, sizeof(text), "=%lld %d", job.request, rtnval);
+		}
+		pthread_mutex_lock(&server->lock);
+		self->busy = false;
+		Reply reply;
+		reply.client = job.client; // 0 for Ctrl-C, which nobody is connected as
+		reply.text = text;
+		self->lastResult = rtnval;
+		server->finished.push_back(reply);
+		server->wake();
+	}
+	pthread_mutex_unlock(&server->lock);
+	return NULL;
+}
+
+void ControlServer::wake()
+{
+	// Full means the server has been woken already.
+	char byte = 0;
+	if (write(wakePipe[1], &byte, 1) < 0 && errno != EAGAIN)
+	{
+		std::cout << "Control socket: unable to wake the server." << std::endl;
+	}
+}
+
+void ControlServer::acceptClient()
+{
+	int fd = accept(listenFd, NULL, NULL);
+	if (fd < 0)
+	{
+		return;
+	}
+	if (clients.size() >= CONTROL_MAX_CLIENTS)
+	{
+		close(fd);
+		return;
+	}
+
+	Client client;
+	client.fd = fd;
+	client.id = nextClient++;
+	client.requests = 0;
+	clients.push_back(client);
+}
+
+bool ControlServer::readClient(Client& client)
+{
+	char received[512];
+	int size = recv(client.fd, received, sizeof(received), 0);
+	if (size <= 0)
+	{
+		return false; // Gone, or a reply could not be sent to it
+	}
+	long long readAtUs = monotonicUs();
+
+	client.input.append(received, size);
+	size_t start = 0;
+	size_t end;
+	while ((end = client.input.find('\n', start)) != std::string::npos)
+	{
+		handleLine(client, client.input.substr(start, end - start).c_str(), readAtUs);
+		start = end + 1;
+	}
+	client.input.erase(0, start);
+
+	// Not a request of ours, whatever it is.
+	return client.input.size() < CONTROL_LINE_SIZE;
+}
+
+void ControlServer::handleLine(Client& client, const char line[], long long readAtUs)
+{
+	char request[CONTROL_LINE_SIZE];
+	int length = 0;
+	for (int i = 0; line[i] != '\0' && length < CONTROL_LINE_SIZE - 1; i++)
+	{
+		if (line[i] != ' ' && line[i] != '\t' && line[i] != '\r')
+		{
+			request[length++] = line[i];
+		}
+	}
+	request[length] = '\0';
+	if (length == 0)
+	{
+		return;
+	}
+
+	long long n = ++client.requests;
+	char reply[48];
+	if (strcmp(request, "!") == 0)
+	{
+		pressButton(&client, n);
+		return;
+	}
+	if (strcmp(request, "?") == 0)
+	{
+		snprintf(reply, sizeof(reply), "=%lld ", n);
+		send(client, reply + status());
+		return;
+	}
+
+	char* rest;
+	long index = strtol(request, &rest, 10);
+	Job job;
+	job.client = client.id;
+	job.request = n;
+	job.operation = *rest;
+	job.passageMs = 0;
+	const char* refusal = NULL;
+	if (rest == request || index < 1 || index > (long) workers.size())
+	{
+		refusal = "no such sluice";
+	}
+	else if (job.operation == 't')
+	{
+		job.passageMs = strtoll(rest + 1, &rest, 10);
+		refusal = (*rest != '\0' || job.passageMs < 0) ? "bad request" : NULL;
+	}
+	else if (strchr("esx", job.operation) == NULL || job.operation == '\0' || rest[1] != '\0')
+	{
+		refusal = "bad request";
+	}
+
+	pthread_mutex_lock(&lock);
+	long long acceptUs = 0;
+	if (refusal == NULL)
+	{
+		workers[index - 1]->jobs.push_back(job);
+		pthread_cond_broadcast(&jobAdded);
+		acceptUs = monotonicUs() - readAtUs;
+		counters.accepted++;
+		acceptTotalUs += acceptUs;
+		if (acceptUs > counters.acceptMaxUs)
+		{
+			counters.acceptMaxUs = acceptUs;
+		}
+	}
+	else
+	{
+		counters.refused++;
+	}
+	pthread_mutex_unlock(&lock);
+
+	if (refusal == NULL)
+	{
+		snprintf(reply, sizeof(reply), "+%lld %lld", n, acceptUs);
+	}
+	else
+	{
+		snprintf(reply, sizeof(reply), "-%lld %s", n, refusal);
+	}
+	send(client, reply);
+}
+
+void ControlServer::pressButton(Client* client, long long request)
+{
+	char text[64];
+	if (!emergencyButton.stopped())
+	{
+		// A release the sluices have not got round to is taken back, they
+		// stay stopped.
+		pthread_mutex_lock(&lock);
+		for (unsigned int i = 0; i < workers.size(); i++)
+		{
+			std::deque<Job>& jobs = workers[i]->jobs;
+			while (!jobs.empty() && jobs.front().operation == 'r')
+			{
+				jobs.pop_front();
+			}
+		}
+		pthread_mutex_unlock(&lock);
+
+		FleetStopReport report = emergencyButton.stop();
+		std::cout << "Emergency button pressed, " << report.sluices << " sluices stopped. "
+				  << report.acknowledged << " of " << report.messages << " stops acknowledged within "
+				  << report.lastAckUs << " us." << std::endl;
+		snprintf(text, sizeof(text), "stopped %d %d/%d %lld", report.sluices, report.acknowledged,
+			report.messages, report.lastAckUs);
+	}
+	else
+	{
+		// Every sluice carries on from its own thread, before anything queued.
+		emergencyButton.releaseButton();
+		Job job;
+		job.client = (client != NULL) ? client->id : 0;
+		job.request = request;
+		job.operation = 'r';
+		job.passageMs = 0;
+		pthread_mutex_lock(&lock);
+		for (unsigned int i = 0; i < workers.size(); i++)
+		{
+			workers[i]->jobs.push_front(job);
+		}
+		pthread_cond_broadcast(&jobAdded);
+		pthread_mutex_unlock(&lock);
+		std::cout << "Emergency button released, the sluices carry on." << std::endl;
+		snprintf(text, sizeof(text), "released");
+	}
+
+	if (client != NULL)
+	{
+		char reply[96];
+		snprintf(reply, sizeof(reply), "=%lld %s", request, text);
+		send(*client, reply);
+	}
+}
+
+std::string ControlServer::status()
+{
+	char part[64];
+	pthread_mutex_lock(&lock);
+	snprintf(part, sizeof(part), "e%d a%lld l%lld/%lld", emergencyButton.stopped() ? 1 : 0, counters.accepted,
+		(counters.accepted > 0) ? acceptTotalUs / counters.accepted : 0, counters.acceptMaxUs);
+	std::string text = part;
+	for (unsigned int i = 0; i < workers.size(); i++)
+	{
+		snprintf(part, sizeof(part), " %d:%s:%d:%d", i + 1, workers[i]->busy ? "busy" : "idle",
+			(int) workers[i]->jobs.size(), workers[i]->lastResult);
+		text += part;
+	}
+	pthread_mutex_unlock(&lock);
+	return text;
+}
+
+void ControlServer::sendReplies()
+{
+	std::vector<Reply> replies;
+	pthread_mutex_lock(&lock);
+	replies.swap(finished);
+	pthread_mutex_unlock(&lock);
+
+	for (unsigned int r = 0; r < replies.size(); r++)
+	{
+		for (unsigned int i = 0; i < clients.size(); i++)
+		{
+			if (clients[i].id == replies[r].client)
+			{
+				send(clients[i], replies[r].text);
+				break;
+			}
+		}
+	}
+}
+
+bool ControlServer::send(Client& client, const std::string& text)
+{
+	// A client that does not read its replies is not waited for, it is
+	// disconnected: the next poll finds the socket shut.
+	std::string line = text + "\n";
+	if (::send(client.fd, line.data(), line.size(), MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t) line.size())
+	{
+		shutdown(client.fd, SHUT_RDWR);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,130 @@
+#ifndef CONTROLSERVER_H_
+#define CONTROLSERVER_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+#include "FleetEmergencyStop.h"
+#include "Sluice.h"
+
+#define CONTROL_MAX_CLIENTS 32		/* Connections beyond this are closed at once */
+#define CONTROL_LINE_SIZE 64		/* Longest request line */
+
+struct ControlReport
+{
+	long long accepted;			// Requests queued for a sluice
+	long long refused;
+	long long acceptAverageUs;	// From reading a request off the socket to it being queued
+	long long acceptMaxUs;
+};
+
+// Runs the sluices without the menu: any number of clients (automation, a
+// script, socat) connect to a Unix socket and send one request per line.
+// Every sluice works through its requests on a thread of its own, so a
+// request is accepted as soon as it is read, and its result follows when
+// the operation is done.
+//
+// Requests, sluices count from 1:
+//   <sluice>e             allow entry
+//   <sluice>s             start: move the vessels up or down
+//   <sluice>x             allow exit
+//   <sluice>t<ms>         turnaround, ms for the outgoing vessels to leave
+//   !                     the emergency button, for every sluice
+//   ?                     status
+// Replies, <n> is the request's number on its connection, from 1:
+//   +<n> <us>             accepted, us it took to queue it
+//   -<n> <reason>         refused
+//   =<n> <result>         done: the operation's return value (returnValues.h),
+//                         "stopped <sluices> <acknowledged>/<messages> <us>",
+//                         "released", or for ? "e<emergency> a<accepted>
+//                         l<average us>/<max us>" and per sluice
+//                         "<sluice>:<busy|idle>:<queued>:<last result>"
+//   =<n> resumed <sluice> <result>
+//                         after "released", for every sluice once it carried
+//                         on: what the operation the button stopped came to
+class ControlServer
+{
+public:
+	ControlServer(const char Path[], FleetEmergencyStop& button);
+	~ControlServer();
+
+	// Sluices are added before open().
+	void addSluice(Sluice& sluice);
+	// Listens on the socket and starts the sluices' threads. false when
+	// the socket can't be made.
+	bool open();
+	// Serves clients until stop().
+	void run();
+	// Both can be called from any thread.
+	void stop();
+	void pressEmergency();
+
+	ControlReport report();
+
+private:
+	ControlServer(const ControlServer&);
+	ControlServer& operator= (const ControlServer&);
+
+	struct Job
+	{
+		long long client;		// Client::id of who asked, the reply goes there
+		long long request;
+		char operation;			// As in the request, 'r' to carry on after the emergency button
+		long long passageMs;
+	};
+
+	struct Worker
+	{
+		ControlServer* server;
+		Sluice* sluice;
+		int number;				// From 1, as in the requests
+		pthread_t thread;
+		std::deque<Job> jobs;	// Guarded by the server's lock, like busy and lastResult
+		bool busy;
+		int lastResult;
+	};
+
+	struct Client
+	{
+		int fd;
+		long long id;
+		long long requests;
+		std::string input;		// Received, not yet a whole line
+	};
+
+	struct Reply
+	{
+		long long client;
+		std::string text;
+	};
+
+	std::string path;
+	FleetEmergencyStop& emergencyButton;
+	std::vector<Worker*> workers;
+	std::vector<Client> clients;
+	long long nextClient;
+	int listenFd;
+	int wakePipe[2];		// Read end polled along with the clients
+	volatile bool stopping;
+	volatile bool emergencyPressed;
+
+	pthread_mutex_t lock;	// Jobs, finished, the counters
+	pthread_cond_t jobAdded;
+	std::vector<Reply> finished;
+	ControlReport counters;
+	long long acceptTotalUs;
+
+	static void* serve(void* worker);
+	void wake();
+	void acceptClient();
+	bool readClient(Client& client);
+	void handleLine(Client& client, const char line[], long long readAtUs);
+	void pressButton(Client* client, long long request);
+	std::string status();
+	void sendReplies();
+	bool send(Client& client, const std::string& text);
+};
+
+#endif
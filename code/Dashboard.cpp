@@ -0,0 +1,168 @@
+// Destructor, copy constructor and assignment operator overloading is not
+// needed as this class does not contain allocated memory
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "Dashboard.h"
+#include "lib/enums.h"
+#include "lib/timing.h"
+
+static const char* doorName(DoorState state)
+{
+	switch (state)
+	{
+		case doorLocked:	return "locked";
+		case doorClosed:	return "closed";
+		case doorOpen:		return "open";
+		case doorClosing:	return "closing";
+		case doorOpening:	return "opening";
+		case doorStopped:	return "stopped";
+		case motorDamage:	return "DAMAGED";
+		default:			return "?";
+	}
+}
+
+static const char* lockName(ActuatorCommand lock)
+{
+	switch (lock)
+	{
+		case commandedOn:	return "lock on";
+		case commandedOff:	return "lock off";
+		default:			return "";
+	}
+}
+
+static const char* lightName(LightState state)
+{
+	switch (state)
+	{
+		case redLightOn:	return "red";
+		case greenLightOn:	return "green";
+		default:			return "?";
+	}
+}
+
+static const char* waterName(WaterLevel level)
+{
+	switch (level)
+	{
+		case low:			return "low";
+		case belowValve2:	return "below valve 2";
+		case aboveValve2:	return "above valve 2";
+		case aboveValve3:	return "above valve 3";
+		case high:			return "high";
+		default:			return "?";
+	}
+}
+
+static const char* operationName(SluiceState operation)
+{
+	switch (operation)
+	{
+		case allowingEntry:	return "allowing entry";
+		case allowingExit:	return "allowing exit";
+		case sluicingUp:	return "sluicing up";
+		case sluicingDown:	return "sluicing down";
+		default:			return "idle";
+	}
+}
+
+Dashboard::Dashboard(const char boardName[])
+	: board(boardName, false)
+{
+	memset(rates, 0, sizeof(rates));
+	shown = 0;
+	frame.reserve(4096);
+}
+
+bool Dashboard::open()
+{
+	return board.isOpen() || board.open();
+}
+
+int Dashboard::sluiceCount()
+{
+	return shown;
+}
+
+void Dashboard::append(const char format[], ...)
+{
+	char line[160];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+	frame += line;
+}
+
+void Dashboard::updateRate(MessageRate& rate, const SluiceStatus& status, long long now)
+{
+	if (rate.port != status.port || status.commands < rate.commands)
+	{
+		// Another sluice, or the controller started over: no rate yet.
+		memset(&rate, 0, sizeof(rate));
+		rate.port = status.port;
+		rate.sampledAtMs = now;
+		rate.commands = status.commands;
+		rate.queries = status.queries;
+		return;
+	}
+
+	long long elapsed = now - rate.sampledAtMs;
+	if (elapsed >= RATE_WINDOW_MS)
+	{
+		rate.commandsPerS = (status.commands - rate.commands) * 1000.0 / elapsed;
+		rate.queriesPerS = (status.queries - rate.queries) * 1000.0 / elapsed;
+		rate.sampledAtMs = now;
+		rate.commands = status.commands;
+		rate.queries = status.queries;
+	}
+}
+
+const std::string& Dashboard::render()
+{
+	// Home the cursor and clear the screen, then draw the whole frame, so
+	// the terminal gets it in one write.
+	frame.assign("\033[H\033[J");
+	shown = 0;
+	long long now = monotonicMs();
+
+	SluiceStatus status;
+	for (int slot = 0; slot < STATUS_BOARD_SLOTS; slot++)
+	{
+		if (!board.read(slot, status))
+		{
+			rates[slot].port = 0;
+			continue;
+		}
+		shown++;
+		updateRate(rates[slot], status, now);
+
+		append("Sluice %d  %s for %.1f s%s\n", status.port, operationName(status.operation),
+			(now - status.operationSinceMs) / 1000.0, status.emergency ? "  ** EMERGENCY STOP **" : "");
+		append("  doors   left %-8s %-9s right %-8s %s\n", doorName(status.doors[left]), lockName(status.locks[left]),
+			doorName(status.doors[right]), lockName(status.locks[right]));
+		append("  valves  left %c%c%c  right %c%c%c    water %s\n",
+			status.valvesOpen[left][0] ? '1' : '-', status.valvesOpen[left][1] ? '2' : '-', status.valvesOpen[left][2] ? '3' : '-',
+			status.valvesOpen[right][0] ? '1' : '-', status.valvesOpen[right][1] ? '2' : '-', status.valvesOpen[right][2] ? '3' : '-',
+			waterName(status.waterLevel));
+		append("  lights  1 %-5s 2 %-5s 3 %-5s 4 %s\n", lightName(status.lights[0]), lightName(status.lights[1]),
+			lightName(status.lights[2]), lightName(status.lights[3]));
+		append("  last    entry %.1f s  exit %.1f s  up %.1f s  down %.1f s\n", status.phaseMs[allowingEntry] / 1000.0,
+			status.phaseMs[allowingExit] / 1000.0, status.phaseMs[sluicingUp] / 1000.0, status.phaseMs[sluicingDown] / 1000.0);
+		append("  rate    %.1f commands/s  %.1f queries/s  (%lld and %lld in all, updated %.1f s ago)\n",
+			rates[slot].commandsPerS, rates[slot].queriesPerS, status.commands, status.queries,
+			(now - status.updatedAtMs) / 1000.0);
+		append("  limit   %lld queries throttled, %.1f s waited\n", status.throttled, status.throttledMs / 1000.0);
+		append("  reuse   %lld answered from another's reply, %lld of %lld sent along with commands used\n\n",
+			status.coalesced, status.prefetched, status.speculated);
+	}
+
+	if (shown == 0)
+	{
+		append("No sluices on the status board, is the controller running?\n");
+	}
+	return frame;
+}
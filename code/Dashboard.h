@@ -0,0 +1,47 @@
+#ifndef DASHBOARD_H_
+#define DASHBOARD_H_
+
+#include <string>
+
+#include "StatusBoard.h"
+
+#define RATE_WINDOW_MS 1000		/* Command and query rates are averaged over this long */
+
+// A terminal view of every sluice on a status board. It only reads the
+// board, so watching the fleet adds nothing to what the simulators are
+// asked, however often it is redrawn.
+class Dashboard
+{
+public:
+	Dashboard(const char boardName[]);
+
+	// false until a controller has created the board.
+	bool open();
+	// One frame: per sluice its doors, locks, valves, lights, water level,
+	// the running operation, how long each operation took last time, and
+	// messages per second. Starts with the escape codes to redraw in place.
+	const std::string& render();
+	// Sluices on the board at the last render().
+	int sluiceCount();
+
+private:
+	struct MessageRate
+	{
+		int port;				// The sluice these are for, a slot can change hands
+		long long sampledAtMs;
+		long long commands;
+		long long queries;
+		double commandsPerS;
+		double queriesPerS;
+	};
+
+	StatusBoard board;
+	MessageRate rates[STATUS_BOARD_SLOTS];
+	std::string frame;
+	int shown;
+
+	void updateRate(MessageRate& rate, const SluiceStatus& status, long long now);
+	void append(const char format[], ...);
+};
+
+#endif
@@ -8,8 +8,10 @@
 
 #include "lib/enums.h"
 #include "lib/returnValues.h"
+#include "lib/timing.h"
 
-Door::Door(CommunicationHandler& existingHandler, DoorType Type, DoorSide Side)
+template <class LockPolicy, class MotorPolicy>
+Door<LockPolicy, MotorPolicy>::Door(CommunicationHandler& existingHandler, DoorSide Side)
 	: cHandler(existingHandler)
 	, lightInside(existingHandler, (Side==left) ? 2 : 3)
 	, lightOutside(existingHandler, (Side==left) ? 1 : 4)
@@ -20,39 +22,80 @@ Door::Door(CommunicationHandler& existingHandler, DoorType Type, DoorSide Side)
 	interruptCaught = false;
 	messageReceived = false;
 	side = Side;
-	type = Type;
+	travelMs = 0;
+	usualTravelMs = 0;
+	motion = doorStateError;
+}
+
+template <class LockPolicy, class MotorPolicy>
+Door<LockPolicy, MotorPolicy>::~Door()
+{
 
-	resetSavedState(); // The initial state is the same as the state after resetting.
 }
 
-Door::~Door()
+template <class LockPolicy, class MotorPolicy>
+void Door<LockPolicy, MotorPolicy>::setInterrupted(bool interrupted)
 {
+	interruptCaught = interrupted;
+}
 
+template <class LockPolicy, class MotorPolicy>
+DoorState Door<LockPolicy, MotorPolicy>::getMotion()
+{
+	return motion;
 }
 
-void Door::interruptReaction()
+template <class LockPolicy, class MotorPolicy>
+int Door<LockPolicy, MotorPolicy>::resumeMove(DoorState direction)
 {
-	if (!interruptCaught)
+	// The water level and the lock were fine when the move started, and
+	// nothing has touched them since.
+	if (direction == doorOpening)
 	{
-		// No interrupt was caught yet, OHSHITPANIC
-		interruptCaught = true;
-		stopDoor();
+		return moveDoor(doorOpening, doorOpen);
 	}
-	else
+
+	int rtnval = moveDoor(doorClosing, doorClosed);
+	if (rtnval != success)
+	{
+		return rtnval;
+	}
+	return LockPolicy::secureAfterClosing(cHandler, side) ? success : failure();
+}
+
+template <class LockPolicy, class MotorPolicy>
+int Door<LockPolicy, MotorPolicy>::resumePassage(bool entry, bool opened)
+{
+	TrafficLight& keepOut = entry ? lightInside : lightOutside;
+	TrafficLight& letThrough = entry ? lightOutside : lightInside;
+
+	if (keepOut.redLightCached() != success)
 	{
-		interruptCaught = false; // Set up for another emergency stop later on
-		stopDoor();
+		return failure();
 	}
+	if (!opened)
+	{
+		// Stopped before the door was sent anywhere.
+		int rtnval = openDoor();
+		if (rtnval != success)
+		{
+			return rtnval;
+		}
+	}
+	return (letThrough.greenLightCached() == success) ? success : failure();
 }
 
-int Door::allowExit()
+template <class LockPolicy, class MotorPolicy>
+int Door<LockPolicy, MotorPolicy>::allowExit()
 {
+	travelMs = 0; // Stays 0 if the door is open already
+
 	LightState outsideLightState = lightOutside.getLightState();
 	if (outsideLightState == greenLightOn)
 	{
 		if (lightOutside.redLight() != success)
 		{
-			return noAckReceived;
+			return failure();
 		}
 	}
 	else if (outsideLightState == lightError)
@@ -87,14 +130,17 @@ int Door::allowExit()
 	}
 }
 
-int Door::allowEntry()
+template <class LockPolicy, class MotorPolicy>
+int Door<LockPolicy, MotorPolicy>::allowEntry()
 {
+	travelMs = 0; // Stays 0 if the door is open already
+
 	LightState insideLightState = lightInside.getLightState();
 	if (insideLightState == greenLightOn)
 	{
 		if (lightInside.redLight() != success)
 		{
-			return noAckReceived;
+			return failure();
 		}
 	}
 	else if (insideLightState == lightError)
@@ -132,73 +178,90 @@ int Door::allowEntry()
 	}
 }
 
-int Door::openDoor()
+template <class LockPolicy, class MotorPolicy>
+int Door<LockPolicy, MotorPolicy>::turnaround(long long passageMs)
 {
-	// We can assume the left door can be opened when waterLevel = low,
-	// while the right door can only be opened when waterLevel = high.
+	// Let the vessels in the chamber out and the waiting ones in, with one
+	// opening of the door. The lights are set going by what they were last
+	// told, this sequence is the only one touching them in between.
+	travelMs = 0;
 
-	WaterLevel currentWLevel = cHandler.getWaterLevel();
-	// std::cout << "[DBG] Door side: " << side << std::endl;
-	// std::cout << "[DBG] Water level: " << currentWLevel << std::endl;
-	if (!((side == left && currentWLevel == low) || (side == right && currentWLevel == high)))
+	// Nobody comes in while the chamber empties.
+	if (lightOutside.redLightCached() != success)
 	{
-		// The water is not at the right level to open the left door,
-		// but the water also isn't at the right level to open the right door
-		return incorrectWaterLevel; // Water level invalid for opening door
+		return failure();
 	}
 
-	// std::cout << "[DBG] Looking for door type " << fastLock << std::endl;
-	// std::cout << "[DBG] Got door type " << type << std::endl;
-
-	if (type == fastLock || cHandler.getDoorState(side) == doorLocked)
+	DoorState currentState = cHandler.getDoorState(side);
+	if (currentState == doorClosed || currentState == doorLocked || currentState == doorStopped)
 	{
-		// Door is locked
-		messageReceived = cHandler.unlockDoor(side);
-
-		if (!messageReceived)
+		int rtnval = openDoor();
+		if (rtnval != success)
 		{
-			return noAckReceived; // Message was not acknowledged by the simulator
+			return rtnval;
 		}
-		// Door is not locked
+	}
+	else if (currentState == motorDamage)
+	{
+		return motorDamaged;
+	}
+	else if (currentState != doorOpen)
+	{
+		return incorrectDoorState;
 	}
 
-	messageReceived = cHandler.openDoor(side);
-	if (!messageReceived)
+	if (lightInside.greenLightCached() != success)
+	{
+		return failure();
+	}
+	// Outgoing vessels leave. A wait ended early for nothing (a cancelled
+	// lockage elsewhere) goes on, the emergency button ends it.
+	long long leftAt = monotonicMs() + passageMs;
+	while (!interruptCaught && !cHandler.timedOut() && !cHandler.waitUntil(leftAt))
 	{
-		return noAckReceived; // Message was not acknowledged by the simulator
+	}
+	if (interruptCaught)
+	{
+		return interruptReceived;
 	}
 
-	savedState.savedDoorState = doorOpening;
-	DoorState currentState = cHandler.getDoorState(side);
-	do
+	if (lightInside.redLightCached() != success)
 	{
-		if (currentState == doorStopped)
-		{
-			messageReceived = cHandler.openDoor(side);
-			
-			if (!messageReceived)
-			{
-				return noAckReceived; // Message was not acknowledged by the simulator
-			}
-		}
-		else if (currentState == motorDamage)
-		{
-			return motorDamaged;
-		}
-		currentState = cHandler.getDoorState(side);
-	} while (!interruptCaught && currentState != doorOpen);
+		return failure();
+	}
+	return (lightOutside.greenLightCached() == success) ? success : failure();
+}
 
-	if (currentState != doorOpen)
+template <class LockPolicy, class MotorPolicy>
+int Door<LockPolicy, MotorPolicy>::openDoor()
+{
+	// We can assume the left door can be opened when waterLevel = low,
+	// while the right door can only be opened when waterLevel = high.
+
+	WaterLevel currentWLevel = cHandler.getWaterLevel();
+	// std::cout << "[DBG] Door side: " << side << std::endl;
+	// std::cout << "[DBG] Water level: " << currentWLevel << std::endl;
+	if (currentWLevel == waterError && cHandler.timedOut())
 	{
-		return interruptReceived; // An interrupt was received, door was not fully opened
+		return timeoutExpired;
 	}
-	else
+	if (!((side == left && currentWLevel == low) || (side == right && currentWLevel == high)))
+	{
+		// The water is not at the right level to open the left door,
+		// but the water also isn't at the right level to open the right door
+		return incorrectWaterLevel; // Water level invalid for opening door
+	}
+
+	if (!LockPolicy::releaseForOpening(cHandler, side))
 	{
-		return success; // Door opened
+		return failure(); // Message was not acknowledged by the simulator
 	}
+
+	return moveDoor(doorOpening, doorOpen);
 }
 
-int Door::closeDoor()
+template <class LockPolicy, class MotorPolicy>
+int Door<LockPolicy, MotorPolicy>::closeDoor()
 {
 	// Check if any lights are green, they need to be turned red before closing the door.
 	LightState currentLightState = lightInside.getLightState();
@@ -237,156 +300,112 @@ int Door::closeDoor()
 		bottomValves.closeValveRow();
 	}
 
-	messageReceived = cHandler.closeDoor(side);
-	if (!messageReceived)
+	int rtnval = moveDoor(doorClosing, doorClosed);
+	if (rtnval != success)
 	{
-		return noAckReceived; // Message was not acknowledged by the simulator
+		return rtnval;
 	}
 
-	savedState.savedDoorState = doorClosing;
-	DoorState currentState = cHandler.getDoorState(side);
-	do
-	{
-		if (currentState == doorStopped)
-		{
-			messageReceived = cHandler.closeDoor(side);
-			
-			if (!messageReceived)
-			{
-				return noAckReceived; // Message was not acknowledged by the simulator
-			}
-		}
-		currentState = cHandler.getDoorState(side);
-	} while (!interruptCaught && currentState != doorClosed);
-
-	if (currentState != doorClosed)
+	if (!LockPolicy::secureAfterClosing(cHandler, side))
 	{
-		return interruptReceived; // An interrupt was received
+		return failure(); // Message was not acknowledged by the simulator
 	}
-	else
-	{
-		if (type == fastLock)
-		{
-			// Door should be locked
-			messageReceived = cHandler.lockDoor(side);
 
-			if (!messageReceived)
-			{
-				return noAckReceived; // Message was not acknowledged by the simulator
-			}
-			// Door is locked
-		}
-		
-		return success; // Door opened
-	}
+	return success; // Door closed
 }
 
-int Door::stopDoor()
+template <class LockPolicy, class MotorPolicy>
+int Door<LockPolicy, MotorPolicy>::moveDoor(DoorState direction, DoorState destination)
 {
+	// Tell the motor to move and keep an eye on the door until it gets there.
+	travelMs = 0;
+	long long startedAt = monotonicMs();
+	motion = direction; // Set first, an emergency stop can come in any time now
+	messageReceived = motor.move(cHandler, side, direction);
+	if (!messageReceived)
+	{
+		motion = doorStateError;
+		return failure(); // Message was not acknowledged by the simulator
+	}
 	if (interruptCaught)
 	{
-		DoorState currentState = cHandler.getDoorState(side);
-		if (currentState == doorLocked || currentState == doorClosed)
-		{
-			// The door is closed, but valves may be open.
-			savedState.savedDoorState = currentState;
-			stopValves();
-		}
-		else if (currentState == doorOpening || currentState == doorClosing || currentState == doorStopped)
-		{
-			// The door is in the process of either opening or closing.
-			// Don't save the current state, if it's stopped there is no way to know whether it was opening or closing.
-			// Whether it was opening or closing was set when openDoor() or closeDoor() was called.
-			cHandler.stopDoor(side);
-		}
-		else
-		{
-			// The door wasn't moving, but valves may have been open.
-			// Just like stopDoor, stopValves doubles as both stop and restore function.
-			stopValves();
-		}
+		// The emergency stop came in while the command was on its way.
+		cHandler.stopDoor(side);
+		return interruptReceived;
 	}
-	else
+
+	ProgressWatchdog watchdog;
+	watchdog.progress(usualTravelMs); // A door only reports getting there
+	DoorState currentState = motor.await(cHandler, side);
+	do
 	{
-		// Door was already stopped, restore status.
-		if (savedState.savedDoorState == doorLocked || savedState.savedDoorState == doorClosed)
+		if (currentState == doorStopped)
 		{
-			// The door was closed, but valves may have been open.
-			// Just like stopDoor, stopValves doubles as both stop and restore function.
-			stopValves();
+			messageReceived = motor.resume(cHandler, side, direction);
+			
+			if (!messageReceived)
+			{
+				motion = doorStateError;
+				return failure(); // Message was not acknowledged by the simulator
+			}
 		}
-		else if (savedState.savedDoorState == doorOpening)
+		else if (currentState == motorDamage)
 		{
-			// The door was in the process of opening.
-			openDoor();
+			motion = doorStateError;
+			return motorDamaged;
 		}
-		else if (savedState.savedDoorState == doorClosing)
+		else if (cHandler.timedOut())
 		{
-			// The door was in the process of closing.
-			closeDoor();
+			// Door did not finish moving before the operation's deadline. Stop
+			// it all the same rather than leave it driving.
+			long long operationDeadline = cHandler.getDeadline();
+			cHandler.setDeadline(NO_DEADLINE);
+			cHandler.stopDoor(side);
+			cHandler.setDeadline(operationDeadline);
+			motion = doorStateError;
+			return timeoutExpired;
 		}
-		else
+		else if (watchdog.stalled())
 		{
-			// These are door states where we didn't need to do anything to stop in the first place.
+			// Stuck, or the motor runs without the door moving: stop it
+			// rather than drive it until the deadline.
+			cHandler.stopDoor(side);
+			motion = doorStateError;
+			return operationStalled;
 		}
+		currentState = motor.await(cHandler, side);
+	} while (!interruptCaught && currentState != destination);
+
+	if (currentState != destination)
+	{
+		return interruptReceived; // An interrupt was received, door did not get where it had to go
 	}
-	cHandler.stopDoor(side);
-	return noAckReceived;
+
+	motion = doorStateError;
+	travelMs = monotonicMs() - startedAt;
+	usualTravelMs = (usualTravelMs == 0) ? travelMs : (3 * usualTravelMs + travelMs) / 4;
+	return success;
 }
 
-void Door::stopValves()
+template <class LockPolicy, class MotorPolicy>
+long long Door<LockPolicy, MotorPolicy>::getTravelMs()
 {
-	if (interruptCaught)
-	{
-		// Save valve states and close opened valves.
-		savedState.topValveOpen = topValves.getValveRowOpened();
-		savedState.middleValveOpen = middleValves.getValveRowOpened();
-		savedState.bottomValveOpen = bottomValves.getValveRowOpened();
-
-		// std::cout << "[DBG] topValveOpen saved: " << savedState.topValveOpen << std::endl;
-		// std::cout << "[DBG] middleValveOpen saved: " << savedState.middleValveOpen << std::endl;
-		// std::cout << "[DBG] bottomValveOpen saved: " << savedState.bottomValveOpen << std::endl;
+	return travelMs;
+}
 
-		if (savedState.topValveOpen)
-		{
-			topValves.closeValveRow();
-		}
-		if (savedState.middleValveOpen)
-		{
-			middleValves.closeValveRow();
-		}
-		if (savedState.bottomValveOpen)
-		{
-			bottomValves.closeValveRow();
-		}
-	}
-	else
+template <class LockPolicy, class MotorPolicy>
+int Door<LockPolicy, MotorPolicy>::failure()
+{
+	// A message that wasn't acknowledged because the simulator didn't reply in time
+	// is reported as such, so callers can tell a hung simulator from a refusal.
+	if (cHandler.timedOut())
 	{
-		// Reopen valves that were open before the stop.
-
-		// std::cout << "[DBG] topValveOpen restoring: " << savedState.topValveOpen << std::endl;
-		// std::cout << "[DBG] middleValveOpen restoring: " << savedState.middleValveOpen << std::endl;
-		// std::cout << "[DBG] bottomValveOpen restoring: " << savedState.bottomValveOpen << std::endl;
-
-		if (savedState.topValveOpen)
-		{
-			topValves.openValveRow();
-		}
-		if (savedState.middleValveOpen)
-		{
-			middleValves.openValveRow();
-		}
-		if (savedState.bottomValveOpen)
-		{
-			bottomValves.openValveRow();
-		}
+		return timeoutExpired;
 	}
+	return noAckReceived;
 }
 
-void Door::resetSavedState()
-{
-	savedState.savedDoorState = doorStateError;
-	savedState.topValveOpen = false;
-	savedState.middleValveOpen = false;
-	savedState.bottomValveOpen = false;
-}
\ No newline at end of file
+// The door variants the sluices are built from.
+template class Door<NoLock, StandardMotor>;
+template class Door<FastLock, StandardMotor>;
+template class Door<NoLock, PulseMotor>;
@@ -3,46 +3,60 @@
 
 #include "lib/enums.h"
 #include "CommunicationHandler.h"
+#include "DoorPolicies.h"
+#include "ProgressWatchdog.h"
 #include "TrafficLight.h"
 #include "ValveRow.h"
 
-struct SavedDoor
-{
-	DoorState savedDoorState;
-	bool topValveOpen;
-	bool middleValveOpen;
-	bool bottomValveOpen;
-};
-
+// LockPolicy is NoLock or FastLock, MotorPolicy is StandardMotor or
+// PulseMotor. The combinations in use are instantiated in Door.cpp.
+template <class LockPolicy, class MotorPolicy>
 class Door
 {
 private:
 	bool messageReceived;
 	bool interruptCaught;
 	CommunicationHandler& cHandler;
-	DoorType type;
 	DoorSide side;
 	TrafficLight lightInside;
 	TrafficLight lightOutside;
-	SavedDoor savedState;
+	MotorPolicy motor;
+	long long travelMs;
+	long long usualTravelMs; // Learned from the moves that finished, for the watchdog
+	DoorState motion; // doorOpening/doorClosing while a move is unfinished
 	
-	void stopValves();
-	void resetSavedState();
+	int moveDoor(DoorState direction, DoorState destination);
+	int failure();
 
 public:
-	Door(CommunicationHandler& existingHandler, DoorType Type, DoorSide Side);
+	Door(CommunicationHandler& existingHandler, DoorSide Side);
 	~Door();
 	
-	void interruptReaction();
+	// While interrupted a moving door gives up on where it was going and
+	// leaves stopping the motor to the sluice.
+	void setInterrupted(bool interrupted);
+	// doorOpening or doorClosing when the last move did not finish,
+	// doorStateError otherwise.
+	DoorState getMotion();
+	// Finishes a move that was interrupted, the way openDoor() or
+	// closeDoor() would have.
+	int resumeMove(DoorState direction);
+	// The rest of allowEntry() or allowExit() after an emergency stop,
+	// going by what the lights were last told. opened when the door got
+	// open before the stop or in resumeMove().
+	int resumePassage(bool entry, bool opened);
 	int allowExit();
 	int allowEntry();
+	int turnaround(long long passageMs);
 	int openDoor();
 	int closeDoor();
-	int stopDoor();
+	// How long the door took to get where it was sent the last time it
+	// moved, in ms. 0 when that move did not finish.
+	long long getTravelMs();
 
 	ValveRow topValves;
 	ValveRow middleValves;
 	ValveRow bottomValves;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,140 @@
+// Destructor, copy constructor and assignment operator overloading is not
+// needed as these classes do not contain allocated memory
+
+#include "DoorPolicies.h"
+#include "lib/timing.h"
+
+static bool sendMove(CommunicationHandler& cHandler, DoorSide side, DoorState direction)
+{
+	if (direction == doorOpening)
+	{
+		return cHandler.openDoor(side);
+	}
+	return cHandler.closeDoor(side);
+}
+
+StandardMotor::StandardMotor()
+{
+	travelMs = 0;
+	movedAt = 0;
+	nextPollAt = 0;
+	seenMoving = false;
+	partial = false;
+}
+
+bool StandardMotor::move(CommunicationHandler& cHandler, DoorSide side, DoorState direction)
+{
+	movedAt = monotonicMs();
+	seenMoving = false;
+	partial = false;
+	// Wake up just before the door is expected to be there.
+	nextPollAt = movedAt + travelMs * 9 / 10;
+	return sendMove(cHandler, side, direction);
+}
+
+bool StandardMotor::resume(CommunicationHandler& cHandler, DoorSide side, DoorState direction)
+{
+	// Only happens when the door was stopped on purpose and is now being
+	// restored. Where it stopped is not known: poll from the start.
+	partial = true;
+	nextPollAt = monotonicMs() + DOOR_POLL_MS;
+	return sendMove(cHandler, side, direction);
+}
+
+DoorState StandardMotor::await(CommunicationHandler& cHandler, DoorSide side)
+{
+	// The wait is cut short by the emergency button, the caller checks for it.
+	cHandler.waitUntil(nextPollAt);
+
+	DoorState state = cHandler.getDoorState(side);
+	long long now = monotonicMs();
+	if (state == doorOpening || state == doorClosing)
+	{
+		seenMoving = true;
+		nextPollAt = now + DOOR_POLL_MS;
+	}
+	else if ((state == doorOpen || state == doorClosed || state == doorLocked) && !partial)
+	{
+		if (seenMoving)
+		{
+			// Arrived somewhere in the last poll interval.
+			long long sample = now - movedAt - DOOR_POLL_MS / 2;
+			travelMs = (travelMs == 0) ? sample : (3 * travelMs + sample) / 4;
+		}
+		else if (travelMs > 0)
+		{
+			// Already there when we first looked: it is quicker than we thought.
+			travelMs = travelMs * 3 / 4;
+		}
+		partial = true; // Timed, until the next move
+	}
+	return state;
+}
+
+long long StandardMotor::getTravelMs()
+{
+	return travelMs;
+}
+
+PulseMotor::PulseMotor()
+{
+	pulseMs = 0;
+	pulseSentAt = 0;
+	lastSeenRunningAt = 0;
+	nextPollAt = 0;
+	pulseSeenRunning = false;
+}
+
+bool PulseMotor::move(CommunicationHandler& cHandler, DoorSide side, DoorState direction)
+{
+	return sendPulse(cHandler, side, direction);
+}
+
+bool PulseMotor::resume(CommunicationHandler& cHandler, DoorSide side, DoorState direction)
+{
+	// The pulse ended somewhere between the last time the door was seen
+	// moving and now. Time it by the middle of that, waking up late must not
+	// make the next pulse look longer.
+	if (pulseSeenRunning)
+	{
+		long long sample = (lastSeenRunningAt + monotonicMs()) / 2 - pulseSentAt;
+		pulseMs = (pulseMs == 0) ? sample : (3 * pulseMs + sample) / 4;
+	}
+	else if (pulseMs > 0)
+	{
+		// Already over when we woke up: it is shorter than we thought.
+		pulseMs = pulseMs * 3 / 4;
+	}
+	return sendPulse(cHandler, side, direction);
+}
+
+DoorState PulseMotor::await(CommunicationHandler& cHandler, DoorSide side)
+{
+	// The wait is cut short by the emergency button, the caller checks for it.
+	cHandler.waitUntil(nextPollAt);
+
+	DoorState state = cHandler.getDoorState(side);
+	if (state == doorOpening || state == doorClosing)
+	{
+		// Still going, the end of the pulse is close by now: look again soon.
+		pulseSeenRunning = true;
+		lastSeenRunningAt = monotonicMs();
+		long long step = (pulseMs > 0) ? pulseMs / 10 : PULSE_POLL_MS;
+		nextPollAt = monotonicMs() + ((step > 0) ? step : 1);
+	}
+	return state;
+}
+
+long long PulseMotor::getPulseMs()
+{
+	return pulseMs;
+}
+
+bool PulseMotor::sendPulse(CommunicationHandler& cHandler, DoorSide side, DoorState direction)
+{
+	pulseSentAt = monotonicMs();
+	pulseSeenRunning = false;
+	// Wake up just before the pulse is expected to run out.
+	nextPollAt = pulseSentAt + pulseMs * 9 / 10;
+	return sendMove(cHandler, side, direction);
+}
@@ -0,0 +1,101 @@
+#ifndef DOORPOLICIES_H_
+#define DOORPOLICIES_H_
+
+#include "CommunicationHandler.h"
+#include "lib/enums.h"
+
+// Lock policies decide what has to happen around moving a door. They are
+// picked per sluice at compile time, so a door without a lock never spends
+// a message on finding out whether it is locked.
+
+// Standard doors: there is no lock to deal with.
+struct NoLock
+{
+	static bool releaseForOpening(CommunicationHandler&, DoorSide)
+	{
+		return true;
+	}
+
+	static bool secureAfterClosing(CommunicationHandler&, DoorSide)
+	{
+		return true;
+	}
+};
+
+// Doors that are always locked when closed, and have to be locked right
+// after closing or the motor breaks. Unlocking is unconditional: it is
+// harmless on an unlocked door and saves asking first.
+struct FastLock
+{
+	static bool releaseForOpening(CommunicationHandler& cHandler, DoorSide side)
+	{
+		return cHandler.unlockDoor(side);
+	}
+
+	static bool secureAfterClosing(CommunicationHandler& cHandler, DoorSide side)
+	{
+		return cHandler.lockDoor(side);
+	}
+};
+
+// Motor policies decide how a door is driven to where it has to go: move()
+// starts it, await() waits for the next state worth reacting to and
+// resume() gets a stopped door going again.
+
+// A moving door is polled this often once it is about due, or all the way
+// until its travel time has been learned.
+#define DOOR_POLL_MS 5
+
+// The motor keeps going once told to, until the door is there or is stopped.
+// The travel time is learned from the moves that went all the way, so the
+// door is first looked at again shortly before it should be there.
+class StandardMotor
+{
+public:
+	StandardMotor();
+
+	bool move(CommunicationHandler& cHandler, DoorSide side, DoorState direction);
+	bool resume(CommunicationHandler& cHandler, DoorSide side, DoorState direction);
+	DoorState await(CommunicationHandler& cHandler, DoorSide side);
+
+	// Learned travel time in ms, 0 until a move has been timed.
+	long long getTravelMs();
+
+private:
+	long long travelMs;
+	long long movedAt;		// When the running move was started
+	long long nextPollAt;
+	bool seenMoving;		// A door that was there already tells nothing
+	bool partial;			// Resumed half-way, does not time a whole move
+};
+
+// Until the first pulse has been timed, a running pulse is polled this often.
+#define PULSE_POLL_MS 5
+
+// The motor of sluice 4 stops on its own after every pulse, and has to be
+// told to continue every time it does. The pulse length is learned from the
+// pulses it gives, so the door is only looked at again around the time the
+// pulse runs out instead of being polled all the way.
+class PulseMotor
+{
+public:
+	PulseMotor();
+
+	bool move(CommunicationHandler& cHandler, DoorSide side, DoorState direction);
+	bool resume(CommunicationHandler& cHandler, DoorSide side, DoorState direction);
+	DoorState await(CommunicationHandler& cHandler, DoorSide side);
+
+	// Learned pulse length in ms, 0 until a pulse has been timed.
+	long long getPulseMs();
+
+private:
+	long long pulseMs;
+	long long pulseSentAt;	// When the running pulse was given
+	long long lastSeenRunningAt;
+	long long nextPollAt;
+	bool pulseSeenRunning;	// Only a pulse that was seen moving the door can be timed
+
+	bool sendPulse(CommunicationHandler& cHandler, DoorSide side, DoorState direction);
+};
+
+#endif
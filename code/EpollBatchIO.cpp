@@ -0,0 +1,124 @@
+// Copy constructor and assignment operator are disabled: the epoll
+// descriptor is owned by exactly one instance.
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "EpollBatchIO.h"
+#include "lib/timing.h"
+
+#define EPOLL_BATCH_EVENTS 64	/* Ready sockets harvested per epoll_wait */
+
+EpollBatchIO::EpollBatchIO()
+{
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+}
+
+EpollBatchIO::~EpollBatchIO()
+{
+	if (epollFd >= 0)
+	{
+		close(epollFd);
+	}
+}
+
+const char* EpollBatchIO::name()
+{
+	return "epoll";
+}
+
+int EpollBatchIO::exchange(std::vector<BatchExchange>& exchanges, int timeoutMs)
+{
+	long long deadline = (timeoutMs >= 0) ? deadlineAfter(timeoutMs) : NO_DEADLINE;
+	int waiting = 0;
+	int completed = 0;
+
+	for (unsigned int i = 0; i < exchanges.size(); i++)
+	{
+		BatchExchange& ex = exchanges[i];
+		ex.complete = false;
+		ex.replies.clear();
+
+		if (send(ex.fd, ex.request.data(), ex.request.size(), MSG_NOSIGNAL) != (int) ex.request.size())
+		{
+			continue; // Broken connection, reported as incomplete
+		}
+
+		struct epoll_event event;
+		event.events = EPOLLIN;
+		event.data.u32 = i;
+		if (epoll_ctl(epollFd, EPOLL_CTL_ADD, ex.fd, &event) == 0)
+		{
+			waiting++;
+		}
+	}
+
+	struct epoll_event events[EPOLL_BATCH_EVENTS];
+	char buffer[256];
+	while (waiting > 0)
+	{
+		long long remaining = deadlineRemaining(deadline);
+		if (remaining == 0)
+		{
+			break;
+		}
+
+		int ready = epoll_wait(epollFd, events, EPOLL_BATCH_EVENTS, (int) remaining);
+		if (ready < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		else if (ready <= 0)
+		{
+			break;
+		}
+
+		for (int e = 0; e < ready; e++)
+		{
+			BatchExchange& ex = exchanges[events[e].data.u32];
+			int received = recv(ex.fd, buffer, sizeof(buffer), 0);
+			bool finished = received <= 0;
+
+			if (received > 0)
+			{
+				ex.replies.append(buffer, received);
+				int replies = 0;
+				for (unsigned int c = 0; c < ex.replies.size(); c++)
+				{
+					if (ex.replies[c] == ';')
+					{
+						replies++;
+					}
+				}
+				if (replies >= ex.repliesExpected)
+				{
+					ex.complete = true;
+					completed++;
+					finished = true;
+				}
+			}
+
+			if (finished)
+			{
+				epoll_ctl(epollFd, EPOLL_CTL_DEL, ex.fd, NULL);
+				waiting--;
+			}
+		}
+	}
+
+	if (waiting > 0)
+	{
+		// Timed out, stop watching the sockets that are still silent.
+		for (unsigned int i = 0; i < exchanges.size(); i++)
+		{
+			if (!exchanges[i].complete)
+			{
+				epoll_ctl(epollFd, EPOLL_CTL_DEL, exchanges[i].fd, NULL);
+			}
+		}
+	}
+
+	return completed;
+}
@@ -0,0 +1,24 @@
+#ifndef EPOLLBATCHIO_H_
+#define EPOLLBATCHIO_H_
+
+#include "BatchIO.h"
+
+// Fallback batch backend: one send per socket, but replies from all
+// sockets are waited for together with epoll.
+class EpollBatchIO : public BatchIO
+{
+public:
+	EpollBatchIO();
+	~EpollBatchIO();
+
+	const char* name();
+	int exchange(std::vector<BatchExchange>& exchanges, int timeoutMs);
+
+private:
+	EpollBatchIO(const EpollBatchIO&);
+	EpollBatchIO& operator= (const EpollBatchIO&);
+
+	int epollFd;
+};
+
+#endif
@@ -0,0 +1,247 @@
+// Copy constructor and assignment operator are disabled, the dispatcher owns
+// the schedulers and their threads
+
+#include "FleetDispatcher.h"
+#include "lib/returnValues.h"
+#include "lib/timing.h"
+
+FleetDispatcher::FleetDispatcher()
+{
+	finishing = false;
+	started = false;
+	pthread_mutex_init(&lock, NULL);
+}
+
+FleetDispatcher::~FleetDispatcher()
+{
+	finish();
+	for (unsigned int i = 0; i < members.size(); i++)
+	{
+		delete members[i]->scheduler;
+		delete members[i];
+	}
+	pthread_mutex_destroy(&lock);
+}
+
+void FleetDispatcher::addSluice(Sluice& sluice, int capacity, long long passageMs)
+{
+	Member* member = new Member;
+	member->fleet = this;
+	member->scheduler = new LockageScheduler(sluice, capacity, passageMs);
+	member->assigned = 0;
+	member->failure = success;
+	member->stopped = false;
+	member->hasThread = false;
+	members.push_back(member);
+}
+
+void FleetDispatcher::setPredictive(bool on)
+{
+	for (unsigned int i = 0; i < members.size(); i++)
+	{
+		members[i]->scheduler->setPredictive(on);
+	}
+}
+
+void FleetDispatcher::start()
+{
+	started = true;
+	for (unsigned int i = 0; i < members.size(); i++)
+	{
+		// Know where every chamber is before the first vessel is dispatched.
+		members[i]->failure = members[i]->scheduler->begin();
+		members[i]->stopped = (members[i]->failure != success);
+		members[i]->hasThread = !members[i]->stopped;
+		if (members[i]->hasThread)
+		{
+			pthread_create(&members[i]->thread, NULL, &FleetDispatcher::serve, members[i]);
+		}
+	}
+}
+
+int FleetDispatcher::dispatch(DoorSide from)
+{
+	return assign(from, monotonicMs());
+}
+
+int FleetDispatcher::assign(DoorSide from, long long arrivesAt)
+{
+	long long now = monotonicMs();
+	std::vector<SchedulerStatus> statuses(members.size());
+
+	pthread_mutex_lock(&lock);
+
+	// Sluices that have not timed a lockage yet are expected to be as fast
+	// as the average one that has, so an idle newcomer still gets work.
+	long long lockageMs = 0;
+	long long emptyLevelChangeMs = 0;
+	int timedLockages = 0;
+	int timedChanges = 0;
+	for (unsigned int i = 0; i < members.size(); i++)
+	{
+		statuses[i] = members[i]->scheduler->status();
+		if (statuses[i].lockageMs > 0)
+		{
+			lockageMs += statuses[i].lockageMs;
+			timedLockages++;
+		}
+		if (statuses[i].emptyLevelChangeMs > 0)
+		{
+			emptyLevelChangeMs += statuses[i].emptyLevelChangeMs;
+			timedChanges++;
+		}
+	}
+	lockageMs = (timedLockages > 0) ? lockageMs / timedLockages : 1;
+	emptyLevelChangeMs = (timedChanges > 0) ? emptyLevelChangeMs / timedChanges : lockageMs;
+
+	// Equally fast sluices: the one with the fewest vessels waiting, to
+	// spread the load.
+	int best = -1;
+	long long bestMs = 0;
+	int bestQueued = 0;
+	for (unsigned int i = 0; i < members.size(); i++)
+	{
+		if (members[i]->stopped)
+		{
+			continue; // Out of service
+		}
+		long long expected = expectedCompletionMs(statuses[i], from, lockageMs, emptyLevelChangeMs, now);
+		int queued = statuses[i].queued[left] + statuses[i].queued[right];
+		if (best < 0 || expected < bestMs || (expected == bestMs && queued < bestQueued))
+		{
+			best = i;
+			bestMs = expected;
+			bestQueued = queued;
+		}
+	}
+
+	if (best >= 0)
+	{
+		members[best]->scheduler->addVessel(from, arrivesAt);
+		members[best]->assigned++;
+	}
+	pthread_mutex_unlock(&lock);
+	return best;
+}
+
+void FleetDispatcher::handBack(Member* member)
+{
+	// What waits for a sluice out of service goes to the others, as if it
+	// arrived there. Without any in service it stays, not through.
+	std::vector<Vessel> waiting = member->scheduler->takeWaiting();
+	for (unsigned int i = 0; i < waiting.size(); i++)
+	{
+		if (assign(waiting[i].from, waiting[i].arrivesAt) < 0)
+		{
+			member->scheduler->addVessel(waiting[i].from, waiting[i].arrivesAt);
+			continue;
+		}
+		pthread_mutex_lock(&lock);
+		member->assigned--;
+		pthread_mutex_unlock(&lock);
+	}
+}
+
+void FleetDispatcher::finish()
+{
+	if (!started)
+	{
+		return;
+	}
+	finishing = true;
+	for (unsigned int i = 0; i < members.size(); i++)
+	{
+		if (members[i]->hasThread)
+		{
+			pthread_join(members[i]->thread, NULL);
+		}
+	}
+	started = false;
+}
+
+int FleetDispatcher::sluiceCount()
+{
+	return members.size();
+}
+
+FleetSluiceReport FleetDispatcher::report(int index)
+{
+	FleetSluiceReport result;
+	Member* member = members[index];
+
+	result.lockages = member->scheduler->report();
+	result.utilization = (result.lockages.elapsedMs > 0)
+		? (double) result.lockages.busyMs / result.lockages.elapsedMs : 0.0;
+	result.assigned = member->assigned;
+	result.failure = member->failure;
+	return result;
+}
+
+void* FleetDispatcher::serve(void* self)
+{
+	Member* member = (Member*) self;
+	FleetDispatcher* fleet = member->fleet;
+	LockageScheduler& scheduler = *member->scheduler;
+
+	// Out of service under the lock, so no vessel is assigned after the
+	// last look at the queue.
+	int rtnval = success;
+	while (true)
+	{
+		pthread_mutex_lock(&fleet->lock);
+		member->stopped = rtnval != success || (fleet->finishing && !scheduler.hasWaiting());
+		pthread_mutex_unlock(&fleet->lock);
+		if (member->stopped)
+		{
+			break;
+		}
+
+		// The emergency button only pauses the scheduler.
+		rtnval = scheduler.serveArrived();
+		if (rtnval == noVesselWaiting)
+		{
+			sleepMs(FLEET_IDLE_POLL_MS);
+			rtnval = success;
+		}
+	}
+
+	member->failure = rtnval;
+	if (rtnval != success)
+	{
+		fleet->handBack(member);
+	}
+	return NULL;
+}
+
+long long FleetDispatcher::expectedCompletionMs(const SchedulerStatus& status, DoorSide from,
+	long long lockageMs, long long emptyLevelChangeMs, long long now)
+{
+	long long lockage = (status.lockageMs > 0) ? status.lockageMs : lockageMs;
+	long long emptyChange = (status.emptyLevelChangeMs > 0) ? status.emptyLevelChangeMs : emptyLevelChangeMs;
+	DoorSide other = (from == left) ? right : left;
+
+	// Whatever the sluice is doing now has to finish first.
+	long long expected = 0;
+	if (status.activity != waitingForCommand)
+	{
+		long long spent = now - status.activitySince;
+		expected = (spent < lockage) ? lockage - spent : 0;
+	}
+
+	// The chamber takes turns between both sides, vessels from the other
+	// side go up or down on the way back. Without them the way back is empty.
+	int batches = status.queued[from] / status.capacity + 1;
+	int othersWaiting = status.queued[other];
+	DoorSide chamber = status.at;
+	for (int batch = 0; batch < batches; batch++)
+	{
+		if (chamber != from)
+		{
+			expected += (othersWaiting > 0) ? lockage : emptyChange;
+			othersWaiting -= status.capacity;
+		}
+		expected += lockage;
+		chamber = other;
+	}
+	return expected;
+}
@@ -0,0 +1,76 @@
+#ifndef FLEETDISPATCHER_H_
+#define FLEETDISPATCHER_H_
+
+#include <vector>
+#include <pthread.h>
+
+#include "LockageScheduler.h"
+#include "Sluice.h"
+#include "lib/enums.h"
+
+#define FLEET_IDLE_POLL_MS 2	// How often an idle sluice looks for vessels
+
+struct FleetSluiceReport
+{
+	SchedulerReport lockages;
+	double utilization;		// Part of the time the sluice was busy, 0 to 1
+	int assigned;			// Vessels the dispatcher sent its way
+	int failure;			// success, or what stopped the sluice
+};
+
+// Sends every arriving vessel to the sluice that is expected to have it
+// through first, given what each sluice is doing, which side its chamber is
+// at and how many vessels already wait for it. Every sluice is served by
+// its own thread, so they all work at the same time.
+class FleetDispatcher
+{
+public:
+	FleetDispatcher();
+	~FleetDispatcher();
+
+	// Sluices are added before start(), which finds out where every chamber
+	// is and starts serving.
+	void addSluice(Sluice& sluice, int capacity, long long passageMs);
+	// Every sluice added levels its idle chamber ahead of time, see
+	// LockageScheduler::setPredictive().
+	void setPredictive(bool on);
+	void start();
+	// A vessel arrives now. Returns the index of the sluice it goes to, -1
+	// when no sluice is in service. Vessels waiting for a sluice that goes
+	// out of service are dispatched again, the emergency button only
+	// pauses the sluices.
+	int dispatch(DoorSide from);
+	// Waits until every vessel went through and stops the threads.
+	void finish();
+
+	int sluiceCount();
+	FleetSluiceReport report(int index);
+
+private:
+	FleetDispatcher(const FleetDispatcher&);
+	FleetDispatcher& operator= (const FleetDispatcher&);
+
+	struct Member
+	{
+		FleetDispatcher* fleet;
+		LockageScheduler* scheduler;
+		pthread_t thread;
+		int assigned;			// Guarded by the fleet's lock, like stopped
+		volatile int failure;	// Set by the sluice's thread when it stops
+		volatile bool stopped;
+		bool hasThread;
+	};
+
+	std::vector<Member*> members;
+	volatile bool finishing;
+	bool started;
+	pthread_mutex_t lock;	// Vessels are assigned from the sluices' threads too
+
+	static void* serve(void* member);
+	int assign(DoorSide from, long long arrivesAt);
+	void handBack(Member* member);
+	long long expectedCompletionMs(const SchedulerStatus& status, DoorSide from,
+		long long lockageMs, long long emptyLevelChangeMs, long long now);
+};
+
+#endif
@@ -0,0 +1,93 @@
+// Copy constructor and assignment operator are disabled, the emergency stop
+// owns its batch backend
+
+#include <string.h>
+
+#include "FleetEmergencyStop.h"
+#include "lib/auxiliary.h"
+#include "lib/returnValues.h"
+#include "lib/timing.h"
+
+FleetEmergencyStop::FleetEmergencyStop()
+{
+	batch = createBatchIO();
+	active = false;
+}
+
+FleetEmergencyStop::~FleetEmergencyStop()
+{
+	delete batch;
+}
+
+void FleetEmergencyStop::addSluice(Sluice& sluice)
+{
+	// Room for its stops and their replies now, not when the button is
+	// pressed.
+	sluices.push_back(&sluice);
+	targets.resize(sluices.size());
+	targets.back().simulation = NULL;
+	targets.back().messages.reserve(EMERGENCY_STOP_MESSAGES);
+	targets.back().replies.reserve(EMERGENCY_STOP_MESSAGES);
+}
+
+FleetStopReport FleetEmergencyStop::stop()
+{
+	long long pressedAt = monotonicUs();
+	FleetStopReport report;
+	report.sluices = 0;
+	report.messages = 0;
+	report.acknowledged = 0;
+
+	active = true;
+
+	// Sluices stopped already have nothing to send, and stay out of the batch.
+	for (unsigned int i = 0; i < sluices.size(); i++)
+	{
+		if (!sluices[i]->addEmergencyStop(targets[i]))
+		{
+			targets[i].messages.clear();
+		}
+	}
+
+	batch->exchangeAll(targets, (argv_timeout > 0) ? argv_timeout * 1000 : -1);
+	report.lastAckUs = monotonicUs() - pressedAt;
+
+	for (unsigned int i = 0; i < targets.size(); i++)
+	{
+		if (targets[i].messages.empty())
+		{
+			continue;
+		}
+		report.sluices++;
+		for (unsigned int m = 0; m < targets[i].replies.size(); m++)
+		{
+			report.messages++;
+			if (targets[i].replies[m] == "ack")
+			{
+				report.acknowledged++;
+			}
+		}
+	}
+	return report;
+}
+
+std::vector<int> FleetEmergencyStop::release()
+{
+	active = false;
+	std::vector<int> results;
+	for (unsigned int i = 0; i < sluices.size(); i++)
+	{
+		results.push_back(sluices[i]->passInterrupt());
+	}
+	return results;
+}
+
+void FleetEmergencyStop::releaseButton()
+{
+	active = false;
+}
+
+bool FleetEmergencyStop::stopped()
+{
+	return active;
+}
@@ -0,0 +1,51 @@
+#ifndef FLEETEMERGENCYSTOP_H_
+#define FLEETEMERGENCYSTOP_H_
+
+#include <vector>
+
+#include "BatchIO.h"
+#include "Sluice.h"
+
+struct FleetStopReport
+{
+	int sluices;			// Sluices stopped by this press, not stopped already
+	int messages;			// Stop messages sent
+	int acknowledged;		// ... that the simulators acknowledged
+	long long lastAckUs;	// From the button being pressed to the last acknowledgement
+};
+
+// The emergency button for every sluice at once. Each sluice takes its
+// checkpoint, then every door and valve of the fleet is told to stop in one
+// batch: one write per simulator and all acknowledgements collected together
+// (see BatchIO), instead of one message after another, sluice by sluice.
+class FleetEmergencyStop
+{
+public:
+	FleetEmergencyStop();
+	~FleetEmergencyStop();
+
+	void addSluice(Sluice& sluice);
+	// First press. Sluices that were stopped already stay as they are.
+	// Whatever it can be made ready beforehand is, by addSluice().
+	FleetStopReport stop();
+	// Second press: the sluices carry on where they were stopped, one
+	// after the other. What each one's operation came to, in the order
+	// they were added.
+	std::vector<int> release();
+	// Second press when each sluice carries on from a thread of its own:
+	// only the button comes back up, the caller has every sluice
+	// passInterrupt() on its thread.
+	void releaseButton();
+	bool stopped();
+
+private:
+	FleetEmergencyStop(const FleetEmergencyStop&);
+	FleetEmergencyStop& operator= (const FleetEmergencyStop&);
+
+	std::vector<Sluice*> sluices;
+	std::vector<BatchTarget> targets;	// One per sluice, made room for by addSluice()
+	BatchIO* batch;
+	bool active;
+};
+
+#endif
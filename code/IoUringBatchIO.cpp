@@ -0,0 +1,380 @@
+// Copy constructor and assignment operator are disabled: the ring and its
+// mappings are owned by exactly one instance.
+//
+// There is no liburing on the controllers, so the ring is set up with the
+// raw system calls, the way the io_uring man pages describe it.
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+
+#include "IoUringBatchIO.h"
+
+#define IOURING_MIN_ENTRIES 64
+
+// user_data layout: the exchange index times four plus what the entry is for.
+#define TAG_SEND 0
+#define TAG_RECV 1
+#define TAG_CANCEL 2
+#define TAG_TIMEOUT 3
+#define TAG_TIMEOUT_REMOVE 0xffffffffffffffffULL
+
+static int countReplies(const std::string& replies)
+{
+	int count = 0;
+	for (unsigned int i = 0; i < replies.size(); i++)
+	{
+		if (replies[i] == ';')
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+IoUringBatchIO::IoUringBatchIO()
+{
+	ringFd = -1;
+	entries = 0;
+	toSubmit = 0;
+	sqRing = MAP_FAILED;
+	cqRing = MAP_FAILED;
+	sqes = (struct io_uring_sqe*) MAP_FAILED;
+
+	if (!setup(IOURING_MIN_ENTRIES) || !supportsOperations())
+	{
+		teardown();
+	}
+}
+
+IoUringBatchIO::~IoUringBatchIO()
+{
+	teardown();
+}
+
+bool IoUringBatchIO::available()
+{
+	return ringFd >= 0;
+}
+
+const char* IoUringBatchIO::name()
+{
+	return "io_uring";
+}
+
+bool IoUringBatchIO::setup(unsigned int wanted)
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	ringFd = syscall(__NR_io_uring_setup, wanted, &params);
+	if (ringFd < 0)
+	{
+		return false;
+	}
+	entries = params.sq_entries;
+
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		// Both rings live in one mapping, which then has to fit the larger one.
+		if (cqRingSize > sqRingSize)
+		{
+			sqRingSize = cqRingSize;
+		}
+		cqRingSize = sqRingSize;
+	}
+
+	sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	if (sqRing == MAP_FAILED)
+	{
+		return false;
+	}
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		cqRing = sqRing;
+	}
+	else
+	{
+		cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+		if (cqRing == MAP_FAILED)
+		{
+			return false;
+		}
+	}
+
+	sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	sqes = (struct io_uring_sqe*) mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED)
+	{
+		return false;
+	}
+
+	char* sq = (char*) sqRing;
+	sqHead = (unsigned int*) (sq + params.sq_off.head);
+	sqTail = (unsigned int*) (sq + params.sq_off.tail);
+	sqMask = (unsigned int*) (sq + params.sq_off.ring_mask);
+	sqArray = (unsigned int*) (sq + params.sq_off.array);
+
+	char* cq = (char*) cqRing;
+	cqHead = (unsigned int*) (cq + params.cq_off.head);
+	cqTail = (unsigned int*) (cq + params.cq_off.tail);
+	cqMask = (unsigned int*) (cq + params.cq_off.ring_mask);
+	cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+
+	toSubmit = 0;
+	return true;
+}
+
+bool IoUringBatchIO::supportsOperations()
+{
+	// Operations were added over several kernel releases, make sure the ones
+	// used here are all known before relying on the ring.
+	size_t probeSize = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe* probe = (struct io_uring_probe*) calloc(1, probeSize);
+	if (probe == NULL)
+	{
+		return false;
+	}
+
+	bool supported = syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, 256) == 0;
+	unsigned char needed[] = { IORING_OP_SEND, IORING_OP_RECV, IORING_OP_TIMEOUT, IORING_OP_TIMEOUT_REMOVE, IORING_OP_ASYNC_CANCEL };
+	for (unsigned int i = 0; supported && i < sizeof(needed); i++)
+	{
+		supported = needed[i] <= probe->last_op && (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+	}
+
+	free(probe);
+	return supported;
+}
+
+void IoUringBatchIO::teardown()
+{
+	if (sqes != MAP_FAILED)
+	{
+		munmap(sqes, sqesSize);
+		sqes = (struct io_uring_sqe*) MAP_FAILED;
+	}
+	if (cqRing != MAP_FAILED && cqRing != sqRing)
+	{
+		munmap(cqRing, cqRingSize);
+	}
+	cqRing = MAP_FAILED;
+	if (sqRing != MAP_FAILED)
+	{
+		munmap(sqRing, sqRingSize);
+		sqRing = MAP_FAILED;
+	}
+	if (ringFd >= 0)
+	{
+		close(ringFd);
+		ringFd = -1;
+	}
+}
+
+struct io_uring_sqe* IoUringBatchIO::queue(unsigned char opcode, int fd, unsigned long long userData)
+{
+	unsigned int tail = *sqTail;
+	unsigned int index = tail & *sqMask;
+	struct io_uring_sqe* sqe = &sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->user_data = userData;
+
+	sqArray[index] = index;
+	// The kernel may only see the new tail after the entry is complete.
+	__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+	toSubmit++;
+
+	return sqe;
+}
+
+bool IoUringBatchIO::enter(unsigned int waitFor)
+{
+	while (true)
+	{
+		int submitted = syscall(__NR_io_uring_enter, ringFd, toSubmit, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+		if (submitted >= 0)
+		{
+			toSubmit -= submitted;
+			return true;
+		}
+		if (errno != EINTR)
+		{
+			return false;
+		}
+	}
+}
+
+int IoUringBatchIO::exchange(std::vector<BatchExchange>& exchanges, int timeoutMs)
+{
+	unsigned int count = exchanges.size();
+
+	// Every exchange needs a send and a receive at once, a cancel for each when
+	// the timeout hits, plus the timeout itself and its removal.
+	if (4 * count + 2 > entries)
+	{
+		unsigned int wanted = IOURING_MIN_ENTRIES;
+		while (wanted < 4 * count + 2)
+		{
+			wanted *= 2;
+		}
+		teardown();
+		if (!setup(wanted))
+		{
+			teardown();
+			return 0;
+		}
+	}
+
+	buffers.resize(count * IOURING_RECV_BUFSIZE);
+	std::vector<bool> recvPending(count, false);
+	std::vector<bool> sendPending(count, false);
+	unsigned int inFlight = 0;
+	unsigned int pendingExchanges = 0;
+	int completed = 0;
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		BatchExchange& ex = exchanges[i];
+		ex.complete = false;
+		ex.replies.clear();
+
+		struct io_uring_sqe* sqe = queue(IORING_OP_SEND, ex.fd, i * 4ULL + TAG_SEND);
+		sqe->addr = (unsigned long long) ex.request.data();
+		sqe->len = ex.request.size();
+		sqe->msg_flags = MSG_NOSIGNAL;
+		// Linked, so the receive is only started once the request went out.
+		sqe->flags = IOSQE_IO_LINK;
+
+		sqe = queue(IORING_OP_RECV, ex.fd, i * 4ULL + TAG_RECV);
+		sqe->addr = (unsigned long long) &buffers[i * IOURING_RECV_BUFSIZE];
+		sqe->len = IOURING_RECV_BUFSIZE;
+
+		sendPending[i] = true;
+		recvPending[i] = true;
+		inFlight += 2;
+		pendingExchanges++;
+	}
+
+	struct __kernel_timespec timeout;
+	bool timeoutArmed = false;
+	if (timeoutMs >= 0)
+	{
+		timeout.tv_sec = timeoutMs / 1000;
+		timeout.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+		struct io_uring_sqe* sqe = queue(IORING_OP_TIMEOUT, -1, TAG_TIMEOUT);
+		sqe->addr = (unsigned long long) &timeout;
+		sqe->len = 1;
+		timeoutArmed = true;
+		inFlight++;
+	}
+
+	bool timedOut = false;
+	bool cancelsQueued = false;
+	bool removeQueued = false;
+	while (inFlight > 0)
+	{
+		if (!enter(1))
+		{
+			break; // Ring unusable, everything still open is reported incomplete
+		}
+
+		unsigned int head = *cqHead;
+		unsigned int tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++)
+		{
+			struct io_uring_cqe* cqe = &cqes[head & *cqMask];
+			unsigned long long userData = cqe->user_data;
+			int result = cqe->res;
+			inFlight--;
+
+			if (userData == TAG_TIMEOUT)
+			{
+				timeoutArmed = false;
+				if (result == -ETIME)
+				{
+					timedOut = true;
+				}
+				continue;
+			}
+			if (userData == TAG_TIMEOUT_REMOVE || (userData & 3) == TAG_CANCEL)
+			{
+				continue;
+			}
+
+			unsigned int i = userData / 4;
+			BatchExchange& ex = exchanges[i];
+
+			if ((userData & 3) == TAG_SEND)
+			{
+				// A failed send makes the kernel cancel the linked receive, which
+				// then completes the exchange as incomplete.
+				sendPending[i] = false;
+				continue;
+			}
+
+			// A receive completed.
+			recvPending[i] = false;
+			if (result > 0)
+			{
+				ex.replies.append(&buffers[i * IOURING_RECV_BUFSIZE], result);
+				if (countReplies(ex.replies) >= ex.repliesExpected)
+				{
+					ex.complete = true;
+					completed++;
+				}
+				else if (!timedOut && !cancelsQueued)
+				{
+					// More replies to come on this socket.
+					struct io_uring_sqe* sqe = queue(IORING_OP_RECV, ex.fd, i * 4ULL + TAG_RECV);
+					sqe->addr = (unsigned long long) &buffers[i * IOURING_RECV_BUFSIZE];
+					sqe->len = IOURING_RECV_BUFSIZE;
+					recvPending[i] = true;
+					inFlight++;
+					continue;
+				}
+			}
+			pendingExchanges--;
+		}
+		__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+		if (timedOut && !cancelsQueued)
+		{
+			// Cancel whatever is still waiting, its buffers must not be written after we return.
+			for (unsigned int i = 0; i < count; i++)
+			{
+				if (sendPending[i])
+				{
+					struct io_uring_sqe* sqe = queue(IORING_OP_ASYNC_CANCEL, -1, i * 4ULL + TAG_CANCEL);
+					sqe->addr = i * 4ULL + TAG_SEND;
+					inFlight++;
+				}
+				if (recvPending[i])
+				{
+					struct io_uring_sqe* sqe = queue(IORING_OP_ASYNC_CANCEL, -1, i * 4ULL + TAG_CANCEL);
+					sqe->addr = i * 4ULL + TAG_RECV;
+					inFlight++;
+				}
+			}
+			cancelsQueued = true;
+		}
+		else if (pendingExchanges == 0 && timeoutArmed && !removeQueued)
+		{
+			struct io_uring_sqe* sqe = queue(IORING_OP_TIMEOUT_REMOVE, -1, TAG_TIMEOUT_REMOVE);
+			sqe->addr = TAG_TIMEOUT;
+			removeQueued = true;
+			inFlight++;
+		}
+	}
+
+	return completed;
+}
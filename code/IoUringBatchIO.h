@@ -0,0 +1,56 @@
+#ifndef IOURINGBATCHIO_H_
+#define IOURINGBATCHIO_H_
+
+#include <linux/io_uring.h>
+
+#include "BatchIO.h"
+
+#define IOURING_RECV_BUFSIZE 256	/* Reply bytes one receive can harvest per socket */
+
+// Batch backend on io_uring: the sends and receives for every socket in a
+// batch are submitted with one system call, and completions are harvested
+// from the shared ring without a system call per socket.
+class IoUringBatchIO : public BatchIO
+{
+public:
+	IoUringBatchIO();
+	~IoUringBatchIO();
+
+	bool available();
+	const char* name();
+	int exchange(std::vector<BatchExchange>& exchanges, int timeoutMs);
+
+private:
+	IoUringBatchIO(const IoUringBatchIO&);
+	IoUringBatchIO& operator= (const IoUringBatchIO&);
+
+	int ringFd;
+	unsigned int entries;
+	unsigned int toSubmit;
+
+	void* sqRing;
+	size_t sqRingSize;
+	unsigned int* sqHead;
+	unsigned int* sqTail;
+	unsigned int* sqMask;
+	unsigned int* sqArray;
+	struct io_uring_sqe* sqes;
+	size_t sqesSize;
+
+	void* cqRing;
+	size_t cqRingSize;
+	unsigned int* cqHead;
+	unsigned int* cqTail;
+	unsigned int* cqMask;
+	struct io_uring_cqe* cqes;
+
+	std::vector<char> buffers;
+
+	bool setup(unsigned int wanted);
+	bool supportsOperations();
+	void teardown();
+	struct io_uring_sqe* queue(unsigned char opcode, int fd, unsigned long long userData);
+	bool enter(unsigned int waitFor);
+};
+
+#endif
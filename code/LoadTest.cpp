@@ -0,0 +1,281 @@
+// Copy constructor and assignment operator are disabled, a load test is run
+// once, where it was made
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+#include "LoadTest.h"
+#include "lib/returnValues.h"
+#include "lib/timing.h"
+
+#define LOAD_ENTRY 0
+#define LOAD_START 1
+#define LOAD_EXIT 2
+#define LOAD_TURNAROUND 3
+
+LoadTest::LoadTest()
+{
+	stopping = false;
+	nextScript = 0;
+	pthread_mutex_init(&claimLock, NULL);
+}
+
+LoadTest::~LoadTest()
+{
+	pthread_mutex_destroy(&claimLock);
+}
+
+const char* LoadTest::operationName(int operation)
+{
+	static const char* names[LOAD_OPERATIONS] = { "entry", "start", "exit", "turnaround" };
+	return (operation >= 0 && operation < LOAD_OPERATIONS) ? names[operation] : "?";
+}
+
+void LoadTest::addSluice(Sluice& sluice)
+{
+	sluices.push_back(&sluice);
+}
+
+bool LoadTest::addScript(const char text[], std::string& error)
+{
+	Script script;
+	script.text = text;
+	script.repeat = 1;
+	script.cycles = 0;
+	script.failure = success;
+	memset(script.failed, 0, sizeof(script.failed));
+
+	std::string body = text;
+	size_t times = body.rfind('*');
+	if (times != std::string::npos)
+	{
+		char* end;
+		script.repeat = strtoll(body.c_str() + times + 1, &end, 10);
+		if (*end != '\0' || script.repeat < 1)
+		{
+			error = "the repeat count after * is not a number above 0";
+			return false;
+		}
+		body.erase(times);
+	}
+
+	size_t start = 0;
+	while (start <= body.size())
+	{
+		size_t comma = body.find(',', start);
+		if (comma == std::string::npos)
+		{
+			comma = body.size();
+		}
+		std::string stepText = body.substr(start, comma - start);
+		start = comma + 1;
+
+		Step step;
+		step.passageMs = 0;
+		char* rest;
+		long sluice = strtol(stepText.c_str(), &rest, 10);
+		if (rest == stepText.c_str() || *rest != ':')
+		{
+			error = "step '" + stepText + "' is not <sluice>:<operation>";
+			return false;
+		}
+		if (sluice < 1 || sluice > (long) sluices.size())
+		{
+			error = "step '" + stepText + "' is for a sluice that does not exist";
+			return false;
+		}
+		step.sluice = sluice - 1;
+
+		std::string operation = rest + 1;
+		size_t equals = operation.find('=');
+		step.operation = -1;
+		for (int i = 0; i < LOAD_OPERATIONS; i++)
+		{
+			if (operation.compare(0, equals, operationName(i)) == 0)
+			{
+				step.operation = i;
+			}
+		}
+		if (step.operation == LOAD_TURNAROUND && equals != std::string::npos)
+		{
+			step.passageMs = strtoll(operation.c_str() + equals + 1, &rest, 10);
+			if (*rest != '\0' || step.passageMs < 0)
+			{
+				step.operation = -1;
+			}
+		}
+		else if (equals != std::string::npos)
+		{
+			step.operation = -1;
+		}
+		if (step.operation < 0)
+		{
+			error = "step '" + stepText + "' is not entry, start, exit or turnaround[=<ms>]";
+			return false;
+		}
+
+		// Two threads must never drive one sluice.
+		for (unsigned int s = 0; s < scripts.size(); s++)
+		{
+			for (unsigned int i = 0; i < scripts[s].steps.size(); i++)
+			{
+				if (scripts[s].steps[i].sluice == step.sluice)
+				{
+					error = "step '" + stepText + "' is for a sluice another script uses already";
+					return false;
+				}
+			}
+		}
+		script.steps.push_back(step);
+	}
+
+	scripts.push_back(script);
+	return true;
+}
+
+LoadReport LoadTest::run(int parallel)
+{
+	nextScript = 0;
+	int threads = (parallel > 0 && parallel < (int) scripts.size()) ? parallel : scripts.size();
+	std::vector<pthread_t> runners(threads);
+
+	long long started = monotonicMs();
+	for (int i = 0; i < threads; i++)
+	{
+		pthread_create(&runners[i], NULL, &LoadTest::runner, this);
+	}
+	for (int i = 0; i < threads; i++)
+	{
+		pthread_join(runners[i], NULL);
+	}
+
+	LoadReport report;
+	memset(&report, 0, sizeof(report));
+	report.scripts = scripts.size();
+	report.elapsedMs = monotonicMs() - started;
+
+	for (int operation = 0; operation < LOAD_OPERATIONS; operation++)
+	{
+		std::vector<long long> all;
+		LoadOperationStats& stats = report.perOperation[operation];
+		for (unsigned int s = 0; s < scripts.size(); s++)
+		{
+			all.insert(all.end(), scripts[s].latencyUs[operation].begin(), scripts[s].latencyUs[operation].end());
+			stats.failed += scripts[s].failed[operation];
+		}
+		stats.count = all.size();
+		if (all.empty())
+		{
+			continue;
+		}
+
+		std::sort(all.begin(), all.end());
+		long long total = 0;
+		for (unsigned int i = 0; i < all.size(); i++)
+		{
+			total += all[i];
+		}
+		stats.averageUs = total / (long long) all.size();
+		stats.p50Us = all[all.size() / 2];
+		stats.p99Us = all[(all.size() * 99) / 100];
+		stats.maxUs = all.back();
+		report.operations += stats.count;
+		report.failed += stats.failed;
+	}
+
+	for (unsigned int s = 0; s < scripts.size(); s++)
+	{
+		report.cycles += scripts[s].cycles;
+		if (scripts[s].failure != success)
+		{
+			report.stoppedScripts++;
+		}
+	}
+	if (report.elapsedMs > 0)
+	{
+		report.operationsPerS = report.operations * 1000.0 / report.elapsedMs;
+		report.cyclesPerHour = report.cycles * 3600000.0 / report.elapsedMs;
+	}
+	return report;
+}
+
+void LoadTest::stop()
+{
+	stopping = true;
+}
+
+int LoadTest::scriptCount()
+{
+	return scripts.size();
+}
+
+LoadScriptReport LoadTest::scriptReport(int index)
+{
+	LoadScriptReport report;
+	report.text = scripts[index].text;
+	report.cycles = scripts[index].cycles;
+	report.failure = scripts[index].failure;
+	return report;
+}
+
+void* LoadTest::runner(void* test)
+{
+	LoadTest* self = (LoadTest*) test;
+	while (!self->stopping)
+	{
+		pthread_mutex_lock(&self->claimLock);
+		int index = self->nextScript++;
+		pthread_mutex_unlock(&self->claimLock);
+		if (index >= (int) self->scripts.size())
+		{
+			break;
+		}
+		self->runScript(self->scripts[index]);
+	}
+	return NULL;
+}
+
+void LoadTest::runScript(Script& script)
+{
+	for (long long cycle = 0; cycle < script.repeat; cycle++)
+	{
+		for (unsigned int i = 0; i < script.steps.size(); i++)
+		{
+			if (stopping)
+			{
+				return; // A cycle cut short is not counted
+			}
+
+			Step& step = script.steps[i];
+			Sluice* sluice = sluices[step.sluice];
+			long long startedAt = monotonicUs();
+			int rtnval = success;
+			switch (step.operation)
+			{
+				case LOAD_ENTRY:
+					rtnval = sluice->allowEntry();
+					break;
+				case LOAD_START:
+					rtnval = sluice->start();
+					break;
+				case LOAD_EXIT:
+					rtnval = sluice->allowExit();
+					break;
+				case LOAD_TURNAROUND:
+					rtnval = sluice->turnaround(step.passageMs);
+					break;
+			}
+			script.latencyUs[step.operation].push_back(monotonicUs() - startedAt);
+
+			if (rtnval != success)
+			{
+				// What follows would start from a sluice in the wrong state.
+				script.failed[step.operation]++;
+				script.failure = rtnval;
+				return;
+			}
+		}
+		script.cycles++;
+	}
+}
@@ -0,0 +1,102 @@
+#ifndef LOADTEST_H_
+#define LOADTEST_H_
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+#include "Sluice.h"
+
+#define LOAD_OPERATIONS 4		/* entry, start, exit, turnaround */
+
+struct LoadOperationStats
+{
+	long long count;			// Operations run, failed ones included
+	long long failed;
+	long long averageUs;
+	long long p50Us;
+	long long p99Us;
+	long long maxUs;
+};
+
+struct LoadReport
+{
+	int scripts;
+	long long cycles;			// Times a script went through all its steps
+	long long operations;
+	long long failed;
+	long long elapsedMs;
+	double operationsPerS;
+	double cyclesPerHour;
+	LoadOperationStats perOperation[LOAD_OPERATIONS];	// Indexed like operationName()
+	int stoppedScripts;			// Scripts that stopped at a failure
+};
+
+struct LoadScriptReport
+{
+	std::string text;
+	long long cycles;
+	int failure;				// success, or the return value the script stopped at
+};
+
+// Runs scripts of operations without anyone at the keyboard and times
+// them, to see how much a set of sluices gets through. A script is a list
+// of steps, run over and over, e.g. "1:entry,1:start,1:exit*1000": sluice
+// 1 lets vessels in, moves them and lets them out, a thousand times.
+// Steps are <sluice>:entry, :start, :exit or :turnaround=<ms>, sluices
+// count from 1. Scripts run at the same time, each on a thread of its own,
+// so no two of them may use the same sluice.
+class LoadTest
+{
+public:
+	LoadTest();
+	~LoadTest();
+
+	void addSluice(Sluice& sluice);
+	// false, with the reason in error, for a script that can't be run.
+	bool addScript(const char text[], std::string& error);
+	// Runs the scripts, at most parallel at a time (0 for all of them).
+	// A script stops at the first operation that fails, the others carry
+	// on. Returns early, after the operations in progress, once stop()
+	// was called (from a signal handler, say).
+	LoadReport run(int parallel);
+	void stop();
+
+	int scriptCount();
+	LoadScriptReport scriptReport(int index);
+
+	static const char* operationName(int operation);
+
+private:
+	LoadTest(const LoadTest&);
+	LoadTest& operator= (const LoadTest&);
+
+	struct Step
+	{
+		int sluice;				// Index in sluices
+		int operation;			// As in operationName()
+		long long passageMs;	// Turnaround only
+	};
+
+	struct Script
+	{
+		std::string text;
+		std::vector<Step> steps;
+		long long repeat;
+		long long cycles;		// Completed, set while running
+		std::vector<long long> latencyUs[LOAD_OPERATIONS];
+		long long failed[LOAD_OPERATIONS];
+		int failure;
+	};
+
+	std::vector<Sluice*> sluices;
+	std::vector<Script> scripts;
+	volatile bool stopping;
+	int nextScript;				// Taken by the runners, under claimLock
+	pthread_mutex_t claimLock;
+
+	static void* runner(void* test);
+	void runScript(Script& script);
+};
+
+#endif
@@ -0,0 +1,425 @@
+// Copy constructor and assignment operator are disabled, the scheduler owns
+// a mutex
+
+#include "LockageScheduler.h"
+#include "lib/returnValues.h"
+#include "lib/timing.h"
+
+LockageScheduler::LockageScheduler(Sluice& existingSluice, int Capacity, long long PassageMs)
+	: sluice(existingSluice)
+{
+	capacity = (Capacity > 0) ? Capacity : 1;
+	passageMs = PassageMs;
+	pthread_mutex_init(&lock, NULL);
+	nextId = 1;
+	lockages = 0;
+	emptyLevelChanges = 0;
+	preLevellings = 0;
+	cancelledPreLevellings = 0;
+	predictive = false;
+	chamberLoaded = false;
+	preLevelling = false;
+	preLevellingFrom = left;
+	lockageMs = 0;
+	emptyLevelChangeMs = 0;
+	busyMs = 0;
+	startedAt = 0;
+	finishedAt = 0;
+	activity = waitingForCommand;
+	activitySince = 0;
+	at = left;
+}
+
+LockageScheduler::~LockageScheduler()
+{
+	pthread_mutex_destroy(&lock);
+}
+
+int LockageScheduler::addVessel(DoorSide from, long long arrivesAt)
+{
+	Vessel vessel;
+	vessel.from = from;
+	vessel.arrivesAt = arrivesAt;
+	vessel.enteredAt = 0;
+
+	pthread_mutex_lock(&lock);
+	vessel.id = nextId++;
+	// Keep the queue in order of arrival, vessels may be added out of order.
+	std::deque<Vessel>& queue = waiting[from];
+	std::deque<Vessel>::iterator position = queue.end();
+	while (position != queue.begin() && (position - 1)->arrivesAt > arrivesAt)
+	{
+		position--;
+	}
+	queue.insert(position, vessel);
+
+	// The chamber is being levelled away from this vessel: come back for it.
+	if (preLevelling && from == preLevellingFrom)
+	{
+		sluice.cancelAt((arrivesAt > monotonicMs()) ? arrivesAt : monotonicMs());
+	}
+	pthread_mutex_unlock(&lock);
+	return vessel.id;
+}
+
+int LockageScheduler::run()
+{
+	int rtnval = begin();
+
+	while (rtnval == success && hasWaiting())
+	{
+		rtnval = serveArrived();
+		if (rtnval == noVesselWaiting)
+		{
+			// Nobody there yet, wait for whoever comes first.
+			sleepMs(nextArrival() - monotonicMs());
+			rtnval = success;
+		}
+	}
+	return rtnval;
+}
+
+void LockageScheduler::setPredictive(bool on)
+{
+	pthread_mutex_lock(&lock);
+	predictive = on;
+	pthread_mutex_unlock(&lock);
+}
+
+int LockageScheduler::begin()
+{
+	WaterLevel currentWLevel = sluice.getWaterLevel();
+
+	pthread_mutex_lock(&lock);
+	startedAt = monotonicMs();
+	finishedAt = startedAt;
+	at = (currentWLevel == high) ? right : left;
+	pthread_mutex_unlock(&lock);
+
+	if (currentWLevel != low && currentWLevel != high)
+	{
+		return (currentWLevel == waterError) ? incorrectWaterLevel : invalidWaterLevel;
+	}
+	return success;
+}
+
+int LockageScheduler::serveArrived()
+{
+	long long now = monotonicMs();
+
+	pthread_mutex_lock(&lock);
+	DoorSide here = at;
+	DoorSide other = (at == left) ? right : left;
+	bool arrivedHere = chamberLoaded || hasArrived(here, now);
+	bool arrivedThere = hasArrived(other, now);
+	pthread_mutex_unlock(&lock);
+
+	int rtnval;
+	if (arrivedHere)
+	{
+		rtnval = lockage(here);
+	}
+	else if (arrivedThere)
+	{
+		// Nobody on this side, turn around to fetch the ones waiting there.
+		rtnval = turnAround(other);
+	}
+	else
+	{
+		rtnval = preLevel();
+		if (rtnval == noVesselWaiting)
+		{
+			return rtnval;
+		}
+	}
+
+	pthread_mutex_lock(&lock);
+	activity = waitingForCommand;
+	activitySince = monotonicMs();
+	finishedAt = activitySince;
+	pthread_mutex_unlock(&lock);
+	return rtnval;
+}
+
+bool LockageScheduler::hasWaiting()
+{
+	pthread_mutex_lock(&lock);
+	bool any = !waiting[left].empty() || !waiting[right].empty();
+	pthread_mutex_unlock(&lock);
+	return any;
+}
+
+long long LockageScheduler::nextArrival()
+{
+	long long next = -1;
+
+	pthread_mutex_lock(&lock);
+	for (int side = 0; side < 2; side++)
+	{
+		if (!waiting[side].empty() && (next < 0 || waiting[side].front().arrivesAt < next))
+		{
+			next = waiting[side].front().arrivesAt;
+		}
+	}
+	pthread_mutex_unlock(&lock);
+	return next;
+}
+
+std::vector<Vessel> LockageScheduler::takeWaiting()
+{
+	std::vector<Vessel> taken;
+
+	pthread_mutex_lock(&lock);
+	for (int side = 0; side < 2; side++)
+	{
+		taken.insert(taken.end(), waiting[side].begin(), waiting[side].end());
+		waiting[side].clear();
+	}
+	pthread_mutex_unlock(&lock);
+	return taken;
+}
+
+SchedulerReport LockageScheduler::report()
+{
+	SchedulerReport result;
+
+	pthread_mutex_lock(&lock);
+	result.vessels = served.size();
+	result.lockages = lockages;
+	result.emptyLevelChanges = emptyLevelChanges;
+	result.preLevellings = preLevellings;
+	result.cancelledPreLevellings = cancelledPreLevellings;
+	result.elapsedMs = finishedAt - startedAt;
+	result.busyMs = busyMs;
+	result.vesselsPerHour = (result.elapsedMs > 0) ? result.vessels * 3600000.0 / result.elapsedMs : 0.0;
+	result.averageWaitMs = 0;
+	result.longestWaitMs = 0;
+
+	for (unsigned int i = 0; i < served.size(); i++)
+	{
+		long long wait = served[i].enteredAt - served[i].arrivesAt;
+		result.averageWaitMs += wait;
+		if (wait > result.longestWaitMs)
+		{
+			result.longestWaitMs = wait;
+		}
+	}
+	if (!served.empty())
+	{
+		result.averageWaitMs /= (long long) served.size();
+	}
+	pthread_mutex_unlock(&lock);
+	return result;
+}
+
+SchedulerStatus LockageScheduler::status()
+{
+	SchedulerStatus result;
+
+	pthread_mutex_lock(&lock);
+	result.activity = activity;
+	result.activitySince = activitySince;
+	result.at = at;
+	result.queued[left] = waiting[left].size();
+	result.queued[right] = waiting[right].size();
+	result.capacity = capacity;
+	result.lockageMs = lockageMs;
+	result.emptyLevelChangeMs = emptyLevelChangeMs;
+	pthread_mutex_unlock(&lock);
+	return result;
+}
+
+bool LockageScheduler::hasArrived(DoorSide side, long long now)
+{
+	return !waiting[side].empty() && waiting[side].front().arrivesAt <= now;
+}
+
+int LockageScheduler::lockage(DoorSide from)
+{
+	DoorSide to = (from == left) ? right : left;
+	long long started = monotonicMs();
+	int rtnval;
+
+	// Vessels that came in during the last turnaround are in already.
+	if (!chamberLoaded)
+	{
+		setActivity(allowingEntry, to);
+		rtnval = carryOn(sluice.allowEntry());
+		if (rtnval != success)
+		{
+			return rtnval;
+		}
+		board(from);
+		sleepMs(passageMs);
+	}
+	chamberLoaded = false;
+
+	setActivity((from == left) ? sluicingUp : sluicingDown, to);
+	rtnval = carryOn(sluice.start());
+	if (rtnval != success)
+	{
+		return rtnval;
+	}
+
+	// Vessels waiting on the other side come in as these leave, the door
+	// only has to open once for both.
+	setActivity(allowingExit, to);
+	pthread_mutex_lock(&lock);
+	bool waitingThere = hasArrived(to, monotonicMs());
+	pthread_mutex_unlock(&lock);
+	if (waitingThere)
+	{
+		rtnval = carryOn(sluice.turnaround(passageMs));
+		if (rtnval != success)
+		{
+			return rtnval;
+		}
+		board(to);
+		chamberLoaded = true;
+	}
+	else
+	{
+		rtnval = carryOn(sluice.allowExit());
+		if (rtnval != success)
+		{
+			return rtnval;
+		}
+	}
+	sleepMs(passageMs);
+
+	pthread_mutex_lock(&lock);
+	lockages++;
+	learn(lockageMs, monotonicMs() - started);
+	pthread_mutex_unlock(&lock);
+	return success;
+}
+
+void LockageScheduler::board(DoorSide from)
+{
+	// Everyone who is there and fits goes in together.
+	pthread_mutex_lock(&lock);
+	long long now = monotonicMs();
+	for (int boarded = 0; boarded < capacity && hasArrived(from, now); boarded++)
+	{
+		Vessel vessel = waiting[from].front();
+		waiting[from].pop_front();
+		vessel.enteredAt = now;
+		served.push_back(vessel);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+int LockageScheduler::turnAround(DoorSide to)
+{
+	long long started = monotonicMs();
+
+	setActivity((to == right) ? sluicingUp : sluicingDown, to);
+	int rtnval = carryOn(sluice.start());
+	if (rtnval != success)
+	{
+		return rtnval;
+	}
+
+	pthread_mutex_lock(&lock);
+	emptyLevelChanges++;
+	learn(emptyLevelChangeMs, monotonicMs() - started);
+	pthread_mutex_unlock(&lock);
+	return success;
+}
+
+int LockageScheduler::preLevel()
+{
+	DoorSide to;
+	if (!predictSide(to))
+	{
+		return noVesselWaiting; // Already at the side the next vessel is expected on
+	}
+	DoorSide from = (to == left) ? right : left;
+	long long started = monotonicMs();
+
+	// A vessel that is already known to come on this side cancels it when it
+	// arrives, one added later does so in addVessel().
+	pthread_mutex_lock(&lock);
+	preLevelling = true;
+	preLevellingFrom = from;
+	sluice.cancelAt(waiting[from].empty() ? NO_DEADLINE : waiting[from].front().arrivesAt);
+	pthread_mutex_unlock(&lock);
+
+	setActivity((to == right) ? sluicingUp : sluicingDown, to);
+	int rtnval = carryOn(sluice.levelTo(to));
+
+	pthread_mutex_lock(&lock);
+	preLevelling = false;
+	sluice.cancelAt(NO_DEADLINE);
+	preLevellings++;
+	busyMs += monotonicMs() - started;
+	pthread_mutex_unlock(&lock);
+
+	if (rtnval == operationCancelled)
+	{
+		// Someone came on the side it was levelling away from, go back.
+		pthread_mutex_lock(&lock);
+		cancelledPreLevellings++;
+		pthread_mutex_unlock(&lock);
+
+		started = monotonicMs();
+		setActivity((from == right) ? sluicingUp : sluicingDown, from);
+		rtnval = carryOn(sluice.levelTo(from));
+
+		pthread_mutex_lock(&lock);
+		busyMs += monotonicMs() - started;
+		pthread_mutex_unlock(&lock);
+	}
+	return rtnval;
+}
+
+bool LockageScheduler::predictSide(DoorSide& side)
+{
+	// The side most of the last vessels came from, if that is not the side
+	// the chamber is at already.
+	pthread_mutex_lock(&lock);
+	int count[2] = { 0, 0 };
+	for (unsigned int i = served.size(); i > 0 && i + PREDICTION_HISTORY > served.size(); i--)
+	{
+		count[served[i - 1].from]++;
+	}
+	DoorSide other = (at == left) ? right : left;
+	bool move = predictive && count[other] > count[at];
+	side = other;
+	pthread_mutex_unlock(&lock);
+	return move;
+}
+
+void LockageScheduler::setActivity(SluiceState newActivity, DoorSide chamberAt)
+{
+	pthread_mutex_lock(&lock);
+	if (activity == waitingForCommand)
+	{
+		activitySince = monotonicMs();
+	}
+	activity = newActivity;
+	at = chamberAt;
+	pthread_mutex_unlock(&lock);
+}
+
+int LockageScheduler::carryOn(int rtnval)
+{
+	// Whatever the operation returned while the button was down, the second
+	// press carries it on.
+	if (rtnval == success || (rtnval != interruptReceived && !sluice.stopped()))
+	{
+		return rtnval;
+	}
+	while (sluice.stopped())
+	{
+		sleepMs(SCHEDULER_PAUSE_POLL_MS);
+	}
+	return sluice.lastResume();
+}
+
+void LockageScheduler::learn(long long& average, long long sample)
+{
+	// Called with the lock held. Counts the time as busy as well.
+	busyMs += sample;
+	average = (average == 0) ? sample : (3 * average + sample) / 4;
+}
@@ -0,0 +1,136 @@
+#ifndef LOCKAGESCHEDULER_H_
+#define LOCKAGESCHEDULER_H_
+
+#include <deque>
+#include <vector>
+#include <pthread.h>
+
+#include "Sluice.h"
+#include "lib/enums.h"
+
+#define CHAMBER_CAPACITY 4		// Vessels that fit in the chamber together
+#define PREDICTION_HISTORY 8	// Arrivals the predictive mode looks back on
+#define SCHEDULER_PAUSE_POLL_MS 10	// How often a paused scheduler looks for the button to come up
+
+struct Vessel
+{
+	int id;
+	DoorSide from;			// Side it waits on: left is the low water, right the high water
+	long long arrivesAt;	// monotonicMs()
+	long long enteredAt;	// When the door opened for it, 0 while it waits
+};
+
+struct SchedulerReport
+{
+	int vessels;			// Vessels that went through
+	int lockages;			// Level changes with vessels in the chamber
+	int emptyLevelChanges;	// Level changes only made to turn the chamber around
+	int preLevellings;		// Empty level changes made ahead of a vessel that was expected
+	int cancelledPreLevellings;	// ... of which a vessel on the other side cut short
+	long long elapsedMs;
+	long long busyMs;		// Time spent on lockages and empty level changes
+	double vesselsPerHour;
+	long long averageWaitMs;	// From arriving to the door opening for it
+	long long longestWaitMs;
+};
+
+// What the scheduler is doing right now, for whoever decides where the next
+// vessel goes.
+struct SchedulerStatus
+{
+	SluiceState activity;	// waitingForCommand while idle
+	long long activitySince;
+	DoorSide at;			// Side the chamber is at, or will be at once the current activity is done
+	int queued[2];			// Indexed by DoorSide, arrived or not
+	int capacity;
+	long long lockageMs;	// Learned duration of a lockage, 0 until one was made
+	long long emptyLevelChangeMs;	// Same for an empty level change
+};
+
+// Takes vessels waiting on either side of one sluice through it, as many
+// travelling the same way per lockage as fit in the chamber. The chamber
+// serves the side it is at for as long as vessels wait there, and only
+// changes level empty when nobody waits on its side but someone does on
+// the other. Vessels waiting where the chamber arrives come in as the ones
+// in it leave, see Sluice::turnaround().
+//
+// In predictive mode (-a) an idle chamber is levelled ahead of time with the
+// side most of the recent vessels came from. When a vessel shows up on the
+// side it is levelling away from, that is cancelled and the chamber goes
+// back.
+//
+// The emergency button pauses the scheduler: the operation it stopped is
+// carried on by the second press, the lockage goes on from there.
+//
+// Vessels can be added from another thread than the one serving them.
+class LockageScheduler
+{
+public:
+	LockageScheduler(Sluice& existingSluice, int Capacity, long long PassageMs);
+	~LockageScheduler();
+
+	// Returns the vessel's id.
+	int addVessel(DoorSide from, long long arrivesAt);
+	// Serves until every vessel added went through. Returns success, or
+	// the return value of the sluice operation that failed.
+	int run();
+	void setPredictive(bool on);
+
+	// For driving the scheduler step by step, as run() does: begin() finds
+	// out where the chamber is, serveArrived() makes one lockage or empty
+	// level change if a vessel is there for it, noVesselWaiting if not.
+	int begin();
+	int serveArrived();
+	bool hasWaiting();
+	// When the first vessel that has not arrived yet will, -1 if none.
+	long long nextArrival();
+	// Takes the vessels still waiting out of the queue, for another sluice
+	// to take through. The ones in the chamber stay.
+	std::vector<Vessel> takeWaiting();
+
+	SchedulerReport report();
+	SchedulerStatus status();
+
+private:
+	LockageScheduler(const LockageScheduler&);
+	LockageScheduler& operator= (const LockageScheduler&);
+
+	Sluice& sluice;
+	int capacity;
+	long long passageMs;	// Time vessels get to sail in or out of the chamber
+	pthread_mutex_t lock;	// Guards everything below
+	std::deque<Vessel> waiting[2];	// Indexed by DoorSide, in order of arrival
+	std::vector<Vessel> served;
+	int nextId;
+	int lockages;
+	int emptyLevelChanges;
+	int preLevellings;
+	int cancelledPreLevellings;
+	bool predictive;
+	bool chamberLoaded;		// Vessels boarded in a turnaround wait for their lockage
+	bool preLevelling;		// A pre-levelling is running that a vessel may cancel
+	DoorSide preLevellingFrom;
+	long long lockageMs;
+	long long emptyLevelChangeMs;
+	long long busyMs;
+	long long startedAt;
+	long long finishedAt;
+	SluiceState activity;
+	long long activitySince;
+	DoorSide at;
+
+	bool hasArrived(DoorSide side, long long now);
+	int lockage(DoorSide from);
+	void board(DoorSide from);
+	int turnAround(DoorSide to);
+	int preLevel();
+	bool predictSide(DoorSide& side);
+	// Waits out the emergency button when it stopped the operation that
+	// returned rtnval, what the carried on operation came to then. rtnval
+	// otherwise.
+	int carryOn(int rtnval);
+	void setActivity(SluiceState newActivity, DoorSide chamberAt);
+	void learn(long long& average, long long sample);
+};
+
+#endif
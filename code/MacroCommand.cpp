@@ -0,0 +1,157 @@
+// Destructor, copy constructor and assignment operator overloading is not
+// needed as this class does not contain allocated memory
+
+#include <string.h>
+
+#include "MacroCommand.h"
+
+MacroCommand::MacroCommand()
+{
+	count = 0;
+	sentCount = 0;
+	asked = 0;
+}
+
+void MacroCommand::add(const char* command, const char* undo)
+{
+	if (count < MACRO_STEPS)
+	{
+		step[count].command = command;
+		step[count].undo = undo;
+		step[count].applied = false;
+		count++;
+	}
+}
+
+void MacroCommand::ask(const char* query)
+{
+	if (asked < MACRO_QUERIES)
+	{
+		answers[asked][0] = '\0';
+		queries[asked++] = query;
+	}
+}
+
+int MacroCommand::steps()
+{
+	return count;
+}
+
+const char* MacroCommand::command(int index)
+{
+	return (index >= 0 && index < count) ? step[index].command : "";
+}
+
+bool MacroCommand::applied(int index)
+{
+	return index >= 0 && index < count && step[index].applied;
+}
+
+int MacroCommand::sent()
+{
+	return sentCount;
+}
+
+const char* MacroCommand::answer(int query)
+{
+	return (query >= 0 && query < asked) ? answers[query] : "";
+}
+
+void MacroCommand::exchange(SimulationCommunicator& simulation, const char* const commands[], int n, bool acked[],
+	bool withQueries)
+{
+	const char* rest[MACRO_STEPS + MACRO_QUERIES];
+	char replies[MACRO_STEPS + MACRO_QUERIES][RCVBUFSIZE];
+	int along = withQueries ? asked : 0;
+	for (int i = 1; i < n; i++)
+	{
+		rest[i - 1] = commands[i];
+	}
+	for (int i = 0; i < along; i++)
+	{
+		rest[n - 1 + i] = queries[i];
+	}
+
+	char* first = simulation.sendPipelined(commands[0], rest, n - 1 + along, replies);
+	acked[0] = strcmp(first, "ack") == 0;
+	for (int i = 1; i < n; i++)
+	{
+		acked[i] = strcmp(replies[i - 1], "ack") == 0;
+	}
+	for (int i = 0; i < along; i++)
+	{
+		strcpy(answers[i], replies[n - 1 + i]);
+	}
+	sentCount += n;
+}
+
+bool MacroCommand::run(SimulationCommunicator& simulation)
+{
+	if (count == 0)
+	{
+		return true;
+	}
+
+	const char* commands[MACRO_STEPS];
+	bool acked[MACRO_STEPS];
+	bool complete = true;
+	for (int i = 0; i < count; i++)
+	{
+		commands[i] = step[i].command;
+	}
+	exchange(simulation, commands, count, acked, true);
+	for (int i = 0; i < count; i++)
+	{
+		step[i].applied = acked[i];
+		complete = complete && acked[i];
+	}
+	if (complete)
+	{
+		return true;
+	}
+
+	// The compensation: undo what was applied, or finish what was not.
+	int stepOf[MACRO_STEPS];
+	int n = 0;
+	for (int i = count - 1; i >= 0; i--)
+	{
+		if (step[i].undo != NULL && step[i].applied)
+		{
+			commands[n] = step[i].undo;
+			stepOf[n++] = i;
+		}
+	}
+	for (int i = 0; i < count; i++)
+	{
+		if (step[i].undo == NULL && !step[i].applied)
+		{
+			commands[n] = step[i].command;
+			stepOf[n++] = i;
+		}
+	}
+	if (n == 0)
+	{
+		return false;
+	}
+
+	exchange(simulation, commands, n, acked, false);
+	complete = true;
+	for (int i = 0; i < n; i++)
+	{
+		MacroStep& compensated = step[stepOf[i]];
+		if (compensated.undo != NULL)
+		{
+			compensated.applied = !acked[i];
+			complete = false; // Undone or not, the macro did not happen
+		}
+		else
+		{
+			compensated.applied = acked[i];
+		}
+	}
+	for (int i = 0; i < count; i++)
+	{
+		complete = complete && step[i].applied;
+	}
+	return complete;
+}
@@ -0,0 +1,54 @@
+#ifndef MACROCOMMAND_H_
+#define MACROCOMMAND_H_
+
+#include "SimulationCommunicator.h"
+
+#define MACRO_STEPS 3		/* A side's valve rows */
+#define MACRO_QUERIES 3		/* Sent along, as many as QuerySpeculator guesses */
+
+struct MacroStep
+{
+	const char* command;
+	const char* undo;		// NULL when a failed step is sent again instead
+	bool applied;			// Acknowledged, and not undone since
+};
+
+// Commands that only make sense together, like the two halves of switching
+// a light. They go out in one write and their acknowledgements are checked
+// together. When some are missing the compensation goes in a second write:
+// with steps that have an undo the acknowledged ones are undone, last first,
+// so nothing is left half-switched; steps without one (closing, where what
+// is left is the safe state) that failed are sent again. The simulator may
+// have applied an unacknowledged step, what was commanded is repeated after
+// a reconnect.
+class MacroCommand
+{
+public:
+	MacroCommand();
+
+	void add(const char* command, const char* undo);
+	// Sent in the same write after the commands, not part of the macro.
+	void ask(const char* query);
+	int steps();
+	const char* command(int step);
+	// true when every step is applied.
+	bool run(SimulationCommunicator& simulation);
+	bool applied(int step);
+	int sent();				// Commands, the compensation's included
+	const char* answer(int query);	// Empty when it got no reply
+
+private:
+	MacroStep step[MACRO_STEPS];
+	int count;
+	int sentCount;
+	const char* queries[MACRO_QUERIES];
+	char answers[MACRO_QUERIES][RCVBUFSIZE];
+	int asked;
+
+	// Sends commands in one write, acked[i] set for each acknowledged one.
+	// The queries go along when withQueries is set.
+	void exchange(SimulationCommunicator& simulation, const char* const commands[], int n, bool acked[],
+		bool withQueries);
+};
+
+#endif
@@ -0,0 +1,203 @@
+// Copy constructor and assignment operator are disabled: WaitChannel owns
+// its eventfd, PollScheduler its lock and its thread.
+
+#include <poll.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "PollScheduler.h"
+#include "lib/timing.h"
+
+// A wait in progress, on the stack of the waiting thread. The timer thread
+// only touches it under the scheduler's lock, and the waiter takes it off
+// the wheel under that lock before returning.
+struct PollWait
+{
+	WheelTimer timer;
+	int eventFd;
+	bool fired;
+};
+
+WaitChannel::WaitChannel()
+{
+	eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+WaitChannel::~WaitChannel()
+{
+	if (eventFd >= 0)
+	{
+		close(eventFd);
+	}
+}
+
+void WaitChannel::wake()
+{
+	uint64_t one = 1;
+	if (write(eventFd, &one, sizeof(one)) < 0)
+	{
+		// Only fails when the counter is full, and then it is woken already.
+	}
+}
+
+int WaitChannel::descriptor()
+{
+	return eventFd;
+}
+
+PollScheduler::PollScheduler()
+	: wheel(monotonicMs())
+{
+	pthread_condattr_t attributes;
+	pthread_condattr_init(&attributes);
+	pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC); // Deadlines are monotonicMs()
+	pthread_cond_init(&changed, &attributes);
+	pthread_condattr_destroy(&attributes);
+	pthread_mutex_init(&lock, NULL);
+	started = false;
+	stopping = false;
+	sleepingUntil = -1;
+}
+
+PollScheduler::~PollScheduler()
+{
+	pthread_mutex_lock(&lock);
+	stopping = true;
+	pthread_cond_signal(&changed);
+	pthread_mutex_unlock(&lock);
+	if (started)
+	{
+		pthread_join(thread, NULL);
+	}
+	pthread_cond_destroy(&changed);
+	pthread_mutex_destroy(&lock);
+}
+
+void PollScheduler::fire(WheelTimer* timer)
+{
+	PollWait* wait = (PollWait*) timer->context;
+	wait->fired = true;
+	uint64_t one = 1;
+	if (write(wait->eventFd, &one, sizeof(one)) < 0)
+	{
+		// Woken already.
+	}
+}
+
+void* PollScheduler::run(void* self)
+{
+	PollScheduler* scheduler = (PollScheduler*) self;
+	pthread_mutex_lock(&scheduler->lock);
+	while (!scheduler->stopping)
+	{
+		scheduler->wheel.advance(monotonicMs());
+		scheduler->sleepingUntil = scheduler->wheel.nextDueMs();
+		if (scheduler->sleepingUntil < 0)
+		{
+			pthread_cond_wait(&scheduler->changed, &scheduler->lock);
+		}
+		else
+		{
+			struct timespec until;
+			until.tv_sec = scheduler->sleepingUntil / 1000;
+			until.tv_nsec = (scheduler->sleepingUntil % 1000) * 1000000;
+			pthread_cond_timedwait(&scheduler->changed, &scheduler->lock, &until);
+		}
+	}
+	pthread_mutex_unlock(&scheduler->lock);
+	return NULL;
+}
+
+bool PollScheduler::waitUntil(WaitChannel& channel, long long whenMs)
+{
+	// The emergency button's handler runs on the thread it interrupts, and
+	// may wait in turn while that thread holds the lock or is on the wheel:
+	// that wait goes without the wheel.
+	static __thread bool waiting = false;
+	long long remaining = whenMs - monotonicMs();
+	if (remaining <= 0)
+	{
+		return true;
+	}
+
+	PollWait wait;
+	wait.timer.fire = &fire;
+	wait.timer.context = &wait;
+	wait.timer.next = NULL;
+	wait.timer.previous = NULL;
+	wait.eventFd = channel.descriptor();
+	wait.fired = false;
+
+	bool onWheel = !waiting && wait.eventFd >= 0;
+	if (onWheel)
+	{
+		waiting = true;
+		pthread_mutex_lock(&lock);
+		if (!started)
+		{
+			started = pthread_create(&thread, NULL, &run, this) == 0;
+		}
+		onWheel = started;
+		if (onWheel)
+		{
+			wheel.advance(monotonicMs()); // Idle, the wheel's clock stood still
+			wheel.schedule(wait.timer, whenMs);
+			if (sleepingUntil < 0 || whenMs < sleepingUntil)
+			{
+				pthread_cond_signal(&changed); // Sooner than the thread would wake up
+			}
+		}
+		pthread_mutex_unlock(&lock);
+	}
+
+	// Without the wheel the descriptor's own timeout does, and when the
+	// wheel's thread lags the waiter does not wait much longer for it.
+	struct pollfd event;
+	event.fd = wait.eventFd;
+	event.events = POLLIN;
+	event.revents = 0;
+	int timeout = (int) (onWheel ? remaining + WAIT_SLACK_MS : remaining);
+	if (wait.eventFd >= 0)
+	{
+		poll(&event, 1, timeout); // A signal ends it early, like sleepMs()
+	}
+	else
+	{
+		sleepMs(remaining);
+	}
+
+	if (onWheel)
+	{
+		pthread_mutex_lock(&lock);
+		wheel.cancel(wait.timer);
+		pthread_mutex_unlock(&lock);
+		waiting = false;
+	}
+	if (wait.eventFd >= 0)
+	{
+		// Off the wheel now, so nothing fires after this: a wake left over
+		// would end the next wait for nothing.
+		uint64_t count;
+		if (read(wait.eventFd, &count, sizeof(count)) < 0)
+		{
+			// Nothing to take: the timeout or a signal ended the wait.
+		}
+	}
+	return wait.fired || monotonicMs() >= whenMs;
+}
+
+int PollScheduler::pending()
+{
+	pthread_mutex_lock(&lock);
+	int count = wheel.pending();
+	pthread_mutex_unlock(&lock);
+	return count;
+}
+
+PollScheduler& pollScheduler()
+{
+	static PollScheduler scheduler;
+	return scheduler;
+}
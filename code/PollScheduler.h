@@ -0,0 +1,65 @@
+#ifndef POLLSCHEDULER_H_
+#define POLLSCHEDULER_H_
+
+#include <pthread.h>
+#include <signal.h>
+
+#include "TimerWheel.h"
+
+#define WAIT_SLACK_MS 100	/* A waiter looks for itself when its timer is this late */
+
+// Where a sluice's thread waits for its next poll. wake() ends the wait in
+// progress, or the next one when there is none, from any thread or from a
+// signal handler: that is how the emergency button reaches a sluice that
+// is waiting for its door or its water.
+class WaitChannel
+{
+public:
+	WaitChannel();
+	~WaitChannel();
+
+	void wake();				// Async-signal-safe
+	int descriptor();
+
+private:
+	WaitChannel(const WaitChannel&);
+	WaitChannel& operator= (const WaitChannel&);
+
+	int eventFd;
+};
+
+// One timer thread for every sluice of the controller. Waits are put on a
+// TimerWheel, the thread sleeps until the earliest one is due and wakes its
+// waiter through the waiter's WaitChannel, so the number of sluices waiting
+// costs nothing per poll.
+class PollScheduler
+{
+public:
+	PollScheduler();
+	~PollScheduler();
+
+	// Waits until whenMs (monotonicMs()) or until the channel is woken,
+	// whichever comes first. true when whenMs came.
+	bool waitUntil(WaitChannel& channel, long long whenMs);
+	int pending();
+
+private:
+	PollScheduler(const PollScheduler&);
+	PollScheduler& operator= (const PollScheduler&);
+
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	pthread_t thread;
+	bool started;
+	bool stopping;
+	long long sleepingUntil;	// When the thread wakes up by itself, -1 for not at all
+	TimerWheel wheel;
+
+	static void* run(void* self);
+	static void fire(WheelTimer* timer);
+};
+
+// Shared by every sluice of the controller, the thread starts on first use.
+PollScheduler& pollScheduler();
+
+#endif
@@ -0,0 +1,43 @@
+// Destructor, copy constructor and assignment operator overloading is not
+// needed as this class does not contain allocated memory
+
+#include "ProgressWatchdog.h"
+#include "lib/auxiliary.h"
+#include "lib/timing.h"
+
+ProgressWatchdog::ProgressWatchdog()
+{
+	progressAt = monotonicMs();
+	allowed = STALL_UNLEARNED_MS;
+}
+
+void ProgressWatchdog::progress(long long expectedMs)
+{
+	progressAt = monotonicMs();
+	if (argv_stalltime > 0)
+	{
+		allowed = argv_stalltime * 1000LL;
+	}
+	else if (expectedMs > 0)
+	{
+		allowed = expectedMs * STALL_FACTOR;
+		if (allowed < STALL_MIN_MS)
+		{
+			allowed = STALL_MIN_MS;
+		}
+	}
+	else
+	{
+		allowed = STALL_UNLEARNED_MS;
+	}
+}
+
+bool ProgressWatchdog::stalled()
+{
+	return monotonicMs() - progressAt > allowed;
+}
+
+long long ProgressWatchdog::allowedMs()
+{
+	return allowed;
+}
@@ -0,0 +1,31 @@
+#ifndef PROGRESSWATCHDOG_H_
+#define PROGRESSWATCHDOG_H_
+
+#define STALL_FACTOR 3				/* Times the expected time a phase may take */
+#define STALL_MIN_MS 500			/* Never sooner, short phases jitter */
+#define STALL_UNLEARNED_MS 60000	/* Allowed while a phase has not been timed yet */
+
+// Tells a door or the water that stopped moving from one that is slow. Each
+// phase (a door move, the water in one band) says how long it is expected
+// to take, from what was learned, and is stalled once it has gone
+// STALL_FACTOR times that without progress. -w sets one limit for every
+// phase instead. Unlike the operation's deadline (-o) this goes by how long
+// the sluice usually takes, so a stuck one is given up on in seconds.
+class ProgressWatchdog
+{
+public:
+	ProgressWatchdog();
+
+	// A phase starts: progress was made. expectedMs is how long it should
+	// take, 0 when that is not known.
+	void progress(long long expectedMs);
+	bool stalled();
+	// The limit of the running phase in ms.
+	long long allowedMs();
+
+private:
+	long long progressAt;
+	long long allowed;
+};
+
+#endif
@@ -0,0 +1,178 @@
+// Copy constructor and assignment operator are disabled: the coalescer owns
+// its lock.
+
+#include <string.h>
+
+#include "QueryCoalescer.h"
+#include "lib/timing.h"
+
+// Set while this thread is in the coalescer. The emergency button's
+// handler may query from the same thread, it goes past the coalescer then.
+static __thread bool inside = false;
+
+QueryCoalescer::QueryCoalescer()
+{
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&landed, NULL);
+	memset(queries, 0, sizeof(queries));
+	epoch = 0;
+	freshUs = 0;
+	count = 0;
+	prefetchHits = 0;
+}
+
+void QueryCoalescer::configure(int freshMs)
+{
+	pthread_mutex_lock(&lock);
+	freshUs = (freshMs > 0) ? freshMs * 1000LL : 0;
+	pthread_mutex_unlock(&lock);
+}
+
+QueryCoalescer::~QueryCoalescer()
+{
+	pthread_cond_destroy(&landed);
+	pthread_mutex_destroy(&lock);
+}
+
+int QueryCoalescer::find(const char message[])
+{
+	if (strlen(message) >= RCVBUFSIZE)
+	{
+		return -1;
+	}
+	for (int i = 0; i < COALESCED_QUERIES; i++)
+	{
+		if (queries[i].message[0] == '\0')
+		{
+			strcpy(queries[i].message, message);
+			return i;
+		}
+		if (strcmp(queries[i].message, message) == 0)
+		{
+			return i;
+		}
+	}
+	return -1; // Not kept track of, sent every time
+}
+
+bool QueryCoalescer::reuse(const char message[], char reply[], int& flight)
+{
+	flight = -1;
+	if (inside)
+	{
+		return false;
+	}
+	inside = true;
+	pthread_mutex_lock(&lock);
+
+	bool reused = false;
+	int slot = find(message);
+	if (slot >= 0)
+	{
+		CoalescedQuery& query = queries[slot];
+		// A flight from before forget() is not waited for, its reply would
+		// not be reused. It may well be waiting for this thread: the one
+		// restoring the simulator after a reconnect holds the connection.
+		bool waited = false;
+		while (query.inFlight && query.epoch == epoch && !pthread_equal(query.flying, pthread_self()))
+		{
+			pthread_cond_wait(&landed, &lock);
+			waited = true;
+		}
+
+		if (query.inFlight)
+		{
+			// This thread's own, the emergency button pressed in, or one from
+			// before forget(): it goes out once more, outside the flight.
+		}
+		else if (query.answeredAtUs > 0 && query.epoch == epoch
+			&& (waited || monotonicUs() - query.answeredAtUs < freshUs))
+		{
+			strcpy(reply, query.reply);
+			if (query.prefetched)
+			{
+				prefetchHits++;
+				query.prefetched = false;
+			}
+			else
+			{
+				count++;
+			}
+			reused = true;
+		}
+		else
+		{
+			query.inFlight = true;
+			query.flying = pthread_self();
+			query.epoch = epoch;
+			query.answeredAtUs = 0;
+			query.prefetched = false;
+			flight = slot;
+		}
+	}
+
+	pthread_mutex_unlock(&lock);
+	inside = false;
+	return reused;
+}
+
+void QueryCoalescer::land(int flight, const char reply[])
+{
+	if (flight < 0)
+	{
+		return;
+	}
+	inside = true;
+	pthread_mutex_lock(&lock);
+	CoalescedQuery& query = queries[flight];
+	query.inFlight = false;
+	if (reply[0] != '\0' && query.epoch == epoch && strlen(reply) < RCVBUFSIZE)
+	{
+		// Failed exchanges are not shared, whoever waited tries for itself.
+		strcpy(query.reply, reply);
+		query.answeredAtUs = monotonicUs();
+	}
+	pthread_cond_broadcast(&landed);
+	pthread_mutex_unlock(&lock);
+	inside = false;
+}
+
+void QueryCoalescer::prefill(const char message[], const char reply[], unsigned int asOf)
+{
+	if (inside || reply[0] == '\0' || strlen(reply) >= RCVBUFSIZE)
+	{
+		return;
+	}
+	inside = true;
+	pthread_mutex_lock(&lock);
+	int slot = find(message);
+	if (slot >= 0 && !queries[slot].inFlight && asOf == epoch)
+	{
+		strcpy(queries[slot].reply, reply);
+		queries[slot].answeredAtUs = monotonicUs();
+		queries[slot].epoch = epoch;
+		queries[slot].prefetched = true;
+	}
+	pthread_mutex_unlock(&lock);
+	inside = false;
+}
+
+unsigned int QueryCoalescer::current()
+{
+	return epoch;
+}
+
+void QueryCoalescer::forget()
+{
+	__sync_fetch_and_add(&epoch, 1);
+}
+
+long long QueryCoalescer::coalesced()
+{
+	return count;
+}
+
+long long QueryCoalescer::prefetched()
+{
+	return prefetchHits;
+}
@@ -0,0 +1,65 @@
+#ifndef QUERYCOALESCER_H_
+#define QUERYCOALESCER_H_
+
+#include <pthread.h>
+
+#include "SimulationCommunicator.h"
+
+#define COALESCED_QUERIES 16	/* Different queries kept track of, there are 11 */
+
+struct CoalescedQuery
+{
+	char message[RCVBUFSIZE];	// Empty for an unused entry
+	char reply[RCVBUFSIZE];
+	long long answeredAtUs;		// 0 while there is no reply to reuse
+	unsigned int epoch;			// Of the reply, or of the flight
+	bool inFlight;
+	bool prefetched;			// The reply came along with a command, not used yet
+	pthread_t flying;			// Thread sending it
+};
+
+// Single flight for the queries to one simulator: a query identical to one
+// that is on its way waits for that reply instead of being sent again, and
+// a reply younger than the freshness window (-k) is reused. Commanding
+// anything, waiting for a poll or a reconnect makes every reply so far
+// stale, so a poll loop always sees the simulator anew.
+class QueryCoalescer
+{
+public:
+	QueryCoalescer();
+	~QueryCoalescer();
+
+	// How long a reply is reused (-k). 0, which is what it is until then,
+	// only shares the replies to queries that were on their way.
+	void configure(int freshMs);
+
+	// true with the reply copied when one could be reused. Otherwise the
+	// caller sends message, and hands the reply to land() with flight.
+	bool reuse(const char message[], char reply[], int& flight);
+	void land(int flight, const char reply[]);
+	// A reply to message that came without being asked for at this point,
+	// sent along with a command (QuerySpeculator). Kept only when nothing
+	// was forgotten since asOf, taken from current() before sending.
+	void prefill(const char message[], const char reply[], unsigned int asOf);
+	unsigned int current();
+	// Async-signal-safe, for the emergency button.
+	void forget();
+	long long coalesced();
+	long long prefetched();		// Prefilled replies that were used
+
+private:
+	QueryCoalescer(const QueryCoalescer&);
+	QueryCoalescer& operator= (const QueryCoalescer&);
+
+	pthread_mutex_t lock;
+	pthread_cond_t landed;
+	CoalescedQuery queries[COALESCED_QUERIES];
+	volatile unsigned int epoch;
+	long long freshUs;
+	long long count;
+	long long prefetchHits;
+
+	int find(const char message[]);
+};
+
+#endif
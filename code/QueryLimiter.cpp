@@ -0,0 +1,162 @@
+// Destructor, copy constructor and assignment operator overloading is not
+// needed for QueryLimiter as it does not contain allocated memory. They are
+// disabled for FleetQueryScheduler, which owns its lock.
+
+#include "QueryLimiter.h"
+#include "lib/auxiliary.h"
+#include "lib/timing.h"
+
+QueryLimiter::QueryLimiter()
+{
+	configure(0, 1);
+	count.queries = 0;
+	count.throttled = 0;
+	count.throttledUs = 0;
+	count.commands = 0;
+	count.coalesced = 0;
+	count.speculated = 0;
+	count.prefetched = 0;
+}
+
+void QueryLimiter::configure(double perSecond, int burst)
+{
+	rate = (perSecond > 0) ? perSecond : 0;
+	capacity = (burst > 0) ? burst : 1;
+	tokens = capacity;
+	refilledUs = monotonicUs();
+}
+
+void QueryLimiter::refill(long long now)
+{
+	tokens += (now - refilledUs) * rate / 1000000.0;
+	if (tokens > capacity)
+	{
+		tokens = capacity;
+	}
+	refilledUs = now;
+}
+
+void QueryLimiter::acquire()
+{
+	long long startedUs = monotonicUs();
+	bool waited = false;
+	if (rate > 0)
+	{
+		refill(startedUs);
+		if (tokens < 1)
+		{
+			sleepUs((long long) ((1 - tokens) * 1000000 / rate) + 1);
+			refill(monotonicUs());
+			waited = true;
+		}
+		tokens -= 1; // Below 0 after a sleep cut short: the next query waits longer
+	}
+	if (fleetQueryScheduler().acquire())
+	{
+		waited = true;
+	}
+
+	count.queries++;
+	if (waited)
+	{
+		count.throttled++;
+		count.throttledUs += monotonicUs() - startedUs;
+	}
+}
+
+void QueryLimiter::bypass()
+{
+	count.commands++;
+}
+
+QueryCounters QueryLimiter::counters()
+{
+	return count;
+}
+
+FleetQueryScheduler::FleetQueryScheduler()
+{
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&turn, NULL);
+	nextTicket = 0;
+	serving = 0;
+	rate = 0;
+	capacity = 1;
+	tokens = 1;
+	refilledUs = monotonicUs();
+}
+
+FleetQueryScheduler::~FleetQueryScheduler()
+{
+	pthread_cond_destroy(&turn);
+	pthread_mutex_destroy(&lock);
+}
+
+void FleetQueryScheduler::configure(double perSecond, int burst)
+{
+	pthread_mutex_lock(&lock);
+	rate = (perSecond > 0) ? perSecond : 0;
+	capacity = (burst > 0) ? burst : 1;
+	tokens = capacity;
+	refilledUs = monotonicUs();
+	pthread_mutex_unlock(&lock);
+}
+
+bool FleetQueryScheduler::acquire()
+{
+	// A query sent from a signal handler (the emergency button resuming)
+	// while this thread waits for its turn must not queue behind itself.
+	static __thread bool waiting = false;
+	if (rate <= 0 || waiting)
+	{
+		return false;
+	}
+	waiting = true;
+
+	pthread_mutex_lock(&lock);
+	unsigned long long ticket = nextTicket++;
+	bool waited = false;
+	while (true)
+	{
+		if (ticket == serving)
+		{
+			long long now = monotonicUs();
+			tokens += (now - refilledUs) * rate / 1000000.0;
+			if (tokens > capacity)
+			{
+				tokens = capacity;
+			}
+			refilledUs = now;
+			if (tokens >= 1)
+			{
+				break;
+			}
+
+			// This thread's turn, the others keep waiting for theirs.
+			long long sleepFor = (long long) ((1 - tokens) * 1000000 / rate) + 1;
+			pthread_mutex_unlock(&lock);
+			sleepUs(sleepFor);
+			pthread_mutex_lock(&lock);
+		}
+		else
+		{
+			pthread_cond_wait(&turn, &lock);
+		}
+		waited = true;
+	}
+	tokens -= 1;
+	serving++;
+	pthread_cond_broadcast(&turn);
+	pthread_mutex_unlock(&lock);
+
+	waiting = false;
+	return waited;
+}
+
+FleetQueryScheduler& fleetQueryScheduler()
+{
+	static FleetQueryScheduler scheduler;
+	static bool configured = (scheduler.configure(argv_fleetrate, QUERY_BURST), true);
+	(void) configured;
+	return scheduler;
+}
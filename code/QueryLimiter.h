@@ -0,0 +1,76 @@
+#ifndef QUERYLIMITER_H_
+#define QUERYLIMITER_H_
+
+#include <pthread.h>
+
+#define QUERY_BURST 10		/* Queries a simulator may get back to back after a quiet spell */
+
+struct QueryCounters
+{
+	long long queries;		// Sent through the limiter
+	long long throttled;	// ... of which had to wait for a token or a turn
+	long long throttledUs;	// Time spent waiting, all together
+	long long commands;		// Sent straight away, never limited
+	long long coalesced;	// Not sent, answered with another one's reply (QueryCoalescer)
+	long long speculated;	// Sent along with a command, in its write (QuerySpeculator)
+	long long prefetched;	// Not sent, answered with a reply that came along with a command
+};
+
+// A token bucket for the queries to one simulator (-q): polling loops can
+// ask no faster than perSecond, with bursts of up to burst queries.
+// Commands (Set...) are what moves the sluice and go out at once, they are
+// only counted. Used by one thread at a time, like the simulator socket.
+class QueryLimiter
+{
+public:
+	QueryLimiter();
+
+	// 0 perSecond for no limit, which is what there is until then.
+	void configure(double perSecond, int burst);
+	// Waits until a query may be sent, then counts it.
+	void acquire();
+	void bypass();
+	QueryCounters counters();
+
+private:
+	double rate;			// Tokens per second, 0 for no limit
+	double capacity;
+	double tokens;
+	long long refilledUs;
+	QueryCounters count;
+
+	void refill(long long now);
+};
+
+// The query budget of all simulators together (-Q). Sluices that run out
+// take turns in the order they asked, so one busy sluice gets no more than
+// its share while the others wait, however fast it polls.
+class FleetQueryScheduler
+{
+public:
+	FleetQueryScheduler();
+	~FleetQueryScheduler();
+
+	// 0 perSecond for no fleet limit.
+	void configure(double perSecond, int burst);
+	// Waits for this thread's turn and a token. true when it had to wait.
+	bool acquire();
+
+private:
+	FleetQueryScheduler(const FleetQueryScheduler&);
+	FleetQueryScheduler& operator= (const FleetQueryScheduler&);
+
+	pthread_mutex_t lock;
+	pthread_cond_t turn;
+	unsigned long long nextTicket;
+	unsigned long long serving;	// Ticket whose turn it is
+	double rate;
+	double capacity;
+	double tokens;
+	long long refilledUs;
+};
+
+// Shared by every sluice of the controller, set up from -Q on first use.
+FleetQueryScheduler& fleetQueryScheduler();
+
+#endif
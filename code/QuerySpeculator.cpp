@@ -0,0 +1,74 @@
+// Destructor, copy constructor and assignment operator overloading is not
+// needed as this class does not contain allocated memory
+
+#include <string.h>
+
+#include "QuerySpeculator.h"
+
+QuerySpeculator::QuerySpeculator()
+{
+	enabled = false;
+	memset(followers, 0, sizeof(followers));
+	step = -1;
+	asked = 0;
+}
+
+void QuerySpeculator::configure(bool enabled)
+{
+	this->enabled = enabled;
+}
+
+int QuerySpeculator::commanded(const char command[], char queries[][RCVBUFSIZE])
+{
+	stepEnded();
+	if (!enabled || strlen(command) >= RCVBUFSIZE)
+	{
+		return 0;
+	}
+
+	for (int i = 0; i < SPECULATED_COMMANDS; i++)
+	{
+		if (followers[i].command[0] == '\0')
+		{
+			strcpy(followers[i].command, command);
+			step = i;
+			return 0; // Nothing learned yet
+		}
+		if (strcmp(followers[i].command, command) == 0)
+		{
+			step = i;
+			memcpy(queries, followers[i].queries, followers[i].count * RCVBUFSIZE);
+			return followers[i].count;
+		}
+	}
+	return 0;
+}
+
+void QuerySpeculator::queried(const char query[])
+{
+	if (step < 0 || asked == SPECULATED_QUERIES || strlen(query) >= RCVBUFSIZE)
+	{
+		return;
+	}
+	for (int i = 0; i < asked; i++)
+	{
+		if (strcmp(askedQueries[i], query) == 0)
+		{
+			return;
+		}
+	}
+	strcpy(askedQueries[asked++], query);
+}
+
+void QuerySpeculator::stepEnded()
+{
+	if (step >= 0)
+	{
+		// The last step after this command is the best guess for the next.
+		CommandFollowers& learned = followers[step];
+		memcpy(learned.queries, askedQueries, sizeof(askedQueries));
+		learned.count = asked;
+	}
+	step = -1;
+	asked = 0;
+}
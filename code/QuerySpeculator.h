@@ -0,0 +1,47 @@
+#ifndef QUERYSPECULATOR_H_
+#define QUERYSPECULATOR_H_
+
+#include "SimulationCommunicator.h"
+
+#define SPECULATED_QUERIES 3		/* Sent along with one command at most */
+#define SPECULATED_COMMANDS 32		/* Different commands learned, there are 24 */
+
+struct CommandFollowers
+{
+	char command[RCVBUFSIZE];		// Empty for an unused entry
+	int count;
+	char queries[SPECULATED_QUERIES][RCVBUFSIZE];
+};
+
+// Learns which queries a sluice asks right after each command, before it
+// waits or commands anything else: what the next step needs to know. The
+// next time that command goes out they are sent in the same write (see
+// SimulationCommunicator::sendPipelined()), and their replies are kept in
+// the QueryCoalescer for the step to find. A guess the step did not use
+// is not made again. Used by the sluice's own thread, like the limiter.
+class QuerySpeculator
+{
+public:
+	QuerySpeculator();
+
+	// Off until it is turned on.
+	void configure(bool enabled);
+
+	// command is about to go out: the step before it is over. Returns how
+	// many queries to send along, copied into queries.
+	int commanded(const char command[], char queries[][RCVBUFSIZE]);
+	// The step asked query, whether or not it was sent.
+	void queried(const char query[]);
+	// Waiting, a reconnect or the emergency button: what comes next is no
+	// longer part of the step.
+	void stepEnded();
+
+private:
+	bool enabled;
+	CommandFollowers followers[SPECULATED_COMMANDS];
+	int step;				// Entry of the command that started the step, -1 for none
+	int asked;
+	char askedQueries[SPECULATED_QUERIES][RCVBUFSIZE];
+};
+
+#endif
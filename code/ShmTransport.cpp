@@ -0,0 +1,185 @@
+// Copy constructor and assignment operator are disabled: the mapping is owned
+// by exactly one transport and unmapped by its destructor.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ShmTransport.h"
+#include "lib/timing.h"
+
+#define SPIN_BEFORE_YIELD 2000	/* Busy polls before giving the CPU away while waiting */
+
+// Spinning only helps when the simulator runs on another CPU at the same
+// time. On a single CPU it just burns the time slice the simulator needs.
+static int spinLimit()
+{
+	static int limit = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? SPIN_BEFORE_YIELD : 0;
+	return limit;
+}
+
+ShmTransport::ShmTransport(int port, bool Owner)
+{
+	snprintf(name, sizeof(name), SHM_NAME, port);
+	owner = Owner;
+	generation = 0;
+	region = NULL;
+	outgoing = NULL;
+	incoming = NULL;
+}
+
+ShmTransport::~ShmTransport()
+{
+	close();
+}
+
+bool ShmTransport::open()
+{
+	close();
+
+	int fd = shm_open(name, owner ? (O_CREAT | O_RDWR) : O_RDWR, 0600);
+	if (fd < 0)
+	{
+		return false; // Simulator isn't running (yet)
+	}
+	if (owner && ftruncate(fd, sizeof(ShmRegion)) != 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	void* mapping = mmap(NULL, sizeof(ShmRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd); // The mapping keeps the memory alive
+	if (mapping == MAP_FAILED)
+	{
+		return false;
+	}
+
+	region = (ShmRegion*) mapping;
+	if (owner)
+	{
+		region->toSimulator.head.store(0);
+		region->toSimulator.tail.store(0);
+		region->toController.head.store(0);
+		region->toController.tail.store(0);
+		region->generation.store((unsigned int) getpid(), std::memory_order_release);
+		outgoing = &region->toController;
+		incoming = &region->toSimulator;
+	}
+	else
+	{
+		outgoing = &region->toSimulator;
+		incoming = &region->toController;
+	}
+
+	generation = region->generation.load(std::memory_order_acquire);
+	if (generation == 0)
+	{
+		close(); // Region exists, but the simulator already left
+		return false;
+	}
+
+	return true;
+}
+
+void ShmTransport::close()
+{
+	if (region != NULL)
+	{
+		if (owner)
+		{
+			// Tell the controller it has to reconnect, then remove the name.
+			region->generation.store(0, std::memory_order_release);
+			shm_unlink(name);
+		}
+		munmap(region, sizeof(ShmRegion));
+		region = NULL;
+		outgoing = NULL;
+		incoming = NULL;
+	}
+}
+
+bool ShmTransport::isOpen()
+{
+	return region != NULL;
+}
+
+bool ShmTransport::peerAlive()
+{
+	return region->generation.load(std::memory_order_acquire) == generation;
+}
+
+bool ShmTransport::send(const char data[], int size)
+{
+	if (region == NULL || size > SHM_RING_SIZE || !peerAlive())
+	{
+		return false;
+	}
+
+	unsigned int head = outgoing->head.load(std::memory_order_relaxed);
+
+	// Messages are tiny compared to the ring, only a stalled peer fills it.
+	int spins = 0;
+	while (SHM_RING_SIZE - (head - outgoing->tail.load(std::memory_order_acquire)) < (unsigned int) size)
+	{
+		if (!peerAlive())
+		{
+			return false;
+		}
+		if (++spins > spinLimit())
+		{
+			sched_yield();
+		}
+	}
+
+	for (int i = 0; i < size; i++)
+	{
+		outgoing->data[(head + i) & (SHM_RING_SIZE - 1)] = data[i];
+	}
+	outgoing->head.store(head + size, std::memory_order_release);
+
+	return true;
+}
+
+int ShmTransport::receive(char buffer[], int size, int timeoutMs)
+{
+	if (region == NULL)
+	{
+		return -1;
+	}
+
+	long long deadline = (timeoutMs >= 0) ? deadlineAfter(timeoutMs) : NO_DEADLINE;
+	unsigned int tail = incoming->tail.load(std::memory_order_relaxed);
+	unsigned int available = incoming->head.load(std::memory_order_acquire) - tail;
+
+	// Spin first, a co-located simulator usually answers within microseconds.
+	for (int spins = 0; available == 0; spins++)
+	{
+		if (spins >= spinLimit())
+		{
+			if (!peerAlive())
+			{
+				return -1; // Simulator restarted or left
+			}
+			if (deadlineExpired(deadline))
+			{
+				return 0;
+			}
+			sched_yield();
+		}
+		available = incoming->head.load(std::memory_order_acquire) - tail;
+	}
+
+	int count = (available < (unsigned int) size) ? available : size;
+	for (int i = 0; i < count; i++)
+	{
+		buffer[i] = incoming->data[(tail + i) & (SHM_RING_SIZE - 1)];
+	}
+	incoming->tail.store(tail + count, std::memory_order_release);
+
+	return count;
+}
@@ -0,0 +1,58 @@
+#ifndef SHMTRANSPORT_H_
+#define SHMTRANSPORT_H_
+
+#include <atomic>
+
+#include "Transport.h"
+
+#define SHM_RING_SIZE 4096	/* Bytes per direction, must be a power of two */
+
+// Byte ring with exactly one producer and one consumer. Head and tail are
+// free running counters on their own cache lines, so neither side ever
+// writes a line the other side writes.
+struct ShmRing
+{
+	std::atomic<unsigned int> head;	// Written by the producer only
+	char headPadding[60];
+	std::atomic<unsigned int> tail;	// Written by the consumer only
+	char tailPadding[60];
+	char data[SHM_RING_SIZE];
+};
+
+struct ShmRegion
+{
+	std::atomic<unsigned int> generation;	// Non-zero while the simulator side is alive
+	char generationPadding[60];
+	ShmRing toSimulator;
+	ShmRing toController;
+};
+
+// A pair of rings in shared memory, for a simulator running on the same
+// machine. The simulator creates the region (owner), the controller opens it.
+class ShmTransport : public Transport
+{
+public:
+	ShmTransport(int port, bool Owner);
+	~ShmTransport();
+
+	bool open();
+	void close();
+	bool isOpen();
+	bool send(const char data[], int size);
+	int receive(char buffer[], int size, int timeoutMs);
+
+private:
+	ShmTransport(const ShmTransport&);
+	ShmTransport& operator= (const ShmTransport&);
+
+	char name[32];
+	bool owner;
+	unsigned int generation; // Generation of the region when it was opened
+	ShmRegion* region;
+	ShmRing* outgoing;
+	ShmRing* incoming;
+
+	bool peerAlive();
+};
+
+#endif
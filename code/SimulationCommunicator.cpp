@@ -1,55 +1,507 @@
-// Destructor, copy constructor and assignment operator overloading is not
-// needed as this class does not contain allocated memory
+// Copy constructor and assignment operator are disabled: the transport is owned
+// by exactly one communicator and deleted by its destructor.
 
 #include <unistd.h>
 #include <string.h>
-#include <sys/types.h>
-#include <sys/socket.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
 #include <iostream>
 
 #include "SimulationCommunicator.h"
+#include "lib/auxiliary.h"
+#include "lib/timing.h"
 
-SimulationCommunicator::SimulationCommunicator(int port)
+static void deleteThreadExchange(void* own)
 {
-	sock = CreateTCPClientSocket (port);
+	delete (ThreadExchange*) own;
+}
+
+SimulationCommunicator::SimulationCommunicator(int Port)
+{
+	port = Port;
+	resyncing = false;
+	lastTimedOut = false;
+	pthread_key_create(&threadKey, &deleteThreadExchange);
+	listener = NULL;
+	jitterSeed = (unsigned int) (time(NULL) ^ (getpid() << 16) ^ Port);
+	echoBuffer[0] = '\0';
+	streamLength = 0;
+	repliesOwed = 0;
+
+	pthread_mutexattr_t recursive;
+	pthread_mutexattr_init(&recursive);
+	pthread_mutexattr_settype(&recursive, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&exchangeLock, &recursive);
+	pthread_mutexattr_destroy(&recursive);
+
+	transport = NULL; // Made by the first message, see openTransport()
 }
 
 SimulationCommunicator::~SimulationCommunicator()
 {
-	close(sock);
+	if (transport != NULL)
+	{
+		disconnect();
+		delete transport;
+	}
+	delete threadExchange(false); // Other threads' are gone with the key
+	pthread_key_delete(threadKey);
+	pthread_mutex_destroy(&exchangeLock);
+}
+
+void SimulationCommunicator::setConnectionListener(ConnectionListener* newListener)
+{
+	listener = newListener;
+}
+
+void SimulationCommunicator::setDeadline(long long newDeadline)
+{
+	// Lifting a deadline the thread never had needs no storage, which is
+	// what the emergency stop from a signal handler does on an idle thread.
+	ThreadExchange* own = threadExchange(newDeadline != NO_DEADLINE);
+	if (own != NULL)
+	{
+		own->deadline = newDeadline;
+	}
+}
+
+long long SimulationCommunicator::getDeadline()
+{
+	ThreadExchange* own = threadExchange(false);
+	return (own != NULL) ? own->deadline : NO_DEADLINE;
+}
+
+bool SimulationCommunicator::timedOut()
+{
+	ThreadExchange* own = threadExchange(false);
+	return own != NULL && own->timedOut;
+}
+
+ThreadExchange* SimulationCommunicator::threadExchange(bool create)
+{
+	ThreadExchange* own = (ThreadExchange*) pthread_getspecific(threadKey);
+	if (own == NULL && create)
+	{
+		own = new ThreadExchange;
+		own->deadline = NO_DEADLINE;
+		own->timedOut = false;
+		pthread_setspecific(threadKey, own);
+	}
+	return own;
+}
+
+void SimulationCommunicator::keepTimeout(bool create)
+{
+	// With exchangeLock held: the exchange that just ended was this thread's.
+	// Without create (the emergency stops, which may be sent from a signal
+	// handler) nothing is allocated, a thread with no storage yet has no
+	// operation that would ask.
+	ThreadExchange* own = threadExchange(create);
+	if (own != NULL)
+	{
+		own->timedOut = lastTimedOut;
+	}
+}
+
+int SimulationCommunicator::getPort()
+{
+	return port;
+}
+
+bool SimulationCommunicator::prepareExchange(BatchExchange& exchange, const char* const messages[], int count)
+{
+	// Only a connected socket with no half-read reply lying around can be
+	// handed over, anything else is sent the normal way. Nor while a reply
+	// is on its way: the emergency button pressed in on the thread waiting
+	// for it, the batch would take that reply for its first. Nor while
+	// another thread has the simulator, it may be reconnecting for seconds.
+	if (pthread_mutex_trylock(&exchangeLock) != 0)
+	{
+		return false;
+	}
+	openTransport();
+	// The batch holds emergency stops, no operation's deadline keeps them back.
+	if (!transport->isOpen() || transport->descriptor() < 0 || streamLength > 0 || repliesOwed > 0)
+	{
+		pthread_mutex_unlock(&exchangeLock);
+		return false;
+	}
+
+	exchange.fd = transport->descriptor();
+	exchange.request.clear();
+	for (int i = 0; i < count; i++)
+	{
+		exchange.request.append(messages[i]);
+	}
+	exchange.repliesExpected = count;
+	exchange.replies.clear();
+	exchange.complete = false;
+
+	return true;
+}
+
+void SimulationCommunicator::finishExchange(BatchExchange& exchange, std::string replies[])
+{
+	lastTimedOut = !exchange.complete;
+	keepTimeout(false);
+
+	unsigned int start = 0;
+	for (int i = 0; i < exchange.repliesExpected; i++)
+	{
+		replies[i].clear();
+		size_t end = exchange.replies.find(';', start);
+		if (end != std::string::npos)
+		{
+			replies[i] = exchange.replies.substr(start, end - start);
+			start = end + 1;
+		}
+	}
+
+	if (!exchange.complete)
+	{
+		// Replies still on their way would be taken for answers to the next
+		// messages, start over on a new connection.
+		std::cout << "Simulator on port " << port << " did not reply to a batch in time." << std::endl;
+		disconnect();
+	}
+	pthread_mutex_unlock(&exchangeLock);
 }
 
 char* SimulationCommunicator::sendMessage(const char message[])
+{
+	// The communicator's own buffers are the next thread's as soon as it
+	// is unlocked.
+	static __thread char reply[RCVBUFSIZE];
+	pthread_mutex_lock(&exchangeLock);
+	openTransport();
+	strcpy(reply, exchangeMessage(message, getDeadline()));
+	keepTimeout(true);
+	pthread_mutex_unlock(&exchangeLock);
+	return reply;
+}
+
+char* SimulationCommunicator::sendUrgent(const char message[])
+{
+	static __thread char reply[RCVBUFSIZE];
+	pthread_mutex_lock(&exchangeLock);
+	openTransport();
+	strcpy(reply, exchangeMessage(message, NO_DEADLINE));
+	keepTimeout(false);
+	pthread_mutex_unlock(&exchangeLock);
+	return reply;
+}
+
+char* SimulationCommunicator::sendPipelined(const char message[], const char* const queries[], int count, char replies[][RCVBUFSIZE])
+{
+	static __thread char reply[RCVBUFSIZE];
+	for (int i = 0; i < count; i++)
+	{
+		replies[i][0] = '\0';
+	}
+
+	pthread_mutex_lock(&exchangeLock);
+	openTransport();
+	std::string request(message);
+	for (int i = 0; i < count; i++)
+	{
+		request.append(queries[i]);
+	}
+
+	long long deadline = getDeadline();
+	lastTimedOut = deadlineExpired(deadline);
+	if (lastTimedOut)
+	{
+		reply[0] = '\0';
+		keepTimeout(true);
+		pthread_mutex_unlock(&exchangeLock);
+		return reply;
+	}
+
+	char* first = NULL;
+	int ahead = repliesOwed;
+	bool sent = false;
+	if (transport->isOpen() && sizeOfMessage(message) > 0)
+	{
+		repliesOwed += count + 1;
+		sent = transport->send(request.data(), request.size());
+		repliesOwed -= sent ? 0 : count + 1;
+	}
+	if (sent)
+	{
+		first = receiveMessage(ahead, deadline);
+	}
+	if (first == NULL)
+	{
+		// What is still on its way would be taken for the next replies.
+		// Then as exchangeMessage() does: give up on a late reply, or
+		// reconnect and send message again.
+		if (sent)
+		{
+			disconnect();
+		}
+		if (sent && (lastTimedOut || resyncing))
+		{
+			reply[0] = '\0';
+		}
+		else
+		{
+			strcpy(reply, exchangeMessage(message, deadline));
+		}
+		keepTimeout(true);
+		pthread_mutex_unlock(&exchangeLock);
+		return reply;
+	}
+
+	strcpy(reply, first);
+	for (int i = 0; i < count; i++)
+	{
+		char* queried = receiveMessage(ahead, deadline);
+		if (queried == NULL)
+		{
+			// Only the guesses are lost, message was answered.
+			disconnect();
+			lastTimedOut = false;
+			break;
+		}
+		strcpy(replies[i], queried);
+	}
+	keepTimeout(true);
+	pthread_mutex_unlock(&exchangeLock);
+	return reply;
+}
+
+char* SimulationCommunicator::exchangeMessage(const char message[], long long deadline)
 {
 	// std::cout << "[DBG] Message to send (SimulationCommunicator): " << message << std::endl;
+	lastTimedOut = deadlineExpired(deadline);
+	if (lastTimedOut)
+	{
+		echoBuffer[0] = '\0';
+		return echoBuffer;
+	}
+
+	int ahead = repliesOwed;
+	if (transport->isOpen() && transmit(message))
+	{
+		char* reply = receiveMessage(ahead, deadline);
+		if (reply != NULL)
+		{
+			return reply;
+		}
+	}
+
+	if (lastTimedOut || resyncing)
+	{
+		// No reply in time, or the connection dropped again while restoring state.
+		// A late reply would be mistaken for the answer to the next message, so
+		// the connection is dropped and the next message reconnects.
+		disconnect();
+		echoBuffer[0] = '\0';
+		return echoBuffer;
+	}
+
+	std::cout << "Connection to simulator on port " << port << " lost, reconnecting." << std::endl;
+	disconnect();
+
+	for (int attempt = 0; attempt < RECONNECT_MAX_ATTEMPTS; attempt++)
+	{
+		long long delay = backoffDelay(attempt);
+		long long remaining = deadlineRemaining(deadline);
+		if (remaining >= 0 && remaining < delay)
+		{
+			// The operation would run out of time while waiting for the simulator.
+			pthread_mutex_unlock(&exchangeLock);
+			sleepMs(remaining);
+			pthread_mutex_lock(&exchangeLock);
+			lastTimedOut = true;
+			echoBuffer[0] = '\0';
+			return echoBuffer;
+		}
+		// Not held through the wait, the emergency stops to the other
+		// sluices must not queue up behind it. Whoever sent meanwhile may
+		// have reconnected already.
+		pthread_mutex_unlock(&exchangeLock);
+		sleepMs(delay);
+		pthread_mutex_lock(&exchangeLock);
+
+		if (!transport->isOpen() && !reconnect())
+		{
+			continue;
+		}
+
+		// Now that the interrupted message can be resent, retry it.
+		ahead = repliesOwed;
+		if (transport->isOpen() && transmit(message))
+		{
+			char* reply = receiveMessage(ahead, deadline);
+			if (reply != NULL)
+			{
+				return reply;
+			}
+		}
+		disconnect();
+
+		if (lastTimedOut)
+		{
+			echoBuffer[0] = '\0';
+			return echoBuffer;
+		}
+	}
+
+	std::cout << "Error sending message: simulator on port " << port << " unreachable\n";
+	echoBuffer[0] = '\0';
+	return echoBuffer;
+}
+
+void SimulationCommunicator::openTransport()
+{
+	// Not in the constructor: the sluices in main.cpp are built before the
+	// options are parsed, -c would never be seen. A simulator that isn't
+	// running yet is not fatal, the message keeps trying to connect.
+	if (transport != NULL)
+	{
+		return;
+	}
+	transport = createTransport(parseTransportType(argv_transport), port);
+	if (!transport->open())
+	{
+		std::cout << "Unable to connect to simulator on port " << port << ", will retry." << std::endl;
+	}
+}
+
+bool SimulationCommunicator::transmit(const char message[])
+{
 	int size = sizeOfMessage(message);
 	// std::cout << "[DBG] Size: " << size << std::endl;
-	// std::cout << "Sending to: " << sock << std::endl;
+	if (size <= 0)
+	{
+		return false;
+	}
+	repliesOwed++; // Before it goes out, a press right after must see it
+	if (!transport->send(message, size))
+	{
+		repliesOwed--;
+		return false;
+	}
+	return true;
+}
+
+char* SimulationCommunicator::receiveMessage(int ahead, long long deadline)
+{
+	// Replies end in a semicolon. Bytes may arrive split over several reads or
+	// with more than one reply in a read, so keep reading until one is complete.
+	// The first ahead replies belong to an exchange this one interrupted, and
+	// stay in the buffer for it.
+	while (true)
+	{
+		int start = 0;
+		int skipped = 0;
+		for (int i = 0; i < streamLength; i++)
+		{
+			if (streamBuffer[i] == ';' && skipped < ahead)
+			{
+				skipped++;
+				start = i + 1;
+			}
+			else if (streamBuffer[i] == ';')
+			{
+				// Copy the reply without the semicolon, keep whatever is around it.
+				int size = (i - start < RCVBUFSIZE) ? i - start : RCVBUFSIZE - 1;
+				memcpy(echoBuffer, streamBuffer + start, size);
+				echoBuffer[size] = '\0';
+				memmove(streamBuffer + start, streamBuffer + i + 1, streamLength - i - 1);
+				streamLength -= i + 1 - start;
+				repliesOwed--;
+				// std::cout << "[DBG] Message received: " << echoBuffer << std::endl;
+				return echoBuffer;
+			}
+		}
+
+		if (streamLength == STREAMBUFSIZE)
+		{
+			return NULL; // Garbage without any semicolons, start over on a new connection
+		}
+
+		int received = transport->receive(streamBuffer + streamLength, STREAMBUFSIZE - streamLength, replyTimeout(deadline));
+		if (received == -2)
+		{
+			continue; // Interrupted, the reply may be in the buffer now
+		}
+		else if (received == 0)
+		{
+			std::cout << "Simulator on port " << port << " did not reply in time." << std::endl;
+			lastTimedOut = true;
+			return NULL;
+		}
+		else if (received < 0)
+		{
+			return NULL; // The connection is broken
+		}
+		streamLength += received;
+	}
+}
 
-	if(send(sock, message, size, 0) < 0)
+int SimulationCommunicator::replyTimeout(long long deadline)
+{
+	// The shortest of the reply timeout (-t) and what is left of the operation's deadline.
+	// -1 makes poll() wait forever, as recv() used to.
+	long long timeout = (argv_timeout > 0) ? argv_timeout * 1000LL : -1;
+	long long remaining = deadlineRemaining(deadline);
+
+	if (remaining >= 0 && (timeout < 0 || remaining < timeout))
 	{
-		std::cout << "Error sending message\n";
-		return NULL;
+		timeout = remaining;
 	}
 
-	return receiveMessage();
+	return (int) timeout;
 }
 
-char* SimulationCommunicator::receiveMessage()
+bool SimulationCommunicator::reconnect()
 {
-	for (int j = 0; j < RCVBUFSIZE; ++j)
+	if (!transport->open())
 	{
-		echoBuffer[j] = '\0';
+		return false;
 	}
 
-	if (recv(sock, echoBuffer, RCVBUFSIZE, 0) >= 0)
+	std::cout << "Reconnected to simulator on port " << port << "." << std::endl;
+
+	if (listener != NULL)
 	{
-		int size = sizeOfMessage(echoBuffer);
-		echoBuffer[size-1] = '\0'; // Remove the semicolon at the end of the received message
-		// std::cout << "[DBG] Message received: " << echoBuffer << std::endl;
-		return echoBuffer;
+		// The simulator may have restarted and lost everything we told it,
+		// restore that before the interrupted message is retried.
+		resyncing = true;
+		listener->connectionRestored();
+		resyncing = false;
 	}
-	return NULL;
+
+	// The listener's messages may have dropped the connection again.
+	return transport->isOpen();
+}
+
+void SimulationCommunicator::disconnect()
+{
+	transport->close();
+	streamLength = 0; // Half a reply from the old connection is worthless
+	repliesOwed = 0;
+}
+
+long long SimulationCommunicator::backoffDelay(int attempt)
+{
+	// Exponential backoff with jitter, so several controllers (or several
+	// sluices of one controller) don't all hammer a restarting simulator at once.
+	int delay = RECONNECT_BASE_DELAY_MS;
+	for (int i = 0; i < attempt && delay < RECONNECT_MAX_DELAY_MS; i++)
+	{
+		delay *= 2;
+	}
+	if (delay > RECONNECT_MAX_DELAY_MS)
+	{
+		delay = RECONNECT_MAX_DELAY_MS;
+	}
+
+	// Wait somewhere between half and the full delay.
+	return delay / 2 + rand_r(&jitterSeed) % (delay / 2 + 1);
 }
 
 int SimulationCommunicator::sizeOfMessage(const char message[])
@@ -69,4 +521,4 @@ int SimulationCommunicator::sizeOfMessage(const char message[])
 
     // Message was not NULL terminated correctly, return error
     return -1;
-}
\ No newline at end of file
+}
@@ -1,10 +1,35 @@
 #ifndef SIMULATIONCOMMUNICATOR_H_
 #define SIMULATIONCOMMUNICATOR_H_ 
 
-#include "lib/createTCPClientSocket.h"		// Used to create the TCP client socket
+#include <pthread.h>
+#include <string>
+
+#include "Transport.h"
+#include "BatchIO.h"
 #include "lib/enums.h"
 
 #define RCVBUFSIZE 32   /* Size of receive buffer */
+#define STREAMBUFSIZE 256	/* Received bytes not yet split into messages */
+
+#define RECONNECT_BASE_DELAY_MS 100		/* First backoff delay after a dropped connection */
+#define RECONNECT_MAX_DELAY_MS 5000		/* Backoff delays never grow beyond this */
+#define RECONNECT_MAX_ATTEMPTS 20		/* Give up on a message after this many failed reconnects */
+
+// Implemented by whoever needs to restore simulator state after the
+// connection was lost and a new one has been established.
+class ConnectionListener
+{
+public:
+	virtual ~ConnectionListener() {}
+	virtual void connectionRestored() = 0;
+};
+
+// A thread's own part of a communicator.
+struct ThreadExchange
+{
+	long long deadline;	// NO_DEADLINE if there is none
+	bool timedOut;		// Its last message got no reply before its timeout or the deadline
+};
 
 class SimulationCommunicator
 {
@@ -12,15 +37,67 @@ public:
 	SimulationCommunicator(int port);
 	~SimulationCommunicator();
 
+	// Never returns NULL: when the simulator can't be reached or doesn't reply
+	// in time, an empty message is returned. Threads take turns, the reply
+	// is in a buffer of the calling thread's own.
 	char* sendMessage(const char message[]);
+	// As sendMessage(), but never held to an operation's deadline: for the
+	// emergency stops, which have to go out however late the operation is.
+	char* sendUrgent(const char message[]);
+	// message and the queries in one write, their replies read back in
+	// order: the queries cost no round trip of their own. A query without
+	// a reply gets an empty one in replies. When message itself gets none
+	// it goes again the way sendMessage() sends it.
+	char* sendPipelined(const char message[], const char* const queries[], int count, char replies[][RCVBUFSIZE]);
+	void setConnectionListener(ConnectionListener* newListener);
+	// The deadline of the operation the calling thread runs on this
+	// simulator, every thread has its own. Its messages get no reply
+	// after it, and are not sent at all once it has passed.
+	void setDeadline(long long newDeadline);
+	long long getDeadline();
+	bool timedOut();
+	int getPort();
+
+	// Used by BatchIO to send several messages in one write, possibly along
+	// with other simulators, and to take the replies back. No other thread
+	// sends from a successful prepareExchange() until finishExchange().
+	// false while this thread waits for a reply (the emergency button's
+	// handler), those messages go one at a time behind that reply, and
+	// while another thread is in the middle of an exchange, never waiting
+	// for it: those go once the batch is done.
+	bool prepareExchange(BatchExchange& exchange, const char* const messages[], int count);
+	void finishExchange(BatchExchange& exchange, std::string replies[]);
 
 private:
-	// int port; <- Maybe not used since the auxiliary handles this?
-	int sock; // Socket descriptor
+	SimulationCommunicator(const SimulationCommunicator&);
+	SimulationCommunicator& operator= (const SimulationCommunicator&);
+
+	int port;
+	Transport* transport;	// NULL until the first message
+	bool resyncing; // True while the listener is restoring state after a reconnect
+	bool lastTimedOut; // The exchange under way got no reply in time, kept by the thread once it is done
+	pthread_key_t threadKey; // Each thread's ThreadExchange, NULL until it needs one
+	unsigned int jitterSeed;
+	ConnectionListener* listener;
 	char echoBuffer[RCVBUFSIZE];
+	char streamBuffer[STREAMBUFSIZE];
+	int streamLength;
+	volatile int repliesOwed;	// Asked for on this connection and not read yet
+	// Held for a whole message and reply. Recursive, as the emergency
+	// button may press in on the thread that is waiting for a reply.
+	pthread_mutex_t exchangeLock;
 
+	void openTransport();
+	ThreadExchange* threadExchange(bool create);
+	void keepTimeout(bool create);
+	char* exchangeMessage(const char message[], long long deadline);
 	int sizeOfMessage(const char message[]);
-	char* receiveMessage();	
+	bool transmit(const char message[]);
+	char* receiveMessage(int ahead, long long deadline);
+	int replyTimeout(long long deadline);
+	bool reconnect();
+	void disconnect();
+	long long backoffDelay(int attempt);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,5 +1,6 @@
-// Destructor, copy constructor and assignment operator overloading is not
-// needed as this class does not contain allocated memory
+// Copy constructor and assignment operator are disabled: the sluice owns its
+// state file mapping, and through its CommunicationHandler a status board
+// slot and an eventfd, none of which two copies could share.
 
 #include "Sluice.h"
 #include "CommunicationHandler.h"
@@ -7,167 +8,465 @@
 #include "Door.h"
 #include "lib/enums.h"
 #include "lib/returnValues.h"
+#include "lib/auxiliary.h"
+#include "lib/timing.h"
 
-Sluice::Sluice(int port)
-	: cHandler(port)
-	, leftDoor(cHandler, (port==5557) ? fastLock : noLock, left)
-	, rightDoor(cHandler, (port==5557) ? fastLock : noLock, right)
+// Gives an operation its deadline (-o) and keeps track of which operation is
+// running, for as long as it runs. An operation started from within another
+// one (a restore after an emergency) gets a fresh deadline, the outer one is
+// put back afterwards.
+class OperationScope
 {
+public:
+	OperationScope(CommunicationHandler& handler, SluiceState& operation)
+		: cHandler(handler)
+		, current(operation)
+	{
+		previousDeadline = cHandler.getDeadline();
+		previousOperation = current;
+		cHandler.setDeadline((argv_optimeout > 0) ? deadlineAfter(argv_optimeout * 1000LL) : NO_DEADLINE);
+	}
+
+	~OperationScope()
+	{
+		cHandler.setDeadline(previousDeadline);
+		current = previousOperation;
+		cHandler.publishStatus();
+	}
+
+private:
+	CommunicationHandler& cHandler;
+	SluiceState& current;
+	long long previousDeadline;
+	SluiceState previousOperation;
+};
 
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::BasicSluice(int Port)
+	: cHandler(Port)
+	, leftDoor(cHandler, left)
+	, rightDoor(cHandler, right)
+{
+	port = Port;
+	state = &ownState;
+	state->magic = 0;
+	state->emergency = false;
+	state->operation = waitingForCommand;
+	state->door = left;
+	state->checkpoint.phase = waitingForCommand;
+	doorTravelMs = 0;
+	cancelTime = NO_DEADLINE;
+	resuming = false;
+	resumed = success;
+	levelling = false;
+	watchedBand = waterError;
+	cHandler.watchOperation(&state->operation, &state->emergency);
 }
 
-Sluice::~Sluice()
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::~BasicSluice()
 {
 
 }
 
-void Sluice::passInterrupt()
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+int BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::passInterrupt()
 {
-	leftDoor.interruptReaction();
-	rightDoor.interruptReaction();
-
-	if (!emergency)
+	int rtnval = success;
+	if (!state->emergency)
 	{
 		// Emergency situation triggered
-		emergency = true;
+		state->emergency = true;
+		leftDoor.setInterrupted(true);
+		rightDoor.setInterrupted(true);
+		cHandler.cancelWaits();
+		emergencyStop();
 	}
 	else
 	{
 		// Restore triggered
-		switch(stateBeforeEmergency)
+		resuming = true;
+		leftDoor.setInterrupted(false);
+		rightDoor.setInterrupted(false);
+		state->emergency = false;
+		rtnval = resume();
+		resumed = rtnval;
+		resuming = false;
+	}
+	cHandler.publishStatus();
+	return rtnval;
+}
+
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+int BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::recover()
+{
+	PersistedState* stored = (PersistedState*) stateFile.open(port, sizeof(PersistedState));
+	if (stored == NULL)
+	{
+		return success; // Nothing is kept without a state directory
+	}
+
+	bool pending = stored->magic == STATE_MAGIC && (stored->emergency || stored->operation != waitingForCommand);
+	int rtnval = success;
+	if (pending && !CommunicationHandler::agreesWith(stored->commanded, cHandler.readSnapshot()))
+	{
+		// Someone else moved things since, or the simulator restarted too.
+		pending = false;
+		rtnval = stateDiscarded;
+	}
+
+	if (!pending)
+	{
+		// Start the file over from what this run knows.
+		*stored = *state;
+		stored->magic = STATE_MAGIC;
+		stored->operation = waitingForCommand;
+		stored->emergency = false;
+		cHandler.keepCommandedIn(&stored->commanded, false);
+		state = stored;
+		cHandler.watchOperation(&state->operation, &state->emergency);
+		return rtnval;
+	}
+
+	state = stored;
+	cHandler.keepCommandedIn(&state->commanded, true);
+	cHandler.watchOperation(&state->operation, &state->emergency);
+	if (state->emergency)
+	{
+		// Stopped by the button, and it stays that way until it is pressed again.
+		leftDoor.setInterrupted(true);
+		rightDoor.setInterrupted(true);
+		return interruptReceived;
+	}
+
+	// The restart cut the operation short, but whatever the simulator was
+	// told is still going on: carry on from there.
+	CommandedState told = cHandler.getCommanded();
+	state->checkpoint.phase = state->operation;
+	for (int side = 0; side < 2; side++)
+	{
+		DoorState motion = told.doorMotion[side];
+		state->checkpoint.doorMotion[side] = (motion == doorOpening || motion == doorClosing) ? motion : doorStateError;
+		for (int row = 0; row < 3; row++)
 		{
-			case sluicingUp:
-				// Start itself handles the difference between up and down.
-				start();
-				break;
-			case sluicingDown:
-				// Start itself handles the difference between up and down.
-				start();
-				break;
-			case allowingEntry:
-				allowEntry();
-				break;
-			case allowingExit:
-				allowExit();
-				break;
-			case waitingForCommand:
-				// Do nothing
-				break;
+			state->checkpoint.valvesOpen[side][row] = told.valves[side][row] == commandedOn;
 		}
-		emergency = false;
 	}
+	state->checkpoint.doorOpened = false; // Told to open is caught moving here
+	for (int location = 0; location < 4; location++)
+	{
+		state->checkpoint.lights[location] = told.lights[location];
+	}
+	state->operation = waitingForCommand;
+	return resume();
+}
+
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+bool BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::addEmergencyStop(BatchTarget& target)
+{
+	if (state->emergency)
+	{
+		return false;
+	}
+
+	state->emergency = true;
+	leftDoor.setInterrupted(true);
+	rightDoor.setInterrupted(true);
+	takeCheckpoint();
+	cHandler.addEmergencyStop(target);	// Publishes the stop as well
+	cHandler.cancelWaits();				// The sluice's own thread may be waiting to poll
+	return true;
+}
+
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+bool BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::stopped()
+{
+	return state->emergency || resuming;
 }
 
-bool Sluice::closeValves(DoorSide side)
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+int BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::lastResume()
 {
-	if (side == left)
+	return resumed;
+}
+
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+void BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::takeCheckpoint()
+{
+	// Note down what was going on from what was commanded, nothing is
+	// asked of the simulator: every message here delays the stop.
+	Door<LockPolicy, MotorPolicy>* doors[2] = { &leftDoor, &rightDoor };
+	int opened = cHandler.commandedValves();
+
+	state->checkpoint.phase = state->operation;
+	state->checkpoint.doorOpened = cHandler.getCommanded().doorMotion[state->door] == doorOpening
+		&& doors[state->door]->getMotion() == doorStateError;
+	for (int side = 0; side < 2; side++)
 	{
-		if(leftDoor.topValves.getValveRowOpened())
+		state->checkpoint.doorMotion[side] = doors[side]->getMotion();
+		for (int row = 1; row <= 3; row++)
 		{
-			if (!leftDoor.topValves.closeValveRow())
-			{
-				return false; // Failed to close valves: simulator did not acknowledge message
-			}
+			state->checkpoint.valvesOpen[side][row - 1] = (opened & (1 << (side * 3 + row - 1))) != 0;
 		}
-		if(leftDoor.middleValves.getValveRowOpened())
+	}
+	for (int location = 1; location <= 4; location++)
+	{
+		state->checkpoint.lights[location - 1] = cHandler.commandedLight(location);
+	}
+}
+
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+void BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::emergencyStop()
+{
+	// Stop only what moves: doors that were sent somewhere and valves that
+	// were opened. However late the interrupted operation is, the stops go out.
+	long long operationDeadline = cHandler.getDeadline();
+	cHandler.setDeadline(NO_DEADLINE);
+	takeCheckpoint();
+	for (int side = 0; side < 2; side++)
+	{
+		if (state->checkpoint.doorMotion[side] != doorStateError)
 		{
-			if (!leftDoor.middleValves.closeValveRow())
+			cHandler.stopDoor((DoorSide) side);
+		}
+		for (int row = 1; row <= 3; row++)
+		{
+			if (state->checkpoint.valvesOpen[side][row - 1])
 			{
-				return false; // Failed to close valves: simulator did not acknowledge message
+				cHandler.valveClose((DoorSide) side, row);
 			}
 		}
-		if(leftDoor.bottomValves.getValveRowOpened())
+	}
+	cHandler.setDeadline(operationDeadline);
+}
+
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+int BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::resume()
+{
+	// Pick up from the checkpoint: put back what the stop undid, then let
+	// the interrupted operation finish.
+	OperationScope scope(cHandler, state->operation);
+	state->operation = state->checkpoint.phase;
+	doorTravelMs = 0;
+
+	Door<LockPolicy, MotorPolicy>* doors[2] = { &leftDoor, &rightDoor };
+	if (state->checkpoint.phase == sluicingUp || state->checkpoint.phase == sluicingDown)
+	{
+		// No valve opens before the door on the low side is closed, like
+		// start() sees to. The stop may have caught that door before it was
+		// sent, or half way.
+		DoorSide lowSide = (state->checkpoint.phase == sluicingUp) ? left : right;
+		DoorState doorState = cHandler.getDoorState(lowSide);
+		if (doorState != doorClosed && doorState != doorLocked)
 		{
-			if (!leftDoor.bottomValves.closeValveRow())
+			int rtnval = doors[lowSide]->closeDoor();
+			doorTravelMs = doors[lowSide]->getTravelMs();
+			if (rtnval != success)
 			{
-				return false; // Failed to close valves: simulator did not acknowledge message
+				return rtnval;
 			}
+			doorState = cHandler.getDoorState(lowSide);
 		}
+		if (doorState != doorClosed && doorState != doorLocked)
+		{
+			return incorrectDoorState;
+		}
+		state->checkpoint.doorMotion[lowSide] = doorStateError; // Nothing left to resume there
 	}
-	else // side == right
+
+	for (int side = 0; side < 2; side++)
 	{
-		if(rightDoor.topValves.getValveRowOpened())
+		for (int row = 1; row <= 3; row++)
 		{
-			if (!rightDoor.topValves.closeValveRow())
+			bool isOpen = (cHandler.commandedValves() & (1 << (side * 3 + row - 1))) != 0;
+			if (state->checkpoint.valvesOpen[side][row - 1] && !isOpen && !cHandler.valveOpen((DoorSide) side, row))
 			{
-				return false; // Failed to close valves: simulator did not acknowledge message
+				return failure();
 			}
 		}
-		if(rightDoor.middleValves.getValveRowOpened())
+	}
+
+	// The stop leaves the lights alone, they only need setting when
+	// something else changed them in the meantime.
+	for (int location = 1; location <= 4; location++)
+	{
+		LightState wanted = state->checkpoint.lights[location - 1];
+		if (wanted == lightError || cHandler.commandedLight(location) == wanted)
+		{
+			continue;
+		}
+		int rtnval = (wanted == greenLightOn) ? cHandler.greenLight(location) : cHandler.redLight(location);
+		if (rtnval != success)
 		{
-			if (!rightDoor.middleValves.closeValveRow())
+			return failure();
+		}
+	}
+
+	for (int side = 0; side < 2; side++)
+	{
+		if (state->checkpoint.doorMotion[side] != doorStateError)
+		{
+			int rtnval = doors[side]->resumeMove(state->checkpoint.doorMotion[side]);
+			doorTravelMs = doors[side]->getTravelMs();
+			if (rtnval != success)
 			{
-				return false; // Failed to close valves: simulator did not acknowledge message
+				return rtnval;
 			}
 		}
-		if(rightDoor.bottomValves.getValveRowOpened())
+	}
+
+	switch (state->checkpoint.phase)
+	{
+		case sluicingUp:
+			return sluiceUp(waterError);
+		case sluicingDown:
+			return sluiceDown(waterError);
+		case allowingEntry:
+		case allowingExit:
+		{
+			// No need to ask where the water is, it picked the door.
+			int rtnval = doors[state->door]->resumePassage(state->checkpoint.phase == allowingEntry,
+				state->checkpoint.doorOpened || state->checkpoint.doorMotion[state->door] == doorOpening);
+			doorTravelMs = doors[state->door]->getTravelMs();
+			return rtnval;
+		}
+		case waitingForCommand:
+			break;
+	}
+	return success;
+}
+
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+bool BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::closeValves(DoorSide side)
+{
+	Door<LockPolicy, MotorPolicy>& door = (side == left) ? leftDoor : rightDoor;
+	int rows = 0;
+	if (door.topValves.getValveRowOpened())
+	{
+		rows |= 1 << 2;
+	}
+	if (door.middleValves.getValveRowOpened())
+	{
+		rows |= 1 << 1;
+	}
+	if (door.bottomValves.getValveRowOpened())
+	{
+		rows |= 1 << 0;
+	}
+
+	// All the open ones in one go, false when the simulator did not
+	// acknowledge closing one of them even the second time.
+	return cHandler.valvesClose(side, rows);
+}
+
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+int BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::outOfTime(DoorSide side)
+{
+	// The operation's deadline passed with the water still moving: close the
+	// valves on side all the same, like emergencyStop() does, and say so.
+	long long operationDeadline = cHandler.getDeadline();
+	cHandler.setDeadline(NO_DEADLINE);
+	closeValves(side);
+	cHandler.setDeadline(operationDeadline);
+	return timeoutExpired;
+}
+
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+bool BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::openValves(DoorSide side, WaterLevel currentWLevel)
+{
+	// Open what the valve policy wants of the rows the water level allows.
+	// Rows are never closed here, that happens once the water is level.
+	Door<LockPolicy, MotorPolicy>& door = (side == left) ? leftDoor : rightDoor;
+	ValveRow* rows[3] = { &door.bottomValves, &door.middleValves, &door.topValves };
+	int opened = cHandler.commandedValves();
+
+	for (int row = 1; row <= 3; row++)
+	{
+		bool isOpen = (opened & (1 << (side * 3 + row - 1))) != 0;
+		if (!isOpen && valveRowAllowed(row, currentWLevel) && ValvePolicy::wantRow(side, row, currentWLevel))
 		{
-			if (!rightDoor.bottomValves.closeValveRow())
+			if (!rows[row - 1]->openValveRow())
 			{
-				return false; // Failed to close valves: simulator did not acknowledge message
+				return false; // Message was not acknowledged by the simulator
 			}
 		}
 	}
-
-	// If this point is reached, sluice succeeded in closing all valves where necessary.
 	return true;
 }
 
-int Sluice::sluiceUp(WaterLevel currentWLevel)
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+void BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::waitForWater(WaterLevel currentWLevel)
+{
+	// Wait until the water is about to reach the next band, but never past
+	// the operation's deadline or the lockage being cancelled. The emergency
+	// button and cancelAt() cut the wait short.
+	long long wait = waterEstimate.observe(currentWLevel, cHandler.commandedValves());
+	long long remaining = levelling ? deadlineRemaining(cancelTime) : -1;
+	if (remaining >= 0 && remaining < wait)
+	{
+		wait = remaining;
+	}
+	cHandler.waitUntil(monotonicMs() + wait);
+}
+
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+bool BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::waterStalled(WaterLevel currentWLevel)
 {
+	// Progress is the water getting into the next band, which should take
+	// about as long as it usually stays in this one with these valves.
+	if (currentWLevel != watchedBand)
+	{
+		watchedBand = currentWLevel;
+		waterWatchdog.progress(waterEstimate.getBandMs(currentWLevel, cHandler.commandedValves()));
+	}
+	return waterWatchdog.stalled();
+}
+
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+int BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::sluiceUp(WaterLevel currentWLevel)
+{
+	waterEstimate.startWatching();
+	watchedBand = waterError;
 	do
 	{
 		currentWLevel = cHandler.getWaterLevel();
-		switch(currentWLevel)
+		if (currentWLevel == waterError)
 		{
-			case low:
-				if(!rightDoor.bottomValves.getValveRowOpened())
-				{
-					if (!rightDoor.bottomValves.openValveRow())
-					{
-						return noAckReceived;
-					}
-				}
-				break;
-			case belowValve2:
-				// Can't use one case for two possiblities, but these actually have the same consequences.
-				if(!rightDoor.bottomValves.getValveRowOpened())
-				{
-					if (!rightDoor.bottomValves.openValveRow())
-					{
-						return noAckReceived;
-					}
-				}
-				break;
-			case aboveValve2:
-				if(!rightDoor.middleValves.getValveRowOpened())
-				{
-					if (!rightDoor.middleValves.openValveRow())
-					{
-						return noAckReceived;
-					}
-				}
-				break;
-			case aboveValve3:
-				if(!rightDoor.topValves.getValveRowOpened())
-				{
-					if (!rightDoor.topValves.openValveRow())
-					{
-						return noAckReceived;
-					}
-				}
-				break;
-			case high:
-				// Nothing to do here, about to break out of the while loop.
-				break;
-			case waterError:
-				// Can't go on with incorrect data.
-				return incorrectWaterLevel;
+			// Can't go on with incorrect data.
+			return cHandler.timedOut() ? outOfTime(right) : incorrectWaterLevel;
+		}
+		else if (currentWLevel != high && !openValves(right, currentWLevel))
+		{
+			return failure();
 		}
-	} while (currentWLevel != high && !emergency);
+
+		if (cHandler.timedOut())
+		{
+			return outOfTime(right); // Water did not reach the top before the operation's deadline
+		}
+		if (currentWLevel != high && waterStalled(currentWLevel))
+		{
+			// The valves are open and the water does not rise.
+			return closeValves(right) ? operationStalled : failure();
+		}
+		if (currentWLevel != high && !state->emergency && !cancelled())
+		{
+			waitForWater(currentWLevel);
+		}
+	} while (currentWLevel != high && !state->emergency && !cancelled());
 
 	if (currentWLevel != high)
 	{
+		if (cancelled())
+		{
+			// Leave the water where it is now.
+			return closeValves(right) ? operationCancelled : failure();
+		}
+		if (cHandler.commandedValves() & (7 << (right * 3)))
+		{
+			// Opened after the emergency stop closed the others.
+			closeValves(right);
+		}
 		return interruptReceived;
 	}
 	else
@@ -175,29 +474,57 @@ int Sluice::sluiceUp(WaterLevel currentWLevel)
 		// After finishing the process, close all valves.
 		if (!closeValves(right))
 		{
-			return noAckReceived;
+			return failure();
 		}
 
 		return success;
 	}
 }
 
-int Sluice::sluiceDown(WaterLevel currentWLevel)
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+int BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::sluiceDown(WaterLevel currentWLevel)
 {
-	leftDoor.bottomValves.openValveRow();
-
+	waterEstimate.startWatching();
+	watchedBand = waterError;
 	do
 	{
 		currentWLevel = cHandler.getWaterLevel();
 		if (currentWLevel == waterError)
 		{
 			// Can't go on with incorrect data.
-			return incorrectWaterLevel;
+			return cHandler.timedOut() ? outOfTime(left) : incorrectWaterLevel;
+		}
+		else if (currentWLevel != low && !openValves(left, currentWLevel))
+		{
+			return failure();
+		}
+		else if (cHandler.timedOut())
+		{
+			return outOfTime(left); // Water did not reach the bottom before the operation's deadline
 		}
-	} while (currentWLevel != low && !emergency);
+		else if (currentWLevel != low && waterStalled(currentWLevel))
+		{
+			// The valves are open and the water does not drop.
+			return closeValves(left) ? operationStalled : failure();
+		}
+		if (currentWLevel != low && !state->emergency && !cancelled())
+		{
+			waitForWater(currentWLevel);
+		}
+	} while (currentWLevel != low && !state->emergency && !cancelled());
 
 	if (currentWLevel != low)
 	{
+		if (cancelled())
+		{
+			// Leave the water where it is now.
+			return closeValves(left) ? operationCancelled : failure();
+		}
+		if (cHandler.commandedValves() & (7 << (left * 3)))
+		{
+			// Opened after the emergency stop closed the others.
+			closeValves(left);
+		}
 		return interruptReceived;
 	}
 	else
@@ -205,28 +532,36 @@ int Sluice::sluiceDown(WaterLevel currentWLevel)
 		// After finishing the process, close all valves.
 		if (!closeValves(left))
 		{
-			return noAckReceived;
+			return failure();
 		}
 		
 		return success;
 	}
 }
 
-int Sluice::start()
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+int BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::start()
 {
+	OperationScope scope(cHandler, state->operation);
+	doorTravelMs = 0;
 	WaterLevel currentWLevel = cHandler.getWaterLevel();
-	if (!emergency)
+	if (currentWLevel == waterError && cHandler.timedOut())
+	{
+		return timeoutExpired;
+	}
+	if (!state->emergency)
 	{
 		int rtnval;
 
 		switch(currentWLevel)
 		{
 			case low:
-				stateBeforeEmergency = sluicingUp;
+				state->operation = sluicingUp;
 
 				if (cHandler.getDoorState(left) == doorOpen)
 				{
 					rtnval = leftDoor.closeDoor();
+					doorTravelMs = leftDoor.getTravelMs();
 					if (rtnval != success)
 					{
 						// Don't continue if we can't close the door.
@@ -244,10 +579,11 @@ int Sluice::start()
 				break;
 
 			case high:
-				stateBeforeEmergency = sluicingDown;
+				state->operation = sluicingDown;
 				if (cHandler.getDoorState(right) == doorOpen)
 				{
 					rtnval = rightDoor.closeDoor();
+					doorTravelMs = rightDoor.getTravelMs();
 					if (rtnval != success)
 					{
 						// Don't continue if we can't close the door.
@@ -272,38 +608,39 @@ int Sluice::start()
 	}
 	else
 	{
-		// There was an emergency, which means there should be an old state to restore to.
-
-		if (stateBeforeEmergency == sluicingUp)
-		{
-			return sluiceUp(currentWLevel);
-		}
-		else if (stateBeforeEmergency == sluicingDown)
-		{
-			return sluiceDown(currentWLevel);
-		}
-		else
-		{
-			// There was no state to restore to. Start may have been called while an emergency was going on.
-			return invalidCall;
-		}
+		// Nothing moves until the emergency is over, the second press picks
+		// up where the first one stopped.
+		return invalidCall;
 	}
 
 	return workInProgress;
 }
 
-int Sluice::allowEntry()
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+int BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::allowEntry()
 {
+	OperationScope scope(cHandler, state->operation);
+	doorTravelMs = 0;
 	WaterLevel currentWLevel = cHandler.getWaterLevel();
+	if (currentWLevel == waterError && cHandler.timedOut())
+	{
+		return timeoutExpired;
+	}
 	if (currentWLevel == low)
 	{
-		stateBeforeEmergency = allowingEntry;
-		return leftDoor.allowEntry();
+		state->operation = allowingEntry;
+		state->door = left;
+		int rtnval = leftDoor.allowEntry();
+		doorTravelMs = leftDoor.getTravelMs();
+		return rtnval;
 	}
 	else if (currentWLevel == high)
 	{
-		stateBeforeEmergency = allowingEntry;
-		return rightDoor.allowEntry();
+		state->operation = allowingEntry;
+		state->door = right;
+		int rtnval = rightDoor.allowEntry();
+		doorTravelMs = rightDoor.getTravelMs();
+		return rtnval;
 	}
 	else
 	{
@@ -311,21 +648,145 @@ int Sluice::allowEntry()
 	}
 }
 
-int Sluice::allowExit()
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+int BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::allowExit()
 {
+	OperationScope scope(cHandler, state->operation);
+	doorTravelMs = 0;
 	WaterLevel currentWLevel = cHandler.getWaterLevel();
+	if (currentWLevel == waterError && cHandler.timedOut())
+	{
+		return timeoutExpired;
+	}
 	if (currentWLevel == low)
 	{
-		stateBeforeEmergency = allowingExit;
-		return leftDoor.allowExit();
+		state->operation = allowingExit;
+		state->door = left;
+		int rtnval = leftDoor.allowExit();
+		doorTravelMs = leftDoor.getTravelMs();
+		return rtnval;
 	}
 	else if (currentWLevel == high)
 	{
-		stateBeforeEmergency = allowingExit;
-		return rightDoor.allowExit();
+		state->operation = allowingExit;
+		state->door = right;
+		int rtnval = rightDoor.allowExit();
+		doorTravelMs = rightDoor.getTravelMs();
+		return rtnval;
 	}
 	else
 	{
 		return incorrectWaterLevel;
 	}
-}
\ No newline at end of file
+}
+
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+int BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::turnaround(long long passageMs)
+{
+	OperationScope scope(cHandler, state->operation);
+	doorTravelMs = 0;
+	WaterLevel currentWLevel = cHandler.getWaterLevel();
+	if (currentWLevel == waterError && cHandler.timedOut())
+	{
+		return timeoutExpired;
+	}
+	if (currentWLevel != low && currentWLevel != high)
+	{
+		return incorrectWaterLevel;
+	}
+
+	// A restore after an emergency lets the incoming vessels in.
+	state->operation = allowingEntry;
+	state->door = (currentWLevel == low) ? left : right;
+	Door<LockPolicy, MotorPolicy>& door = (currentWLevel == low) ? leftDoor : rightDoor;
+	int rtnval = door.turnaround(passageMs);
+	doorTravelMs = door.getTravelMs();
+	return rtnval;
+}
+
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+WaterLevel BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::getWaterLevel()
+{
+	return cHandler.getWaterLevel();
+}
+
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+int BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::levelTo(DoorSide side)
+{
+	OperationScope scope(cHandler, state->operation);
+	doorTravelMs = 0;
+	WaterLevel currentWLevel = cHandler.getWaterLevel();
+	if (currentWLevel == waterError)
+	{
+		return cHandler.timedOut() ? timeoutExpired : incorrectWaterLevel;
+	}
+	if (state->emergency)
+	{
+		return invalidCall;
+	}
+	if ((side == left && currentWLevel == low) || (side == right && currentWLevel == high))
+	{
+		return success; // Level already
+	}
+
+	// The water can only move with both doors closed.
+	Door<LockPolicy, MotorPolicy>* doors[2] = { &leftDoor, &rightDoor };
+	for (int doorSide = 0; doorSide < 2; doorSide++)
+	{
+		DoorState currentState = cHandler.getDoorState((DoorSide) doorSide);
+		if (currentState == doorOpen)
+		{
+			int rtnval = doors[doorSide]->closeDoor();
+			doorTravelMs = doors[doorSide]->getTravelMs();
+			if (rtnval != success)
+			{
+				return rtnval;
+			}
+		}
+		else if (currentState != doorClosed && currentState != doorLocked)
+		{
+			return incorrectDoorState;
+		}
+	}
+
+	state->operation = (side == right) ? sluicingUp : sluicingDown;
+	levelling = true;
+	int rtnval = (side == right) ? sluiceUp(currentWLevel) : sluiceDown(currentWLevel);
+	levelling = false;
+	return rtnval;
+}
+
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+void BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::cancelAt(long long when)
+{
+	cancelTime = when;
+	cHandler.cancelWaits(); // Waiting for the water with the old time
+}
+
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+bool BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::cancelled()
+{
+	return levelling && deadlineExpired(cancelTime);
+}
+
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+long long BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::lastDoorTravelMs()
+{
+	return doorTravelMs;
+}
+
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+int BasicSluice<LockPolicy, MotorPolicy, ValvePolicy>::failure()
+{
+	if (cHandler.timedOut())
+	{
+		return timeoutExpired; // The simulator did not reply in time
+	}
+	return noAckReceived;
+}
+
+template class BasicSluice<NoLock, StandardMotor, GreedyValves>;
+template class BasicSluice<FastLock, StandardMotor, GreedyValves>;
+template class BasicSluice<NoLock, PulseMotor, GreedyValves>;
+// The schedule the sluices used before, kept to compare against (bench/valvePolicies).
+template class BasicSluice<NoLock, StandardMotor, SequentialValves>;
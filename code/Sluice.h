@@ -4,29 +4,145 @@
 #include "lib/enums.h"
 #include "CommunicationHandler.h"
 #include "Door.h"
+#include "StateFile.h"
+#include "ValvePolicies.h"
+#include "ProgressWatchdog.h"
+#include "WaterLevelEstimator.h"
 
+// What the operator (or anything else driving sluices) can ask of a sluice,
+// whatever kind of doors it has.
 class Sluice
 {
 public:
-	Sluice(int port);
-	~Sluice();
+	virtual ~Sluice() {}
+
+	virtual int start() = 0;
+	virtual int allowEntry() = 0;
+	virtual int allowExit() = 0;
+	// allowExit() and allowEntry() in one door opening: the outgoing vessels
+	// get passageMs to leave before the incoming ones are let in.
+	virtual int turnaround(long long passageMs) = 0;
+	// The emergency button. The first press stops the sluice and returns
+	// success, the second carries on with the operation it stopped and
+	// returns what that came to.
+	virtual int passInterrupt() = 0;
+	// The first press of the emergency button, without sending anything:
+	// the stop messages are put in target to go out in one batch with the
+	// rest of the fleet (see FleetEmergencyStop). The second press is a
+	// passInterrupt() again. false when the sluice was stopped already.
+	virtual bool addEmergencyStop(BatchTarget& target) = 0;
+	// From the first press of the emergency button until the second one
+	// has carried on with what it stopped.
+	virtual bool stopped() = 0;
+	// What the operation the last second press carried on came to, success
+	// before there was one.
+	virtual int lastResume() = 0;
+	// Picks up where a previous run of the controller left the sluice, from
+	// its state file (-s). An operation the restart cut short is finished,
+	// one the emergency button stopped waits for the button again
+	// (interruptReceived). stateDiscarded when the simulator is not where
+	// the file says.
+	virtual int recover() = 0;
+	virtual WaterLevel getWaterLevel() = 0;
+	// Closes whichever door is open and levels the chamber with the water on
+	// that side, from whatever level it is at.
+	virtual int levelTo(DoorSide side) = 0;
+	// Makes a levelTo() in progress stop at when (monotonicMs()), closing
+	// the valves and returning operationCancelled. NO_DEADLINE takes the
+	// cancel back. Nothing else is cancelled. Can be called from another
+	// thread or a signal handler.
+	virtual void cancelAt(long long when) = 0;
+	// How long the door moved by the last operation took to get there, in
+	// ms. 0 when the operation did not move a door.
+	virtual long long lastDoorTravelMs() = 0;
+};
+
+// Where an operation was when the emergency button was pressed. Taken from
+// what the sluice had commanded, so taking it costs no messages.
+struct EmergencyCheckpoint
+{
+	SluiceState phase;			// waitingForCommand when nothing was running
+	DoorState doorMotion[2];	// doorOpening or doorClosing for a door caught moving
+	bool doorOpened;			// The operation's door was told to open and got there
+	bool valvesOpen[2][3];		// Indexed by DoorSide and valve row - 1
+	LightState lights[4];		// Indexed by light location - 1, lightError when never set
+};
+
+#define STATE_MAGIC (0x534c0000u | sizeof(PersistedState))	/* Changes with the layout */
+
+// All a sluice needs to remember to pick up after the controller restarted.
+// Lives in the sluice's state file when there is one, and is changed there
+// directly, so it is never older than the last transition.
+struct PersistedState
+{
+	unsigned int magic;			// STATE_MAGIC, 0 in a new file
+	SluiceState operation;		// waitingForCommand between operations
+	DoorSide door;				// The door allowingEntry and allowingExit work
+	bool emergency;
+	EmergencyCheckpoint checkpoint;
+	CommandedState commanded;	// Kept up to date by the CommunicationHandler
+};
+
+// A sluice whose doors and valve schedule are fixed at compile time, see
+// DoorPolicies.h and ValvePolicies.h.
+template <class LockPolicy, class MotorPolicy, class ValvePolicy>
+class BasicSluice : public Sluice
+{
+public:
+	BasicSluice(int Port);
+	~BasicSluice();
 	
 	int start();
 	int allowEntry();
     int allowExit();
-    void passInterrupt();
+	int turnaround(long long passageMs);
+    int passInterrupt();
+	bool addEmergencyStop(BatchTarget& target);
+	bool stopped();
+	int lastResume();
+	int recover();
+	WaterLevel getWaterLevel();
+	int levelTo(DoorSide side);
+	void cancelAt(long long when);
+	long long lastDoorTravelMs();
 
 private:
+	BasicSluice(const BasicSluice&);
+	BasicSluice& operator= (const BasicSluice&);
+
 	CommunicationHandler cHandler;
-	Door leftDoor;
-	Door rightDoor;
+	Door<LockPolicy, MotorPolicy> leftDoor;
+	Door<LockPolicy, MotorPolicy> rightDoor;
 
-	bool emergency;
-	SluiceState stateBeforeEmergency;
+	int port;
+	PersistedState ownState;
+	PersistedState* state;		// ownState, or mapped from stateFile
+	StateFile stateFile;
+	long long doorTravelMs;
+	WaterLevelEstimator waterEstimate;
+	ProgressWatchdog waterWatchdog;
+	WaterLevel watchedBand;	// Band the watchdog last saw the water in
+	volatile long long cancelTime;
+	volatile bool resuming;	// The second press is carrying on with the operation
+	volatile int resumed;	// What it came to, set before resuming is cleared
+	bool levelling;	// Only levelTo() can be cancelled
 
+	void takeCheckpoint();
+	void emergencyStop();
+	int resume();
 	int sluiceUp(WaterLevel currentWLevel);
 	int sluiceDown(WaterLevel currentWLevel);
+	bool openValves(DoorSide side, WaterLevel currentWLevel);
 	bool closeValves(DoorSide side);
+	int outOfTime(DoorSide side);
+	void waitForWater(WaterLevel currentWLevel);
+	bool waterStalled(WaterLevel currentWLevel);
+	bool cancelled();
+	int failure();
 };
 
-#endif
\ No newline at end of file
+typedef BasicSluice<NoLock, StandardMotor, GreedyValves> StandardSluice;
+typedef BasicSluice<FastLock, StandardMotor, GreedyValves> FastLockSluice;
+typedef BasicSluice<NoLock, PulseMotor, GreedyValves> PulseMotorSluice;
+
+#endif
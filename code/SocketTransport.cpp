@@ -0,0 +1,101 @@
+// Copy constructor and assignment operator are disabled: the socket is owned
+// by exactly one transport and closed by its destructor.
+
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <poll.h>
+
+#include "SocketTransport.h"
+#include "lib/createTCPClientSocket.h"
+#include "lib/createUnixClientSocket.h"
+
+SocketTransport::SocketTransport()
+{
+	sock = -1;
+}
+
+SocketTransport::~SocketTransport()
+{
+	close();
+}
+
+void SocketTransport::close()
+{
+	if (sock >= 0)
+	{
+		::close(sock);
+		sock = -1;
+	}
+}
+
+bool SocketTransport::isOpen()
+{
+	return sock >= 0;
+}
+
+bool SocketTransport::send(const char data[], int size)
+{
+	// MSG_NOSIGNAL: a simulator that went away must not kill us with SIGPIPE.
+	return sock >= 0 && ::send(sock, data, size, MSG_NOSIGNAL) == size;
+}
+
+int SocketTransport::receive(char buffer[], int size, int timeoutMs)
+{
+	struct pollfd pfd;
+	pfd.fd = sock;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	// The emergency button's handler may read from this socket while we
+	// wait, so neither poll() nor recv() is retried after a signal: the
+	// caller first looks whether its reply has been read already.
+	int ready = poll(&pfd, 1, timeoutMs);
+	if (ready < 0 && errno == EINTR)
+	{
+		return -2;
+	}
+	if (ready == 0)
+	{
+		return 0;
+	}
+
+	// Zero bytes means the simulator closed the connection.
+	int received = (ready > 0) ? recv(sock, buffer, size, MSG_DONTWAIT) : -1;
+	if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+	{
+		return -2; // Someone else took what poll() saw
+	}
+	return (received > 0) ? received : -1;
+}
+
+int SocketTransport::descriptor()
+{
+	return sock;
+}
+
+TCPTransport::TCPTransport(int Port)
+{
+	port = Port;
+}
+
+bool TCPTransport::open()
+{
+	close();
+	sock = TryCreateTCPClientSocket (port);
+	return sock >= 0;
+}
+
+UnixTransport::UnixTransport(int port)
+{
+	snprintf(path, sizeof(path), UNIX_SOCKET_PATH, port);
+}
+
+bool UnixTransport::open()
+{
+	close();
+	sock = TryCreateUnixClientSocket (path);
+	return sock >= 0;
+}
@@ -0,0 +1,49 @@
+#ifndef SOCKETTRANSPORT_H_
+#define SOCKETTRANSPORT_H_
+
+#include "Transport.h"
+
+// Shared by every transport that is a connected stream socket.
+class SocketTransport : public Transport
+{
+public:
+	SocketTransport();
+	virtual ~SocketTransport();
+
+	void close();
+	bool isOpen();
+	bool send(const char data[], int size);
+	int receive(char buffer[], int size, int timeoutMs);
+	int descriptor();
+
+protected:
+	int sock; // Socket descriptor, -1 while disconnected
+
+private:
+	SocketTransport(const SocketTransport&);
+	SocketTransport& operator= (const SocketTransport&);
+};
+
+// Loopback TCP, the only thing the standard simulator listens on.
+class TCPTransport : public SocketTransport
+{
+public:
+	TCPTransport(int Port);
+	bool open();
+
+private:
+	int port;
+};
+
+// AF_UNIX stream socket to a simulator on the same machine.
+class UnixTransport : public SocketTransport
+{
+public:
+	UnixTransport(int port);
+	bool open();
+
+private:
+	char path[108];
+};
+
+#endif
@@ -0,0 +1,67 @@
+// Copy constructor and assignment operator are disabled: the mapping is owned
+// by exactly one state file and unmapped by its destructor.
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "StateFile.h"
+#include "lib/auxiliary.h"
+
+StateFile::StateFile()
+{
+	region = NULL;
+	size = 0;
+}
+
+StateFile::~StateFile()
+{
+	close();
+}
+
+void* StateFile::open(int port, size_t Size)
+{
+	close();
+	if (argv_statedir == NULL)
+	{
+		return NULL;
+	}
+
+	char path[256];
+	snprintf(path, sizeof(path), STATE_FILE_PATH, argv_statedir, port);
+	int fd = ::open(path, O_CREAT | O_RDWR, 0600);
+	if (fd < 0)
+	{
+		return NULL;
+	}
+
+	// A new file reads as zeroes, an old one of another size is grown or cut.
+	struct stat status;
+	if (fstat(fd, &status) != 0 || ((size_t) status.st_size != Size && ftruncate(fd, Size) != 0))
+	{
+		::close(fd);
+		return NULL;
+	}
+
+	void* mapping = mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd); // The mapping keeps the file open
+	if (mapping == MAP_FAILED)
+	{
+		return NULL;
+	}
+
+	region = mapping;
+	size = Size;
+	return region;
+}
+
+void StateFile::close()
+{
+	if (region != NULL)
+	{
+		munmap(region, size);
+		region = NULL;
+	}
+}
@@ -0,0 +1,32 @@
+#ifndef STATEFILE_H_
+#define STATEFILE_H_
+
+#include <stddef.h>
+
+#define STATE_FILE_PATH "%s/sluice%d.state"	/* State of the sluice on a port, in the state directory (-s) */
+
+// A small file mapped into memory, for state that has to outlive the
+// controller process. Whatever is stored in it reaches the file even when
+// the process is killed right after, only a crash of the machine can lose
+// the last changes.
+class StateFile
+{
+public:
+	StateFile();
+	~StateFile();
+
+	// Maps the file of the sluice on port, size bytes, creating it zeroed
+	// when it is missing. NULL when there is no state directory or the file
+	// can't be mapped.
+	void* open(int port, size_t Size);
+	void close();
+
+private:
+	StateFile(const StateFile&);
+	StateFile& operator= (const StateFile&);
+
+	void* region;
+	size_t size;
+};
+
+#endif
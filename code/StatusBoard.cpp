@@ -0,0 +1,206 @@
+// Copy constructor and assignment operator are disabled: the mapping is owned
+// by exactly one board and unmapped by its destructor.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "StatusBoard.h"
+
+#define STATUS_BOARD_LAYOUT (0x53420000u | sizeof(StatusBoardRegion))	/* Changes with the layout */
+#define STATUS_READ_ATTEMPTS 10000	/* Reads of a slot being written before giving up on it */
+
+StatusBoard::StatusBoard(const char Name[], bool Writer)
+{
+	snprintf(name, sizeof(name), "%s", Name);
+	writer = Writer;
+	region = NULL;
+}
+
+StatusBoard::~StatusBoard()
+{
+	close();
+}
+
+bool StatusBoard::open()
+{
+	close();
+
+	// A controller built with another layout left its region behind: the
+	// controller makes a new one, monitors still mapping the old one keep
+	// seeing that.
+	for (int attempt = 0; attempt < 2; attempt++)
+	{
+		int fd = shm_open(name, writer ? (O_CREAT | O_RDWR) : O_RDWR, 0644);
+		if (fd < 0)
+		{
+			return false; // No controller published anything yet
+		}
+
+		// A new region is zero, and stays in place for the next controller.
+		struct stat status;
+		bool sized = fstat(fd, &status) == 0;
+		if (sized && writer && status.st_size == 0)
+		{
+			sized = ftruncate(fd, sizeof(StatusBoardRegion)) == 0;
+			status.st_size = sizeof(StatusBoardRegion);
+		}
+		void* mapping = MAP_FAILED;
+		if (sized && status.st_size == (off_t) sizeof(StatusBoardRegion))
+		{
+			mapping = mmap(NULL, sizeof(StatusBoardRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		}
+		::close(fd); // The mapping keeps the memory alive
+
+		if (mapping != MAP_FAILED)
+		{
+			region = (StatusBoardRegion*) mapping;
+			if (writer)
+			{
+				unsigned int none = 0;
+				region->layout.compare_exchange_strong(none, STATUS_BOARD_LAYOUT);
+			}
+			if (region->layout.load(std::memory_order_acquire) == STATUS_BOARD_LAYOUT)
+			{
+				return true;
+			}
+			close();
+		}
+		if (!writer || !sized)
+		{
+			return false;
+		}
+		shm_unlink(name);
+	}
+	return false;
+}
+
+void StatusBoard::close()
+{
+	if (region != NULL)
+	{
+		munmap(region, sizeof(StatusBoardRegion));
+		region = NULL;
+	}
+}
+
+bool StatusBoard::isOpen()
+{
+	return region != NULL;
+}
+
+int StatusBoard::claim(int port)
+{
+	if (region == NULL)
+	{
+		return -1;
+	}
+
+	// The slot this sluice had before, a free one, or one of a controller
+	// that is gone, in that order.
+	for (int pass = 0; pass < 3; pass++)
+	{
+		for (int slot = 0; slot < STATUS_BOARD_SLOTS; slot++)
+		{
+			StatusSlot& candidate = region->slots[slot];
+			int owner = candidate.owner.load();
+			pid_t pid = candidate.pid.load();
+			bool take;
+			switch (pass)
+			{
+				case 0:
+					take = owner == port && (pid == getpid() || (kill(pid, 0) != 0 && errno == ESRCH));
+					break;
+				case 1:
+					take = owner == 0;
+					break;
+				default:
+					take = owner != 0 && kill(pid, 0) != 0 && errno == ESRCH;
+					break;
+			}
+			if (take && candidate.owner.compare_exchange_strong(owner, port))
+			{
+				// A controller that died writing left the sequence odd, and
+				// nobody else writes here now.
+				unsigned int sequence = candidate.sequence.load();
+				if (pid != getpid() && (sequence & 1))
+				{
+					candidate.sequence.store(sequence + 1, std::memory_order_release);
+				}
+				candidate.pid.store(getpid());
+				return slot;
+			}
+		}
+	}
+	return -1;
+}
+
+void StatusBoard::release(int slot)
+{
+	if (region == NULL || slot < 0)
+	{
+		return;
+	}
+
+	SluiceStatus unused;
+	memset(&unused, 0, sizeof(unused));
+	while (!publish(slot, unused))
+	{
+		sched_yield();
+	}
+	region->slots[slot].owner.store(0);
+}
+
+bool StatusBoard::publish(int slot, const SluiceStatus& status)
+{
+	StatusSlot& target = region->slots[slot];
+	unsigned int sequence = target.sequence.load(std::memory_order_relaxed);
+	if ((sequence & 1) || !target.sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_relaxed))
+	{
+		return false;
+	}
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(&target.status, &status, sizeof(status));
+	target.sequence.store(sequence + 2, std::memory_order_release);
+	return true;
+}
+
+bool StatusBoard::read(int slot, SluiceStatus& status)
+{
+	if (region == NULL || slot < 0 || slot >= STATUS_BOARD_SLOTS)
+	{
+		return false;
+	}
+
+	StatusSlot& source = region->slots[slot];
+	for (int attempt = 0; attempt < STATUS_READ_ATTEMPTS; attempt++)
+	{
+		unsigned int before = source.sequence.load(std::memory_order_acquire);
+		if (before & 1)
+		{
+			sched_yield(); // Being written, which takes a moment unless the writer died
+			continue;
+		}
+		memcpy(&status, &source.status, sizeof(status));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (source.sequence.load(std::memory_order_relaxed) == before)
+		{
+			return status.port != 0;
+		}
+	}
+	return false;
+}
+
+StatusBoard& controllerStatusBoard()
+{
+	static StatusBoard board(STATUS_BOARD_NAME, true);
+	static bool opened = board.open(); // Without shared memory nothing is published
+	(void) opened;
+	return board;
+}
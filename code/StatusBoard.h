@@ -0,0 +1,95 @@
+#ifndef STATUSBOARD_H_
+#define STATUSBOARD_H_
+
+#include <atomic>
+#include <sys/types.h>
+
+#include "lib/enums.h"
+
+#define STATUS_BOARD_NAME "/sluiceStatus"	/* Shared memory the controller publishes in */
+#define STATUS_BOARD_SLOTS 32				/* Sluices one board has room for */
+
+// What the controller last heard from, or told, one sluice's simulator.
+// Nothing here is asked of the simulator for the board's sake.
+struct SluiceStatus
+{
+	int port;					// Simulator port, 0 for an unused slot
+	DoorState doors[2];			// Indexed by DoorSide, doorStateError until known
+	ActuatorCommand locks[2];	// Indexed by DoorSide
+	bool valvesOpen[2][3];		// Indexed by DoorSide and valve row - 1
+	LightState lights[4];		// Indexed by light location - 1, lightError until known
+	WaterLevel waterLevel;		// waterError until known
+	SluiceState operation;
+	bool emergency;
+	long long operationSinceMs;	// monotonicMs() when operation last changed
+	long long phaseMs[waitingForCommand];	// How long each operation took when it last ran, 0 before
+	long long updatedAtMs;		// monotonicMs() of the last change to anything here
+	long long commands;			// Set... messages sent since the controller started
+	long long queries;			// Get... messages sent
+	long long throttled;		// Queries held back by the rate limits (-q, -Q)
+	long long throttledMs;		// ... for this long all together
+	long long coalesced;		// Queries answered with the reply to an identical one, not sent
+	long long speculated;		// Queries sent along with a command, in case the next step asks
+	long long prefetched;		// ... of which the reply was used
+};
+
+// One sluice's status, guarded by a seqlock: the controller makes sequence
+// odd while it writes, readers copy the status and keep the copy only when
+// sequence was even and unchanged around it. Readers never write.
+struct StatusSlot
+{
+	std::atomic<unsigned int> sequence;
+	std::atomic<int> owner;		// Port of the sluice publishing here, 0 when free
+	std::atomic<pid_t> pid;		// Controller process that claimed the slot
+	char padding[52];
+	SluiceStatus status;
+};
+
+struct StatusBoardRegion
+{
+	std::atomic<unsigned int> layout;	// STATUS_BOARD_LAYOUT, 0 in a new region
+	char padding[60];
+	StatusSlot slots[STATUS_BOARD_SLOTS];
+};
+
+// The board in shared memory, so monitor processes can see every sluice of
+// a controller without a single extra message to a simulator, and without
+// a lock the controller could be held up by.
+class StatusBoard
+{
+public:
+	// Writer is set for the controller, which creates the region if needed.
+	StatusBoard(const char Name[], bool Writer);
+	~StatusBoard();
+
+	bool open();
+	void close();
+	bool isOpen();
+
+	// Controller side. A slot for the sluice on port, taken over from a
+	// controller that went away if the board is full. -1 when there is none.
+	// A slot taken over from a controller that died halfway publishing is
+	// made readable again.
+	int claim(int port);
+	void release(int slot);
+	// false when the slot was being written already (another thread, or
+	// the emergency button interrupting), the status was not published.
+	bool publish(int slot, const SluiceStatus& status);
+
+	// Monitor side: a consistent copy of the slot, false when unused or
+	// when it stays half-written (its controller died publishing).
+	bool read(int slot, SluiceStatus& status);
+
+private:
+	StatusBoard(const StatusBoard&);
+	StatusBoard& operator= (const StatusBoard&);
+
+	char name[64];
+	bool writer;
+	StatusBoardRegion* region;
+};
+
+// The board this controller publishes on, opened on first use.
+StatusBoard& controllerStatusBoard();
+
+#endif
@@ -0,0 +1,145 @@
+// Copy constructor and assignment operator are disabled: the slots are list
+// heads the pending timers point back to.
+
+#include <stddef.h>
+
+#include "TimerWheel.h"
+
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_RANGE (1LL << (WHEEL_BITS * WHEEL_LEVELS))	/* Furthest ahead a timer is placed */
+
+TimerWheel::TimerWheel(long long nowMs)
+{
+	for (int level = 0; level < WHEEL_LEVELS; level++)
+	{
+		for (int slot = 0; slot < WHEEL_SLOTS; slot++)
+		{
+			slots[level][slot].next = &slots[level][slot];
+			slots[level][slot].previous = &slots[level][slot];
+		}
+	}
+	currentMs = nowMs;
+	count = 0;
+}
+
+void TimerWheel::schedule(WheelTimer& timer, long long whenMs)
+{
+	cancel(timer);
+	timer.expiresMs = whenMs;
+	insert(timer, currentMs + 1); // This ms has been fired already
+	count++;
+}
+
+void TimerWheel::cancel(WheelTimer& timer)
+{
+	if (isPending(timer))
+	{
+		timer.previous->next = timer.next;
+		timer.next->previous = timer.previous;
+		timer.next = NULL;
+		timer.previous = NULL;
+		count--;
+	}
+}
+
+bool TimerWheel::isPending(WheelTimer& timer)
+{
+	return timer.next != NULL;
+}
+
+int TimerWheel::pending()
+{
+	return count;
+}
+
+void TimerWheel::insert(WheelTimer& timer, long long earliestMs)
+{
+	// The slot is picked by the expiry's own bits at the lowest level that
+	// reaches that far, so a slot comes round exactly when its timers are
+	// due at the level below.
+	long long when = timer.expiresMs;
+	if (when < earliestMs)
+	{
+		when = earliestMs;
+	}
+	else if (when - currentMs >= WHEEL_RANGE)
+	{
+		when = currentMs + WHEEL_RANGE - 1; // Placed again when that slot comes round
+	}
+
+	int level = 0;
+	while (level < WHEEL_LEVELS - 1 && when - currentMs >= (1LL << (WHEEL_BITS * (level + 1))))
+	{
+		level++;
+	}
+	WheelTimer& head = slots[level][(when >> (WHEEL_BITS * level)) & WHEEL_MASK];
+	timer.next = &head;
+	timer.previous = head.previous;
+	head.previous->next = &timer;
+	head.previous = &timer;
+}
+
+void TimerWheel::cascade(int level)
+{
+	WheelTimer& head = slots[level][(currentMs >> (WHEEL_BITS * level)) & WHEEL_MASK];
+	while (head.next != &head)
+	{
+		WheelTimer* timer = head.next;
+		timer->previous->next = timer->next;
+		timer->next->previous = timer->previous;
+		insert(*timer, currentMs); // Level 0 of this ms is fired next
+	}
+}
+
+int TimerWheel::advance(long long nowMs)
+{
+	int fired = 0;
+	while (currentMs < nowMs)
+	{
+		if (count == 0)
+		{
+			currentMs = nowMs; // Nothing to move down or fire on the way
+			break;
+		}
+
+		currentMs++;
+		// Highest level first, so its timers can go down more than one level.
+		int top = 0;
+		while (top < WHEEL_LEVELS - 1 && ((currentMs >> (WHEEL_BITS * (top + 1))) << (WHEEL_BITS * (top + 1))) == currentMs)
+		{
+			top++;
+		}
+		for (int level = top; level > 0; level--)
+		{
+			cascade(level);
+		}
+
+		WheelTimer& head = slots[0][currentMs & WHEEL_MASK];
+		while (head.next != &head)
+		{
+			WheelTimer* timer = head.next;
+			cancel(*timer);
+			timer->fire(timer);
+			fired++;
+		}
+	}
+	return fired;
+}
+
+long long TimerWheel::nextDueMs()
+{
+	if (count == 0)
+	{
+		return -1;
+	}
+
+	// Within 64 ms there is either a timer at level 0 or a level above to
+	// move down.
+	for (long long when = currentMs + 1; ; when++)
+	{
+		if ((when & WHEEL_MASK) == 0 || slots[0][when & WHEEL_MASK].next != &slots[0][when & WHEEL_MASK])
+		{
+			return when;
+		}
+	}
+}
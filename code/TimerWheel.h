@@ -0,0 +1,54 @@
+#ifndef TIMERWHEEL_H_
+#define TIMERWHEEL_H_
+
+#define WHEEL_BITS 6						/* 64 slots per level */
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4						/* 1 ms to 2^24 ms (4.6 hours) apart */
+
+// A timer on a TimerWheel. The owner keeps it alive while it is pending;
+// fire is called from advance() once expiresMs has come.
+struct WheelTimer
+{
+	long long expiresMs;
+	void (*fire)(WheelTimer* timer);
+	void* context;						// For fire, the wheel does not look at it
+	WheelTimer* next;					// Links in a slot, NULL while not pending
+	WheelTimer* previous;
+};
+
+// Hierarchical timing wheel with 1 ms ticks: level 0 holds the timers due
+// in the next 64 ms, one slot per ms, each level above covers 64 times as
+// long with slots 64 times as wide. Scheduling and cancelling are O(1)
+// whatever the number of timers. A timer is moved down a level at most
+// WHEEL_LEVELS - 1 times on its way to firing. Not thread safe, the owner
+// serialises.
+class TimerWheel
+{
+public:
+	TimerWheel(long long nowMs);
+
+	// A timer already pending is moved. Times in the past fire at the next tick.
+	void schedule(WheelTimer& timer, long long whenMs);
+	void cancel(WheelTimer& timer);
+	bool isPending(WheelTimer& timer);
+	// Fires every timer due up to nowMs, in order of expiry per ms. Returns
+	// how many fired. A fire function may schedule and cancel timers.
+	int advance(long long nowMs);
+	// The earliest time advance() has something to do: a timer's expiry,
+	// or a level above moving its timers down. -1 when nothing is pending.
+	long long nextDueMs();
+	int pending();
+
+private:
+	TimerWheel(const TimerWheel&);
+	TimerWheel& operator= (const TimerWheel&);
+
+	WheelTimer slots[WHEEL_LEVELS][WHEEL_SLOTS];	// Heads of circular lists
+	long long currentMs;				// Everything up to here has fired
+	int count;
+
+	void insert(WheelTimer& timer, long long earliestMs);
+	void cascade(int level);
+};
+
+#endif
@@ -78,4 +78,30 @@ int TrafficLight::greenLight()
 
     // This should be unreachable.
     return lightError;
-}
\ No newline at end of file
+}
+
+int TrafficLight::redLightCached()
+{
+    switch(cHandler.commandedLight(location))
+    {
+        case redLightOn:
+            return success; // Told so before, nothing to change.
+        case greenLightOn:
+            return (cHandler.redLight(location) == 0) ? success : noAckReceived;
+        default:
+            return redLight(); // Never told anything, ask.
+    }
+}
+
+int TrafficLight::greenLightCached()
+{
+    switch(cHandler.commandedLight(location))
+    {
+        case greenLightOn:
+            return success; // Told so before, nothing to change.
+        case redLightOn:
+            return (cHandler.greenLight(location) == 0) ? success : noAckReceived;
+        default:
+            return greenLight(); // Never told anything, ask.
+    }
+}
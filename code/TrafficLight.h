@@ -13,6 +13,11 @@ public:
 	LightState getLightState();
 	int redLight();
 	int greenLight();
+	// Like redLight() and greenLight(), but going by what the light was last
+	// told instead of asking the simulator first. For sequences that set the
+	// light themselves moments ago.
+	int redLightCached();
+	int greenLightCached();
 
 private:
 	TrafficLight(const TrafficLight&);
@@ -0,0 +1,33 @@
+#include <string.h>
+
+#include "Transport.h"
+#include "SocketTransport.h"
+#include "ShmTransport.h"
+
+TransportType parseTransportType(const char name[])
+{
+	if (name != NULL && strcmp(name, "unix") == 0)
+	{
+		return unixTransport;
+	}
+	else if (name != NULL && strcmp(name, "shm") == 0)
+	{
+		return shmTransport;
+	}
+
+	// The simulator only speaks TCP unless told otherwise.
+	return tcpTransport;
+}
+
+Transport* createTransport(TransportType type, int port)
+{
+	switch (type)
+	{
+		case unixTransport:
+			return new UnixTransport(port);
+		case shmTransport:
+			return new ShmTransport(port, false);
+		default:
+			return new TCPTransport(port);
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef TRANSPORT_H_
+#define TRANSPORT_H_
+
+#define UNIX_SOCKET_PATH "/tmp/sluice%d.sock"	/* Path of the local socket of the simulator on a port */
+#define SHM_NAME "/sluice%d"					/* Name of the shared memory of the simulator on a port */
+
+enum TransportType
+{
+	tcpTransport,
+	unixTransport,
+	shmTransport
+};
+
+// A byte stream to and from one simulator. The simulator is found by its
+// port number, whichever way it is connected.
+class Transport
+{
+public:
+	virtual ~Transport() {}
+
+	virtual bool open() = 0;
+	virtual void close() = 0;
+	virtual bool isOpen() = 0;
+	virtual bool send(const char data[], int size) = 0;
+	// Returns the number of bytes received, 0 when nothing arrived within
+	// timeoutMs (-1 waits forever) and -1 when the connection is broken.
+	// -2 when a signal handler ran meanwhile, it may have taken the reply
+	// that was waited for (the emergency button talks to the simulator).
+	virtual int receive(char buffer[], int size, int timeoutMs) = 0;
+	// File descriptor that can be polled for replies, -1 when there is none.
+	virtual int descriptor() { return -1; }
+};
+
+TransportType parseTransportType(const char name[]);
+Transport* createTransport(TransportType type, int port);
+
+#endif
@@ -0,0 +1,16 @@
+#include "ValvePolicies.h"
+
+bool valveRowAllowed(int row, WaterLevel level)
+{
+	switch (row)
+	{
+		case 1:
+			return level != waterError;
+		case 2:
+			return level == aboveValve2 || level == aboveValve3 || level == high;
+		case 3:
+			return level == aboveValve3 || level == high;
+		default:
+			return false;
+	}
+}
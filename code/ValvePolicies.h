@@ -0,0 +1,36 @@
+#ifndef VALVEPOLICIES_H_
+#define VALVEPOLICIES_H_
+
+#include "lib/enums.h"
+
+// The safety rule for every valve row: a row may only be opened once the
+// water is above it, otherwise it sprays into the chamber. The bottom row
+// (1) is always under water. No policy can open a row this forbids.
+bool valveRowAllowed(int row, WaterLevel level);
+
+// Valve policies decide which of the allowed rows to open while the water
+// is levelled: the right door's rows fill the chamber, the left door's rows
+// drain it. They are picked per sluice at compile time, like the door
+// policies, and opened rows stay open until the water is level.
+
+// One more fill row with every band passed, draining through the bottom row
+// only. The schedule the sluices always used.
+struct SequentialValves
+{
+	static bool wantRow(DoorSide side, int row, WaterLevel level)
+	{
+		return side == right || row == 1;
+	}
+};
+
+// Every row that is allowed, on both sides: a drain row above the bottom
+// one adds to the flow for as long as the water is above it.
+struct GreedyValves
+{
+	static bool wantRow(DoorSide, int, WaterLevel)
+	{
+		return true;
+	}
+};
+
+#endif
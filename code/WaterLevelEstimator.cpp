@@ -0,0 +1,90 @@
+// Destructor, copy constructor and assignment operator overloading is not
+// needed as this class does not contain allocated memory
+
+#include "WaterLevelEstimator.h"
+#include "lib/timing.h"
+
+WaterLevelEstimator::WaterLevelEstimator()
+{
+	for (int level = 0; level < WATER_BANDS; level++)
+	{
+		for (int valves = 0; valves < VALVE_CONFIGURATIONS; valves++)
+		{
+			bandMs[level][valves] = 0;
+		}
+	}
+	watching = false;
+	band = waterError;
+	bandValves = 0;
+	enteredAt = 0;
+	lastReadAt = 0;
+}
+
+void WaterLevelEstimator::startWatching()
+{
+	watching = false;
+}
+
+long long WaterLevelEstimator::observe(WaterLevel level, int valves)
+{
+	long long now = monotonicMs();
+	if (level == waterError || valves < 0 || valves >= VALVE_CONFIGURATIONS)
+	{
+		return WATER_POLL_MS;
+	}
+
+	if (!watching)
+	{
+		watching = true;
+		enteredAt = 0; // The water may have been in this band for a while already
+	}
+	else if (level != band)
+	{
+		// The water crossed over somewhere between the last read and this one.
+		long long changedAt = (lastReadAt + now) / 2;
+		if (enteredAt != 0)
+		{
+			long long sample = changedAt - enteredAt;
+			long long& learned = bandMs[band][bandValves];
+			learned = (learned == 0) ? sample : (3 * learned + sample) / 4;
+		}
+		enteredAt = changedAt;
+	}
+
+	band = level;
+	bandValves = valves; // Valves opened on reaching a band count for that band
+	lastReadAt = now;
+	return nextRead(now);
+}
+
+long long WaterLevelEstimator::getBandMs(WaterLevel level, int valves)
+{
+	if (level == waterError || valves < 0 || valves >= VALVE_CONFIGURATIONS)
+	{
+		return 0;
+	}
+	return bandMs[level][valves];
+}
+
+long long WaterLevelEstimator::nextRead(long long now)
+{
+	long long expected = bandMs[band][bandValves];
+	if (expected == 0 || enteredAt == 0)
+	{
+		return WATER_POLL_MS;
+	}
+
+	// Sleep until just before the water should move on, then read it often
+	// enough to open the next valves promptly.
+	long long wakeAt = enteredAt + expected * 9 / 10;
+	if (wakeAt > now)
+	{
+		return wakeAt - now;
+	}
+	long long step = expected / 20;
+	if (step > WATER_POLL_MS)
+	{
+		step = WATER_POLL_MS;
+	}
+	return (step > 0) ? step : 1;
+}
@@ -0,0 +1,38 @@
+#ifndef WATERLEVELESTIMATOR_H_
+#define WATERLEVELESTIMATOR_H_
+
+#include "lib/enums.h"
+
+#define WATER_BANDS 5				// low up to high, waterError is never learned
+#define VALVE_CONFIGURATIONS 64		// See CommunicationHandler::commandedValves
+#define WATER_POLL_MS 10			// Poll interval while a band's duration is not known yet
+
+// Learns how long the water stays in each band for each combination of
+// open valves, and uses that to say when the level is worth reading again:
+// just before the water is expected to reach the next band.
+class WaterLevelEstimator
+{
+public:
+	WaterLevelEstimator();
+
+	// Start watching the water anew, the first level read gives no timing.
+	void startWatching();
+	// Called with every level read while the water moves, valves as
+	// commandedValves() reports them. Returns the ms to wait before the
+	// next read.
+	long long observe(WaterLevel level, int valves);
+	// Learned time in ms the water stays in a band, 0 when not known yet.
+	long long getBandMs(WaterLevel level, int valves);
+
+private:
+	long long bandMs[WATER_BANDS][VALVE_CONFIGURATIONS];
+	bool watching;
+	WaterLevel band;
+	int bandValves;
+	long long enteredAt;	// 0 when it is not known when the water got into the band
+	long long lastReadAt;
+
+	long long nextRead(long long now);
+};
+
+#endif
@@ -14,7 +14,17 @@
 char *          argv_ip             = NULL;
 unsigned short  argv_port           = 0;
 int             argv_timeout        = 1;
+int             argv_optimeout      = 120;
+int             argv_stalltime      = 0;
 char *          argv_tty            = NULL;
+char *          argv_transport      = NULL;
+char *          argv_statedir       = NULL;
+char *          argv_control        = NULL;
+int             argv_queryrate      = 1000;
+int             argv_fleetrate      = 0;
+int             argv_freshness      = 10;
+bool            argv_speculate      = true;
+bool            argv_levelahead     = false;
 int             argv_forkmax        = 0;
 bool            argv_verbose        = false;
 bool            argv_delay          = false;
@@ -202,7 +212,7 @@ void parse_args (int argc, char *argv[])
     int opt;
     int i;
     
-    while ((opt = getopt(argc, argv, "i:t:p:y:f:uvdgh")) != -1)
+    while ((opt = getopt(argc, argv, "i:t:o:w:p:y:f:c:s:l:q:Q:k:nauvdgh")) != -1)
     {
         switch (opt)
         {
@@ -219,9 +229,39 @@ void parse_args (int argc, char *argv[])
             case 't':
                 argv_timeout = atoi(optarg);
                 break;
+            case 'o':
+                argv_optimeout = atoi(optarg);
+                break;
+            case 'w':
+                argv_stalltime = atoi(optarg);
+                break;
             case 'f':
                 argv_forkmax = atoi(optarg);
                 break;
+            case 'c':
+                argv_transport = optarg;
+                break;
+            case 's':
+                argv_statedir = optarg;
+                break;
+            case 'l':
+                argv_control = optarg;
+                break;
+            case 'q':
+                argv_queryrate = atoi(optarg);
+                break;
+            case 'Q':
+                argv_fleetrate = atoi(optarg);
+                break;
+            case 'k':
+                argv_freshness = atoi(optarg);
+                break;
+            case 'n':
+                argv_speculate = false;
+                break;
+            case 'a':
+                argv_levelahead = true;
+                break;
             case 'v':
                 argv_verbose = true;
                 break;
@@ -239,14 +279,24 @@ void parse_args (int argc, char *argv[])
                 printf("\noptions: \n"
                     "    -i <ip> \n"
                     "    -y <tty-name> \n"
-                    "    -t <timeout> \n"
+                    "    -t <timeout>          seconds to wait for a reply \n"
+                    "    -o <operation-timeout> seconds an operation may take \n"
+                    "    -w <stall-timeout>    seconds a door or the water may go without progress, 0 (default) for 3 times the usual \n"
                     "    -p <port> \n"
-                    "    -f <fork-max>\n"
+                    "    -f <fork-max>         load test scripts run at most this many at a time \n"
+                    "    -c <tcp|unix|shm>     how to reach the simulator \n"
+                    "    -s <state-dir>        keep controller state there across restarts \n"
+                    "    -l <control-socket>   run without the menu, take commands on this Unix socket \n"
+                    "    -q <queries-per-s>    queries to one simulator, 1000 by default, 0 for no limit \n"
+                    "    -Q <queries-per-s>    queries to all simulators together, shared in turns, 0 (default) for no limit \n"
+                    "    -k <ms>               reuse a query's reply this long, 10 by default, 0 only while it is on its way \n"
+                    "    -n         send no queries along with commands \n"
+                    "    -a         level an idle chamber ahead of time, to where most vessels came from \n"
                     "    -d         delay operation\n"
                     "    -g         debug info\n"
                     "    -u         user prefix\n"
                     "    -v         verbose\n"
-                    "    <data>*\n"
+                    "    <script>*             run these as a load test, e.g. 1:entry,1:start,1:exit*100 or @file \n"
                     "\n");
                 exit(0);
                 break;
@@ -271,12 +321,26 @@ void parse_args (int argc, char *argv[])
                 "    port:      %d\n"
                 "    tty:       %s\n"
                 "    timeout:   %d\n"
+                "    optimeout: %d\n"
+                "    stalltime: %d\n"
+                "    transport: %s\n"
+                "    statedir:  %s\n"
+                "    control:   %s\n"
+                "    queryrate: %d/s, fleet %d/s\n"
+                "    freshness: %d ms\n"
+                "    speculate: %s\n"
                 "    verbose:   %s\n"
                 "    delay:     %s\n"
                 "    debug:     %s\n"
                 "    userprefix:%s\n"
                 "    data(%d):   ",
-                argv_ip, argv_port, argv_tty, argv_timeout, 
+                argv_ip, argv_port, argv_tty, argv_timeout, argv_optimeout, argv_stalltime,
+                argv_transport ? argv_transport : "tcp",
+                argv_statedir ? argv_statedir : "(none)",
+                argv_control ? argv_control : "(menu)",
+                argv_queryrate, argv_fleetrate,
+                argv_freshness,
+                argv_speculate?"true":"false",
                 argv_verbose?"true":"false",
                 argv_delay?"true":"false",
                 argv_debug?"true":"false",
@@ -6,7 +6,17 @@
 extern char *           argv_ip;
 extern unsigned short   argv_port;
 extern int              argv_timeout;
+extern int              argv_optimeout;
+extern int              argv_stalltime;
 extern int              argv_forkmax;
+extern char *           argv_transport;
+extern char *           argv_statedir;
+extern char *           argv_control;
+extern int              argv_queryrate;
+extern int              argv_fleetrate;
+extern int              argv_freshness;
+extern bool             argv_speculate;
+extern bool             argv_levelahead;
 //extern char *           argv_tty;
 //extern bool             argv_verbose;
 //extern bool             argv_debug;
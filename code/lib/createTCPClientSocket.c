@@ -1,10 +1,11 @@
 #include <memory.h>     // for memset()
+#include <unistd.h>     // for close()
 #include <arpa/inet.h>  /* for sockaddr_in and inet_ntoa() */
 
 #include "auxiliary.h"
 #include "createTCPClientSocket.h"
 
-int CreateTCPClientSocket (unsigned short port)
+int TryCreateTCPClientSocket (unsigned short port)
 {
     const char * servIP = "127.0.0.1";
 
@@ -14,7 +15,8 @@ int CreateTCPClientSocket (unsigned short port)
     /* Create a reliable, stream socket using TCP */
     if ((sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
     {
-        DieWithError("socket() failed");
+        info ("socket() failed");
+        return (-1);
     }
     info ("socket");
     delaying ();
@@ -28,7 +30,9 @@ int CreateTCPClientSocket (unsigned short port)
     /* Establish the connection to the echo server */
     if (connect(sock, (struct sockaddr *) &echoServAddr, sizeof(echoServAddr)) < 0)
     {
-        DieWithError("connect() failed");
+        info ("connect() failed");
+        close (sock);
+        return (-1);
     }
     info ("connect");
 
@@ -36,3 +40,15 @@ int CreateTCPClientSocket (unsigned short port)
     
     return (sock);
 }
+
+int CreateTCPClientSocket (unsigned short port)
+{
+    int sock = TryCreateTCPClientSocket (port);
+
+    if (sock < 0)
+    {
+        DieWithError("connect() failed");
+    }
+
+    return (sock);
+}
@@ -2,5 +2,6 @@
 #define _CREATE_TCP_CLIENT_SOCKET_H_
 
 extern int CreateTCPClientSocket (unsigned short port); /* Create TCP server socket */
+extern int TryCreateTCPClientSocket (unsigned short port); /* Same, but returns -1 instead of exiting on failure */
 
 #endif
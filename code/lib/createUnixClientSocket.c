@@ -0,0 +1,36 @@
+#include <memory.h>     // for memset()
+#include <string.h>     // for strncpy()
+#include <unistd.h>     // for close()
+#include <sys/socket.h> // for socket() and connect()
+#include <sys/un.h>     // for sockaddr_un
+
+#include "auxiliary.h"
+#include "createUnixClientSocket.h"
+
+int TryCreateUnixClientSocket (const char * path)
+{
+    int                 sock;         /* Socket descriptor */
+    struct sockaddr_un  servAddr;     /* Simulator address */
+
+    /* Create a local stream socket, same semantics as TCP without the network stack */
+    if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        info ("socket() failed");
+        return (-1);
+    }
+    info ("socket");
+
+    memset(&servAddr, 0, sizeof(servAddr));
+    servAddr.sun_family = AF_UNIX;
+    strncpy(servAddr.sun_path, path, sizeof(servAddr.sun_path) - 1);
+
+    if (connect(sock, (struct sockaddr *) &servAddr, sizeof(servAddr)) < 0)
+    {
+        info ("connect() failed");
+        close (sock);
+        return (-1);
+    }
+    info_s ("connect", path);
+
+    return (sock);
+}
@@ -0,0 +1,6 @@
+#ifndef _CREATE_UNIX_CLIENT_SOCKET_H_
+#define _CREATE_UNIX_CLIENT_SOCKET_H_
+
+extern int TryCreateUnixClientSocket (const char * path); /* Connect to a local stream socket, -1 on failure */
+
+#endif
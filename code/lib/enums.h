@@ -51,4 +51,12 @@ enum DoorSide
 	right
 };
 
+// What the controller last told an actuator (valve, lock) to do.
+enum ActuatorCommand
+{
+	notCommanded,
+	commandedOff,
+	commandedOn
+};
+
 #endif
\ No newline at end of file
@@ -11,6 +11,11 @@ const int motorDamaged = -6;
 const int interruptReceived = -7;
 const int invalidCall = -8;
 const int invalidWaterLevel = -9;
+const int timeoutExpired = -10;
+const int operationCancelled = -11;
+const int stateDiscarded = -12;
+const int operationStalled = -13;
 const int workInProgress = 420;
+const int noVesselWaiting = 421;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include <time.h>       // for clock_gettime() and nanosleep()
+
+#include "timing.h"
+
+long long
+monotonicMs (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ((long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+long long
+monotonicUs (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ((long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+long long
+deadlineAfter (long long ms)
+{
+    return (monotonicMs () + ms);
+}
+
+long long
+deadlineRemaining (long long deadline)
+{
+    long long remaining;
+
+    if (deadline == NO_DEADLINE)
+    {
+        return (-1);
+    }
+
+    remaining = deadline - monotonicMs ();
+    return (remaining > 0 ? remaining : 0);
+}
+
+int
+deadlineExpired (long long deadline)
+{
+    return (deadline != NO_DEADLINE && monotonicMs () >= deadline);
+}
+
+void
+sleepMs (long long ms)
+{
+    struct timespec ts;
+
+    if (ms <= 0)
+    {
+        return;
+    }
+
+    ts.tv_sec  = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000;
+
+    // A signal (the emergency button) ends the sleep early on purpose,
+    // callers re-check their own state afterwards.
+    nanosleep (&ts, NULL);
+}
+
+void
+sleepUs (long long us)
+{
+    struct timespec ts;
+
+    if (us <= 0)
+    {
+        return;
+    }
+
+    ts.tv_sec  = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    nanosleep (&ts, NULL);     // Ends early on a signal, like sleepMs()
+}
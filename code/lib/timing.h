@@ -0,0 +1,14 @@
+#ifndef _TIMING_H_
+#define _TIMING_H_
+
+#define NO_DEADLINE 0LL
+
+extern long long monotonicMs (void);               /* Milliseconds on a clock that never jumps */
+extern long long monotonicUs (void);               /* Microseconds on the same clock */
+extern long long deadlineAfter (long long ms);     /* Deadline that expires ms from now */
+extern long long deadlineRemaining (long long deadline); /* Milliseconds left, 0 when expired, -1 for NO_DEADLINE */
+extern int  deadlineExpired (long long deadline);  /* Non-zero once the deadline has passed */
+extern void sleepMs (long long ms);
+extern void sleepUs (long long us);
+
+#endif
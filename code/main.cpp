@@ -1,46 +1,41 @@
+#include <fstream>
+#include <stdio.h>
 #include <iostream>
+#include <pthread.h>
 #include <signal.h>
+#include <vector>
 
 #include "Sluice.h"
+#include "ControlServer.h"
+#include "FleetDispatcher.h"
+#include "FleetEmergencyStop.h"
+#include "LoadTest.h"
+#include "LockageScheduler.h"
+#include "lib/auxiliary.h"
 #include "lib/returnValues.h"
+#include "lib/timing.h"
 
-int currentSluice = 0;
-Sluice normalSluice1 = Sluice(5555);
-Sluice normalSluice2 = Sluice(5556);
-Sluice fastLockSluice = Sluice(5557);
-Sluice pulseMotorSluice = Sluice(5558);
+StandardSluice normalSluice1(5555);
+StandardSluice normalSluice2(5556);
+FastLockSluice fastLockSluice(5557);
+PulseMotorSluice pulseMotorSluice(5558);
+FleetEmergencyStop emergencyButton;
 
-void ctrlCHandler(int sig){
-    switch(currentSluice)
+void travelTimeReport(Sluice& sluice)
+{
+    if (sluice.lastDoorTravelMs() > 0)
     {
-        case 1:
-            std::cout << "\nEmergency button pressed for sluice 1 (standard)." << std::endl;
-            normalSluice1.passInterrupt();
-            break;
-        case 2:
-            std::cout << "\nEmergency button pressed for sluice 2 (standard)." << std::endl;
-            normalSluice2.passInterrupt();
-            break;
-        case 3:
-            std::cout << "\nEmergency button pressed for sluice 3 (locking doors)." << std::endl;
-            fastLockSluice.passInterrupt();
-            break;
-        case 4:
-            std::cout << "\nEmergency button pressed for sluice 4 (different motor)." << std::endl;
-            pulseMotorSluice.passInterrupt();
-            break;
-        default:
-            std::cout << "\nNo sluice selected to stop." << std::endl;
-            break;
+        std::cout << "The door took " << sluice.lastDoorTravelMs() << " ms to move." << std::endl;
     }
 }
 
-void entryExitInterpreter(int value)
+void entryExitInterpreter(int value, Sluice& sluice)
 {
     switch(value)
     {
         case success:
             std::cout << "Action completed." << std::endl;
+            travelTimeReport(sluice);
             break;
         case incorrectDoorState:
             std::cout << "Door is not currently in a state where it can be moved." << std::endl;
@@ -60,18 +55,25 @@ void entryExitInterpreter(int value)
         case motorDamaged:
             std::cout << "Door is damaged. Unable to open." << std::endl;
             break;
+        case timeoutExpired:
+            std::cout << "The simulator did not respond in time." << std::endl;
+            break;
+        case operationStalled:
+            std::cout << "The door or the water stopped moving, the sluice gave up. Please check it." << std::endl;
+            break;
         default:
             std::cout << "Warning - sluice returned an unknown value: " << value << std::endl;
             break;
     }
 }
 
-void startInterpreter(int value)
+void startInterpreter(int value, Sluice& sluice)
 {
     switch(value)
     {
         case success:
             std::cout << "Sluicing process completed." << std::endl;
+            travelTimeReport(sluice);
             break;
         case invalidCall:
             std::cout << "It is not possible to do this right now. Is the emergency mode active?" << std::endl;
@@ -91,15 +93,363 @@ void startInterpreter(int value)
         case invalidLightState:
             std::cout << "An invalid light state (not green or red) was returned by the simulator." << std::endl;
             break;
+        case operationCancelled:
+            std::cout << "The operation was cancelled." << std::endl;
+            break;
+        case timeoutExpired:
+            std::cout << "The simulator did not respond in time." << std::endl;
+            break;
+        case operationStalled:
+            std::cout << "The door or the water stopped moving, the sluice gave up. Please check it." << std::endl;
+            break;
         default:
             std::cout << "Warning - sluice returned an unknown value: " << value << std::endl;
             break;
     }
 }
 
-int main(int argc, char const *argv[])
+void pressButton()
+{
+    // The button stops every sluice, whichever one is being managed.
+    if (!emergencyButton.stopped())
+    {
+        FleetStopReport report = emergencyButton.stop();
+        std::cout << "\nEmergency button pressed, " << report.sluices << " sluices stopped. "
+                  << report.acknowledged << " of " << report.messages << " stops acknowledged within "
+                  << report.lastAckUs << " us." << std::endl;
+    }
+    else
+    {
+        std::cout << "\nEmergency button released, the sluices carry on." << std::endl;
+        Sluice* sluices[4] = { &normalSluice1, &normalSluice2, &fastLockSluice, &pulseMotorSluice };
+        std::vector<int> results = emergencyButton.release();
+        for (unsigned int i = 0; i < results.size(); i++)
+        {
+            if (results[i] != success)
+            {
+                std::cout << "Sluice " << i + 1 << " could not carry on: ";
+                startInterpreter(results[i], *sluices[i]);
+            }
+        }
+    }
+}
+
+void* buttonWaiter(void* unused)
+{
+    // Ctrl-C is pressed from this thread, not from a signal handler: the
+    // stop builds a batch and the release runs whole operations, neither
+    // of which a handler may do. The menu's thread sees the stop the way
+    // the daemon's do.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    int sig;
+    while (sigwait(&signals, &sig) == 0)
+    {
+        pressButton();
+    }
+    return NULL;
+}
+
+int askVesselCount(const char side[])
+{
+    int count;
+    std::cout << "Vessels waiting on the " << side << " side: ";
+    if (!(std::cin >> count) || count < 0)
+    {
+        std::cin.clear();
+        std::cin.ignore(256, '\n');
+        return 0;
+    }
+    return count;
+}
+
+void scheduleVessels(Sluice& sluice)
+{
+    LockageScheduler scheduler(sluice, CHAMBER_CAPACITY, 0);
+    scheduler.setPredictive(argv_levelahead);
+    int lowSide = askVesselCount("low");
+    int highSide = askVesselCount("high");
+    std::cout << std::endl;
+
+    long long now = monotonicMs();
+    for (int i = 0; i < lowSide; i++)
+    {
+        scheduler.addVessel(left, now);
+    }
+    for (int i = 0; i < highSide; i++)
+    {
+        scheduler.addVessel(right, now);
+    }
+
+    int rtnval = scheduler.run();
+    if (rtnval != success)
+    {
+        startInterpreter(rtnval, sluice);
+    }
+
+    SchedulerReport report = scheduler.report();
+    std::cout << report.vessels << " vessels in " << report.lockages << " lockages ("
+              << report.emptyLevelChanges << " empty), " << report.vesselsPerHour << " vessels per hour.\n"
+              << "Waited " << report.averageWaitMs << " ms on average, " << report.longestWaitMs << " ms at most." << std::endl;
+}
+
+void dispatchVessels()
+{
+    Sluice* sluices[4] = { &normalSluice1, &normalSluice2, &fastLockSluice, &pulseMotorSluice };
+    FleetDispatcher fleet;
+    for (int i = 0; i < 4; i++)
+    {
+        fleet.addSluice(*sluices[i], CHAMBER_CAPACITY, 0);
+    }
+    fleet.setPredictive(argv_levelahead);
+
+    int lowSide = askVesselCount("low");
+    int highSide = askVesselCount("high");
+    std::cout << std::endl;
+
+    fleet.start();
+    for (int i = 0; i < lowSide || i < highSide; i++)
+    {
+        if (i < lowSide)
+        {
+            fleet.dispatch(left);
+        }
+        if (i < highSide)
+        {
+            fleet.dispatch(right);
+        }
+    }
+    fleet.finish();
+
+    for (int i = 0; i < fleet.sluiceCount(); i++)
+    {
+        FleetSluiceReport report = fleet.report(i);
+        std::cout << "Sluice " << i + 1 << ": " << report.lockages.vessels << " of " << report.assigned
+                  << " vessels through, busy " << (int) (report.utilization * 100) << "% of the time, waited "
+                  << report.lockages.averageWaitMs << " ms on average." << std::endl;
+        if (report.failure != success)
+        {
+            startInterpreter(report.failure, *sluices[i]);
+        }
+    }
+}
+
+void recoverSluices()
 {
-    signal (SIGINT,&ctrlCHandler);
+    // Pick up what a previous run left going, see -s.
+    Sluice* sluices[4] = { &normalSluice1, &normalSluice2, &fastLockSluice, &pulseMotorSluice };
+    bool pressed = false;
+    for (int i = 0; i < 4; i++)
+    {
+        int rtnval = sluices[i]->recover();
+        switch (rtnval)
+        {
+            case success:
+                break;
+            case interruptReceived:
+                std::cout << "Sluice " << i + 1 << " was stopped by the emergency button." << std::endl;
+                pressed = true;
+                break;
+            case stateDiscarded:
+                std::cout << "Sluice " << i + 1 << " is not as it was left, its saved state was discarded." << std::endl;
+                break;
+            default:
+                std::cout << "Sluice " << i + 1 << " could not carry on where it was left: ";
+                startInterpreter(rtnval, *sluices[i]);
+                break;
+        }
+    }
+
+    if (pressed)
+    {
+        // The button was down when the controller went, it still is for all of them.
+        emergencyButton.stop();
+        std::cout << "Every sluice stays stopped until Ctrl-C is pressed." << std::endl;
+    }
+}
+
+void* signalWaiter(void* server)
+{
+    // Ctrl-C is the emergency button here too, but it is pressed from this
+    // thread: the sluices' threads are never interrupted halfway a message.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    int sig;
+    while (sigwait(&signals, &sig) == 0)
+    {
+        if (sig == SIGINT)
+        {
+            ((ControlServer*) server)->pressEmergency();
+        }
+        else
+        {
+            ((ControlServer*) server)->stop();
+            break;
+        }
+    }
+    return NULL;
+}
+
+int runDaemon()
+{
+    // Blocked before any thread starts, so they all inherit it and only
+    // signalWaiter() gets to see them.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    recoverSluices();
+
+    ControlServer server(argv_control, emergencyButton);
+    server.addSluice(normalSluice1);
+    server.addSluice(normalSluice2);
+    server.addSluice(fastLockSluice);
+    server.addSluice(pulseMotorSluice);
+    if (!server.open())
+    {
+        return 1;
+    }
+
+    pthread_t waiter;
+    pthread_create(&waiter, NULL, &signalWaiter, &server);
+    std::cout << "Taking commands on " << argv_control << ", SIGTERM to shut down." << std::endl;
+    server.run();
+    pthread_kill(waiter, SIGTERM); // In case the socket failed rather than a SIGTERM ending run()
+    pthread_join(waiter, NULL);
+
+    ControlReport report = server.report();
+    std::cout << "Shutting down. " << report.accepted << " commands accepted in " << report.acceptAverageUs
+              << " us on average, " << report.acceptMaxUs << " us at most, " << report.refused << " refused." << std::endl;
+    return 0;
+}
+
+LoadTest* loadTest = NULL;
+
+void loadTestStopHandler(int sig){
+    loadTest->stop();
+}
+
+bool addLoadScripts(LoadTest& test, const char argument[])
+{
+    // @file: a script per line, # starts a comment.
+    std::string error;
+    if (argument[0] != '@')
+    {
+        if (!test.addScript(argument, error))
+        {
+            std::cout << "Script " << argument << ": " << error << "." << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    std::ifstream file(argument + 1);
+    if (!file)
+    {
+        std::cout << "Unable to read scripts from " << argument + 1 << "." << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line))
+    {
+        size_t comment = line.find('#');
+        if (comment != std::string::npos)
+        {
+            line.erase(comment);
+        }
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (!line.empty() && !test.addScript(line.c_str(), error))
+        {
+            std::cout << "Script " << line << ": " << error << "." << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int runLoadTest()
+{
+    LoadTest test;
+    test.addSluice(normalSluice1);
+    test.addSluice(normalSluice2);
+    test.addSluice(fastLockSluice);
+    test.addSluice(pulseMotorSluice);
+    for (int i = 0; i < argv_nrofdata; i++)
+    {
+        if (!addLoadScripts(test, argv_data[i]))
+        {
+            return 1;
+        }
+    }
+
+    recoverSluices();
+    // Ctrl-C ends the test after the operations in progress, with a report.
+    loadTest = &test;
+    signal (SIGINT,&loadTestStopHandler);
+    std::cout << "Running " << test.scriptCount() << " scripts";
+    if (argv_forkmax > 0)
+    {
+        std::cout << ", at most " << argv_forkmax << " at a time";
+    }
+    std::cout << "." << std::endl;
+    LoadReport report = test.run(argv_forkmax);
+    signal (SIGINT,SIG_DFL);
+
+    std::cout << "\n" << report.cycles << " cycles, " << report.operations << " operations (" << report.failed
+              << " failed) in " << report.elapsedMs << " ms: " << report.operationsPerS << " operations per second, "
+              << report.cyclesPerHour << " cycles per hour." << std::endl;
+    std::cout << "operation        count   failed   avg us   p50 us   p99 us   max us" << std::endl;
+    for (int i = 0; i < LOAD_OPERATIONS; i++)
+    {
+        LoadOperationStats& stats = report.perOperation[i];
+        if (stats.count > 0)
+        {
+            printf("%-12s %9lld %8lld %8lld %8lld %8lld %8lld\n", LoadTest::operationName(i), stats.count, stats.failed,
+                   stats.averageUs, stats.p50Us, stats.p99Us, stats.maxUs);
+        }
+    }
+    for (int i = 0; i < test.scriptCount(); i++)
+    {
+        LoadScriptReport script = test.scriptReport(i);
+        if (script.failure != success)
+        {
+            std::cout << "Script " << script.text << " stopped after " << script.cycles << " cycles: ";
+            startInterpreter(script.failure, normalSluice1);
+        }
+    }
+    return (report.failed > 0) ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+    emergencyButton.addSluice(normalSluice1);
+    emergencyButton.addSluice(normalSluice2);
+    emergencyButton.addSluice(fastLockSluice);
+    emergencyButton.addSluice(pulseMotorSluice);
+    if (argv_control != NULL)
+    {
+        return runDaemon();
+    }
+    if (argv_nrofdata > 0)
+    {
+        return runLoadTest();
+    }
+    // Blocked before any thread starts, so only buttonWaiter() sees it.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    pthread_t button;
+    pthread_create(&button, NULL, &buttonWaiter, NULL);
+    pthread_detach(button);
+    recoverSluices();
 
     int choice = ' ';
     
@@ -112,6 +462,7 @@ int main(int argc, char const *argv[])
         << "[2] Manage sluice 2 (standard)\n"
         << "[3] Manage sluice 3 (locking doors)\n"
         << "[4] Manage sluice 4 (different motor)\n"
+        << "[f] Spread waiting vessels over all sluices\n"
         << "[q] Quit\n"
         << "Enter your choice: ";
         std::cin >> line;
@@ -121,13 +472,13 @@ int main(int argc, char const *argv[])
         switch (choice)
         {
             case '1':
-                currentSluice = 1;
                 std::cout << "\n==Sluice 1 (standard)==\n";
                 while (choice != '9')
                 {
                     std::cout << "[1]   Allow entry\n"
                               << "[2]   Move boat up/down\n"
                               << "[3]   Allow exiting\n"
+                              << "[4]   Take waiting vessels through\n"
                               << "[9]   Return to main menu\n"
                               << "Enter your choice: ";
                     std::cin >> line;
@@ -138,17 +489,20 @@ int main(int argc, char const *argv[])
                         case '1':
                             std::cout << "Allowing entry into sluice.\n" << std::endl;
                             rtnval = normalSluice1.allowEntry();
-                            entryExitInterpreter(rtnval);
+                            entryExitInterpreter(rtnval, normalSluice1);
                             break;
                         case '2':
                             std::cout << "Moving boat up or down, depending on current position.\n" << std::endl;
                             rtnval = normalSluice1.start();
-                            startInterpreter(rtnval);
+                            startInterpreter(rtnval, normalSluice1);
                             break;
                         case '3':
                             std::cout << "Allowing exiting the sluice.\n" << std::endl;
                             rtnval = normalSluice1.allowExit();
-                            entryExitInterpreter(rtnval);
+                            entryExitInterpreter(rtnval, normalSluice1);
+                            break;
+                        case '4':
+                            scheduleVessels(normalSluice1);
                             break;
                         default:
                             std::cout << "Invalid input." << std::endl;
@@ -157,13 +511,13 @@ int main(int argc, char const *argv[])
                 }
                 break;
             case '2':
-                currentSluice = 2;
                 std::cout << "\n==Sluice 2 (standard)==\n";
                 while (choice != '9')
                 {
                     std::cout << "[1]   Allow entry\n"
                               << "[2]   Move boat up/down\n"
                               << "[3]   Allow exiting\n"
+                              << "[4]   Take waiting vessels through\n"
                               << "[9]   Return to main menu\n"
                               << "Enter your choice: ";
                     std::cin >> line;
@@ -174,17 +528,20 @@ int main(int argc, char const *argv[])
                         case '1':
                             std::cout << "Allowing entry into sluice.\n" << std::endl;
                             rtnval = normalSluice2.allowEntry();
-                            entryExitInterpreter(rtnval);
+                            entryExitInterpreter(rtnval, normalSluice2);
                             break;
                         case '2':
                             std::cout << "Moving boat up or down, depending on current position.\n" << std::endl;
                             rtnval = normalSluice2.start();
-                            startInterpreter(rtnval);
+                            startInterpreter(rtnval, normalSluice2);
                             break;
                         case '3':
                             std::cout << "Allowing exiting the sluice.\n" << std::endl;
                             rtnval = normalSluice2.allowExit();
-                            entryExitInterpreter(rtnval);
+                            entryExitInterpreter(rtnval, normalSluice2);
+                            break;
+                        case '4':
+                            scheduleVessels(normalSluice2);
                             break;
                         default:
                             std::cout << "Invalid input." << std::endl;
@@ -193,13 +550,13 @@ int main(int argc, char const *argv[])
                 }
                 break;
             case '3':
-                currentSluice = 3;
                 std::cout << "\n==Sluice 3 (locking doors)==\n";
                 while (choice != '9')
                 {
                     std::cout << "[1]   Allow entry\n"
                               << "[2]   Move boat up/down\n"
                               << "[3]   Allow exiting\n"
+                              << "[4]   Take waiting vessels through\n"
                               << "[9]   Return to main menu\n"
                               << "Enter your choice: ";
                     std::cin >> line;
@@ -210,17 +567,20 @@ int main(int argc, char const *argv[])
                         case '1':
                             std::cout << "Allowing entry into sluice.\n" << std::endl;
                             rtnval = fastLockSluice.allowEntry();
-                            entryExitInterpreter(rtnval);
+                            entryExitInterpreter(rtnval, fastLockSluice);
                             break;
                         case '2':
                             std::cout << "Moving boat up or down, depending on current position.\n" << std::endl;
                             rtnval = fastLockSluice.start();
-                            startInterpreter(rtnval);
+                            startInterpreter(rtnval, fastLockSluice);
                             break;
                         case '3':
                             std::cout << "Allowing exiting the sluice.\n" << std::endl;
                             rtnval = fastLockSluice.allowExit();
-                            entryExitInterpreter(rtnval);
+                            entryExitInterpreter(rtnval, fastLockSluice);
+                            break;
+                        case '4':
+                            scheduleVessels(fastLockSluice);
                             break;
                         default:
                             std::cout << "Invalid input." << std::endl;
@@ -229,13 +589,13 @@ int main(int argc, char const *argv[])
                 }
                 break;
             case '4':
-                currentSluice = 4;
                 std::cout << "\n==Sluice 4 (different motor)==\n";
                 while (choice != '9')
                 {
                     std::cout << "[1]   Allow entry\n"
                               << "[2]   Move boat up/down\n"
                               << "[3]   Allow exiting\n"
+                              << "[4]   Take waiting vessels through\n"
                               << "[9]   Return to main menu\n"
                               << "Enter your choice: ";
                     std::cin >> line;
@@ -246,17 +606,20 @@ int main(int argc, char const *argv[])
                         case '1':
                             std::cout << "Allowing entry into sluice.\n" << std::endl;
                             rtnval = pulseMotorSluice.allowEntry();
-                            entryExitInterpreter(rtnval);
+                            entryExitInterpreter(rtnval, pulseMotorSluice);
                             break;
                         case '2':
                             std::cout << "Moving boat up or down, depending on current position.\n" << std::endl;
                             rtnval = pulseMotorSluice.start();
-                            startInterpreter(rtnval);
+                            startInterpreter(rtnval, pulseMotorSluice);
                             break;
                         case '3':
                             std::cout << "Allowing exiting the sluice.\n" << std::endl;
                             rtnval = pulseMotorSluice.allowExit();
-                            entryExitInterpreter(rtnval);
+                            entryExitInterpreter(rtnval, pulseMotorSluice);
+                            break;
+                        case '4':
+                            scheduleVessels(pulseMotorSluice);
                             break;
                         default:
                             std::cout << "Invalid input." << std::endl;
@@ -264,6 +627,9 @@ int main(int argc, char const *argv[])
                     }
                 }
                 break;
+            case 'f':
+                dispatchVessels();
+                break;
             case 'q':
                 std::cout << "Shutting down." << std::endl;
                 break;
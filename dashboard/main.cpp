@@ -0,0 +1,56 @@
+// sluiceboard: watches the sluices a running controller manages, from the
+// status board it publishes on. It never talks to a simulator.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../code/Dashboard.h"
+#include "../code/lib/timing.h"
+
+#define DEFAULT_REFRESH_MS 50
+
+int main(int argc, char *argv[])
+{
+    int refreshMs = DEFAULT_REFRESH_MS;
+    long long frames = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:n:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'r':
+                refreshMs = atoi(optarg);
+                break;
+            case 'n':
+                frames = atoll(optarg);
+                break;
+            default:
+                printf("\noptions: \n"
+                    "    -r <refresh-ms>       time between frames, %d by default \n"
+                    "    -n <frames>           stop after this many, 0 to go on \n"
+                    "\n", DEFAULT_REFRESH_MS);
+                return (opt == 'h') ? 0 : 1;
+        }
+    }
+
+    Dashboard dashboard(STATUS_BOARD_NAME);
+    for (long long frame = 0; frames == 0 || frame < frames; frame++)
+    {
+        if (!dashboard.open())
+        {
+            printf("\033[H\033[JWaiting for a controller to publish on %s.\n", STATUS_BOARD_NAME);
+            fflush(stdout);
+        }
+        else
+        {
+            const std::string& shown = dashboard.render();
+            if (write(STDOUT_FILENO, shown.data(), shown.size()) < 0)
+            {
+                return 1;
+            }
+        }
+        sleepMs(refreshMs);
+    }
+    return 0;
+}